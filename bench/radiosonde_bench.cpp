@@ -0,0 +1,761 @@
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <dsp/demod/fm.h>
+#include <dsp/multirate/rational_resampler.h>
+#include "flightlog.hpp"
+#include "frontend.hpp"
+#include "gpx.hpp"
+#include "ptu.hpp"
+#include "recording.hpp"
+#include "replay.hpp"
+#include "sondetypes.hpp"
+
+#define BENCH_SAMPLERATE 48000      /* Decoder samplerate, same as the plugin default */
+#define BENCH_BLOCK_SIZE 1024       /* Samples per process() call, about a VFO block */
+#define BENCH_DURATION 60           /* Seconds of synthetic signal per benchmark */
+#define BENCH_BAUDRATE 4800         /* Symbol rate of the synthetic signals */
+#define BENCH_RECORDS 100000        /* Records written by each writer benchmark */
+#define BENCH_RATE_TOLERANCE 10     /* Default throughput drop from the baseline that fails the run, in % */
+#define BENCH_FRAME_TOLERANCE 0     /* Default frame count drop from the baseline that fails the run, in % */
+#define GOLDEN_CSV_SUFFIX ".golden.csv"
+#define GOLDEN_FLT_SUFFIX ".golden.flt"
+
+struct Source {
+	std::string name;
+	const radiosonde::SondeType *type;  /* NULL if usable with any decoder */
+	std::vector<float> audio;           /* FM-demodulated, at BENCH_SAMPLERATE */
+};
+
+/* Recording from the regression corpus, decoded end to end */
+struct CorpusEntry {
+	std::string name;                   /* As listed, so that results compare across machines */
+	std::string path;
+	const radiosonde::SondeType *type;
+};
+
+struct FrameCounter {
+	int frames;
+};
+
+/* Writers fed by the corpus run, the same ones the plugin logs to */
+struct CorpusOutput {
+	PTUWriter ptu;
+	FlightLogWriter flightlog;
+};
+
+/* Captures the output of the replay chain, instead of decoding it */
+class AudioCapture : public radiosonde::DecoderBase {
+public:
+	AudioCapture(std::vector<float> *out) { m_out = out; };
+	void init(dsp::stream<float> *in, int samplerate, void (*callback)(SondeFullData *data, void *ctx), void *ctx) override {};
+	void deinit() override {};
+	void setInput(dsp::stream<float> *in) override {};
+	void setSamplerate(int samplerate) override {};
+	void setBatching(int minSamples, int latencyMs) override {};
+	void process(const float *in, int count) override { m_out->insert(m_out->end(), in, in + count); };
+	int run() override { return -1; };
+private:
+	std::vector<float> *m_out;
+};
+
+static void usage(const char *pname);
+static double now();
+static uint32_t lcg(uint32_t *state);
+static float noise(uint32_t *state);
+static void synth_fsk(std::vector<float> &out, double samplerate, double duration);
+static bool load_recording(Source *source, const char *spec);
+static bool load_corpus(std::vector<CorpusEntry> &corpus, const char *list);
+static bool parse_sweep(const char *spec, float *min, float *max, float *step);
+static std::string bench_decoder(const radiosonde::SondeType *type, const Source *source);
+template<class Demod, class Resampler>
+static std::string bench_frontend(const char *kernel, float bandwidth, int taps, double duration);
+static std::string bench_gpx(const char *dir);
+static std::string bench_ptu(const char *dir);
+static std::string bench_flightlog(const char *dir);
+static std::string bench_corpus(const CorpusEntry *entry, const char *dir, bool update, int *frames, int *failures);
+static std::string bench_snr(const CorpusEntry *entry, float snr, int cleanFrames);
+static int check_baseline(const char *path, const std::vector<std::string> &results, double rateTolerance, double frameTolerance);
+static std::string json_value(const std::string &line, const char *key);
+static int compare_files(const char *a, const char *b);
+static bool copy_file(const char *src, const char *dst);
+static void frame_handler(SondeFullData *data, void *ctx);
+static void corpus_handler(SondeFullData *data, void *ctx);
+
+int
+main(int argc, char *argv[])
+{
+	std::vector<Source> sources;
+	std::vector<std::string> results;
+	std::vector<std::pair<float, int>> frontends;
+	std::vector<CorpusEntry> corpus;
+	const char *outPath = NULL, *dir = ".", *baselinePath = NULL;
+	double duration = BENCH_DURATION;
+	double rateTolerance = BENCH_RATE_TOLERANCE, frameTolerance = BENCH_FRAME_TOLERANCE;
+	float snrMin = 0, snrMax = 0, snrStep = 0;
+	bool update = false, sweep = false;
+	int failures = 0;
+	FILE *out;
+
+	for (int i=1; i<argc; i++) {
+		const bool hasValue = i + 1 < argc;
+
+		if (!strcmp(argv[i], "-i") && hasValue) {
+			Source source;
+			if (!load_recording(&source, argv[++i])) {
+				fprintf(stderr, "%s: could not load recording (expected type:file.wav)\n", argv[i]);
+				return 1;
+			}
+			sources.push_back(source);
+		} else if (!strcmp(argv[i], "-d") && hasValue) {
+			duration = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-o") && hasValue) {
+			outPath = argv[++i];
+		} else if (!strcmp(argv[i], "-w") && hasValue) {
+			dir = argv[++i];
+		} else if (!strcmp(argv[i], "-c") && hasValue) {
+			if (!load_corpus(corpus, argv[++i])) {
+				fprintf(stderr, "%s: could not load corpus (expected one type:file.wav per line)\n", argv[i]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "-u")) {
+			update = true;
+		} else if (!strcmp(argv[i], "-s") && hasValue) {
+			if (!(sweep = parse_sweep(argv[++i], &snrMin, &snrMax, &snrStep))) {
+				fprintf(stderr, "%s: invalid SNR range (expected min:max:step, in dB)\n", argv[i]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "-b") && hasValue) {
+			baselinePath = argv[++i];
+		} else if (!strcmp(argv[i], "-t") && hasValue) {
+			rateTolerance = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-f") && hasValue) {
+			frameTolerance = atof(argv[++i]);
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	/* The synthetic signal goes through every decoder. Random symbols never
+	 * decode, so it only measures the cost of looking for a sync word, which
+	 * is what most channels spend their time doing */
+	sources.insert(sources.begin(), Source());
+	sources[0].name = "synthetic";
+	sources[0].type = NULL;
+	synth_fsk(sources[0].audio, BENCH_SAMPLERATE, duration);
+
+	for (int i=0; i<radiosonde::sondeTypeCount; i++) {
+		const radiosonde::SondeType *type = &radiosonde::sondeTypes[i];
+
+		for (auto &source : sources) {
+			if (source.type && source.type != type) continue;
+			fprintf(stderr, "Decoder: %s (%s)\n", type->id, source.name.c_str());
+			results.push_back(bench_decoder(type, &source));
+		}
+
+		const std::pair<float, int> frontend(type->bandwidth, type->resamplerTaps);
+		if (std::find(frontends.begin(), frontends.end(), frontend) == frontends.end()) {
+			frontends.push_back(frontend);
+		}
+	}
+
+	/* SDR++ blocks, then the fixed kernels the plugin uses */
+	for (auto &frontend : frontends) {
+		fprintf(stderr, "Frontend: %.0f Hz\n", frontend.first);
+		results.push_back(bench_frontend<dsp::demod::FM<float>, dsp::multirate::RationalResampler<float>>("sdrpp", frontend.first, frontend.second, duration));
+		results.push_back(bench_frontend<radiosonde::FMDiscriminator, radiosonde::FixedResampler>("fixed", frontend.first, frontend.second, duration));
+	}
+
+	fprintf(stderr, "Writers\n");
+	results.push_back(bench_gpx(dir));
+	results.push_back(bench_ptu(dir));
+	results.push_back(bench_flightlog(dir));
+
+	/* Full chain on real signals: frames have to match the golden outputs
+	 * exactly, then get counted as the signal is buried in noise */
+	for (auto &entry : corpus) {
+		int frames;
+
+		fprintf(stderr, "Corpus: %s (%s)\n", entry.type->id, entry.name.c_str());
+		results.push_back(bench_corpus(&entry, dir, update, &frames, &failures));
+		if (!sweep) continue;
+		for (int step=0; snrMax - step * snrStep >= snrMin - snrStep / 2; step++) {
+			results.push_back(bench_snr(&entry, snrMax - step * snrStep, frames));
+		}
+	}
+	if (!corpus.empty()) {
+		for (int i=0; i<radiosonde::sondeTypeCount; i++) {
+			const radiosonde::SondeType *type = &radiosonde::sondeTypes[i];
+			if (std::none_of(corpus.begin(), corpus.end(), [type](const CorpusEntry &entry) { return entry.type == type; })) {
+				fprintf(stderr, "Warning: no corpus recording for %s\n", type->id);
+			}
+		}
+	}
+
+	/* Before writing, in case the results replace the baseline */
+	if (baselinePath) failures += check_baseline(baselinePath, results, rateTolerance, frameTolerance);
+
+	if (!outPath) {
+		out = stdout;
+	} else if (!(out = fopen(outPath, "w"))) {
+		fprintf(stderr, "%s: could not open output\n", outPath);
+		return 1;
+	}
+
+	fprintf(out, "{\n  \"samplerate\": %d,\n  \"block_size\": %d,\n  \"results\": [\n", BENCH_SAMPLERATE, BENCH_BLOCK_SIZE);
+	for (size_t i=0; i<results.size(); i++) {
+		fprintf(out, "    %s%s\n", results[i].c_str(), i + 1 < results.size() ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+
+	if (out != stdout) fclose(out);
+
+	if (failures) fprintf(stderr, "%d check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}
+
+static void
+usage(const char *pname)
+{
+	fprintf(stderr, "Usage: %s [-d seconds] [-i type:recording.wav]... [-c corpus.txt [-u] [-s min:max:step]]\n"
+	                "       [-b baseline.json [-t percent] [-f percent]] [-w dir] [-o results.json]\n", pname);
+	fprintf(stderr, "Measure the throughput of the decoders, the FM frontend and the output writers\n\n");
+	fprintf(stderr, "   -d <seconds>   Length of the synthetic signals (default %d)\n", BENCH_DURATION);
+	fprintf(stderr, "   -i <spec>      Also run a recording through the decoder for its type (e.g. rs41:flight.wav)\n");
+	fprintf(stderr, "   -c <file>      Decode the recordings listed in a file end to end, and compare the\n"
+	                "                  CSV and flight log outputs with <recording>%s and %s\n", GOLDEN_CSV_SUFFIX, GOLDEN_FLT_SUFFIX);
+	fprintf(stderr, "   -u             Write the golden outputs instead of comparing with them\n");
+	fprintf(stderr, "   -s <range>     Count the corpus frames decoded with noise added, from max down to min SNR (dB)\n");
+	fprintf(stderr, "   -b <file>      Fail if throughput or frame counts dropped compared to an earlier results file\n");
+	fprintf(stderr, "   -t <percent>   Throughput drop tolerated by -b (default %d)\n", BENCH_RATE_TOLERANCE);
+	fprintf(stderr, "   -f <percent>   Frame count drop tolerated by -b (default %d)\n", BENCH_FRAME_TOLERANCE);
+	fprintf(stderr, "   -w <dir>       Directory for the files written by the writer benchmarks (default .)\n");
+	fprintf(stderr, "   -o <file>      Write the results to a file instead of standard output\n");
+}
+
+/* Benchmarks {{{ */
+static std::string
+bench_decoder(const radiosonde::SondeType *type, const Source *source)
+{
+	radiosonde::DecoderBase *decoder = type->create();
+	FrameCounter counter;
+	std::vector<double> latencies;
+	double elapsed = 0, maxBlock = 0, mean = 0, p99 = 0, max = 0;
+	const size_t count = source->audio.size();
+	char buf[512];
+	int frames;
+
+	counter.frames = 0;
+	decoder->init(NULL, BENCH_SAMPLERATE, frame_handler, &counter);
+
+	for (size_t i=0; i<count; i += BENCH_BLOCK_SIZE) {
+		const int len = std::min((size_t)BENCH_BLOCK_SIZE, count - i);
+		const double start = now();
+
+		frames = counter.frames;
+		decoder->process(source->audio.data() + i, len);
+		const double dt = now() - start;
+
+		/* The frame was complete somewhere in this block: the time spent in
+		 * process() is an upper bound on how long it took to come out */
+		if (counter.frames != frames) latencies.push_back(dt);
+		elapsed += dt;
+		maxBlock = std::max(maxBlock, dt);
+	}
+
+	decoder->deinit();
+	delete decoder;
+
+	if (!latencies.empty()) {
+		for (double latency : latencies) mean += latency;
+		mean /= latencies.size();
+		std::sort(latencies.begin(), latencies.end());
+		p99 = latencies[std::min(latencies.size() - 1, (size_t)(latencies.size() * 0.99))];
+		max = latencies.back();
+	}
+
+	snprintf(buf, sizeof(buf),
+	         "{\"benchmark\": \"decoder\", \"type\": \"%s\", \"source\": \"%s\", \"samples\": %zu, \"seconds\": %.6f, "
+	         "\"samples_per_sec\": %.0f, \"realtime_factor\": %.1f, \"max_block_us\": %.1f, \"frames\": %d, "
+	         "\"frame_latency_us\": {\"mean\": %.1f, \"p99\": %.1f, \"max\": %.1f}}",
+	         type->id, source->name.c_str(), count, elapsed,
+	         elapsed > 0 ? count / elapsed : 0, elapsed > 0 ? count / (double)BENCH_SAMPLERATE / elapsed : 0,
+	         maxBlock * 1e6, counter.frames, mean * 1e6, p99 * 1e6, max * 1e6);
+	return buf;
+}
+
+/* Demodulator and resampler construction differs between the two kernels */
+static void
+frontend_init(dsp::demod::FM<float> *fmDemod, dsp::multirate::RationalResampler<float> *resampler, float bandwidth, int taps)
+{
+	fmDemod->init(NULL, bandwidth, bandwidth/2.0f, false);
+	resampler->init(NULL, bandwidth, BENCH_SAMPLERATE);
+}
+
+static void
+frontend_init(radiosonde::FMDiscriminator *fmDemod, radiosonde::FixedResampler *resampler, float bandwidth, int taps)
+{
+	fmDemod->init(NULL, bandwidth, bandwidth/2.0f);
+	resampler->init(NULL, bandwidth, BENCH_SAMPLERATE, taps);
+}
+
+template<class Demod, class Resampler>
+static std::string
+bench_frontend(const char *kernel, float bandwidth, int taps, double duration)
+{
+	Demod fmDemod;
+	Resampler resampler;
+	const size_t count = bandwidth * duration;
+	const int outSize = BENCH_BLOCK_SIZE * std::max(1.0f, (float)BENCH_SAMPLERATE / bandwidth) + 1;
+	std::vector<dsp::complex_t> iq(count);
+	std::vector<float> audio(BENCH_BLOCK_SIZE), resampled(outSize), symbols;
+	uint32_t state = 1;
+	double phase = 0, elapsed, start;
+	char buf[256];
+
+	/* FM-modulate a synthetic baseband signal, plus some noise */
+	synth_fsk(symbols, bandwidth, duration);
+	for (size_t i=0; i<count; i++) {
+		phase += M_PI / 2 * symbols[i];
+		iq[i].re = cos(phase) + 0.1 * noise(&state);
+		iq[i].im = sin(phase) + 0.1 * noise(&state);
+	}
+
+	frontend_init(&fmDemod, &resampler, bandwidth, taps);
+
+	start = now();
+	for (size_t i=0; i<count; i += BENCH_BLOCK_SIZE) {
+		int len = std::min((size_t)BENCH_BLOCK_SIZE, count - i);
+		len = fmDemod.process(len, iq.data() + i, audio.data());
+		resampler.process(len, audio.data(), resampled.data());
+	}
+	elapsed = now() - start;
+
+	snprintf(buf, sizeof(buf),
+	         "{\"benchmark\": \"frontend\", \"kernel\": \"%s\", \"bandwidth\": %.0f, \"taps\": %d, \"samples\": %zu, "
+	         "\"seconds\": %.6f, \"samples_per_sec\": %.0f, \"realtime_factor\": %.1f}",
+	         kernel, bandwidth, taps, count, elapsed, elapsed > 0 ? count / elapsed : 0, elapsed > 0 ? duration / elapsed : 0);
+	return buf;
+}
+
+static std::string
+bench_gpx(const char *dir)
+{
+	const std::string path = std::string(dir) + "/radiosonde_bench.gpx";
+	GPXWriter writer;
+	double elapsed, start;
+	char buf[256];
+
+	if (!writer.init(path.c_str())) return "{\"benchmark\": \"gpx\", \"error\": \"could not open output\"}";
+
+	start = now();
+	writer.startTrack("BENCH");
+	for (int i=0; i<BENCH_RECORDS; i++) {
+		writer.addTrackPoint(1600000000 + i, 45.0 + i * 1e-6, 9.0 + i * 1e-6, 100.0 + i * 0.1, 5.0, 90.0);
+	}
+	writer.deinit();
+	elapsed = now() - start;
+	remove(path.c_str());
+
+	snprintf(buf, sizeof(buf), "{\"benchmark\": \"gpx\", \"records\": %d, \"seconds\": %.6f, \"records_per_sec\": %.0f}",
+	         BENCH_RECORDS, elapsed, elapsed > 0 ? BENCH_RECORDS / elapsed : 0);
+	return buf;
+}
+
+static std::string
+bench_ptu(const char *dir)
+{
+	const std::string path = std::string(dir) + "/radiosonde_bench.csv";
+	PTUWriter writer;
+	SondeFullData data;
+	double elapsed, start;
+	char buf[256];
+
+	if (!writer.init(path.c_str())) return "{\"benchmark\": \"ptu\", \"error\": \"could not open output\"}";
+
+	data.init();
+	snprintf(data.serial, sizeof(data.serial), "BENCH");
+	start = now();
+	for (int i=0; i<BENCH_RECORDS; i++) {
+		data.time = 1600000000 + i;
+		data.alt = 100.0 + i * 0.1;
+		data.temp = 15.0 - i * 1e-3;
+		writer.addPoint(&data);
+	}
+	writer.deinit();
+	elapsed = now() - start;
+	remove(path.c_str());
+
+	snprintf(buf, sizeof(buf), "{\"benchmark\": \"ptu\", \"records\": %d, \"seconds\": %.6f, \"records_per_sec\": %.0f}",
+	         BENCH_RECORDS, elapsed, elapsed > 0 ? BENCH_RECORDS / elapsed : 0);
+	return buf;
+}
+
+static std::string
+bench_flightlog(const char *dir)
+{
+	const std::string path = std::string(dir) + "/radiosonde_bench.flt";
+	FlightLogWriter writer;
+	SondeFullData data;
+	double elapsed, start;
+	char buf[256];
+
+	if (!writer.init(path.c_str())) return "{\"benchmark\": \"flightlog\", \"error\": \"could not open output\"}";
+
+	data.init();
+	snprintf(data.serial, sizeof(data.serial), "BENCH");
+	start = now();
+	for (int i=0; i<BENCH_RECORDS; i++) {
+		data.time = 1600000000 + i;
+		data.alt = 100.0 + i * 0.1;
+		writer.addPoint(&data);
+	}
+	writer.deinit();
+	elapsed = now() - start;
+	remove(path.c_str());
+
+	snprintf(buf, sizeof(buf), "{\"benchmark\": \"flightlog\", \"records\": %d, \"seconds\": %.6f, \"records_per_sec\": %.0f}",
+	         BENCH_RECORDS, elapsed, elapsed > 0 ? BENCH_RECORDS / elapsed : 0);
+	return buf;
+}
+
+/* Same chain as the plugin: FM discriminator, then FixedResampler with the
+ * taps of the sonde type, then the decoder and the writers */
+static std::string
+bench_corpus(const CorpusEntry *entry, const char *dir, bool update, int *frames, int *failures)
+{
+	const std::string csvPath = std::string(dir) + "/radiosonde_corpus.csv";
+	const std::string fltPath = std::string(dir) + "/radiosonde_corpus.flt";
+	const std::string goldenCsv = entry->path + GOLDEN_CSV_SUFFIX;
+	const std::string goldenFlt = entry->path + GOLDEN_FLT_SUFFIX;
+	radiosonde::Recording recording;
+	radiosonde::Replay replay;
+	radiosonde::Replay::Stats stats;
+	radiosonde::DecoderBase *decoder;
+	CorpusOutput output;
+	const char *golden;
+	char buf[512];
+
+	*frames = 0;
+	if (!recording.openWAV(entry->path.c_str())) {
+		(*failures)++;
+		return "{\"benchmark\": \"corpus\", \"source\": \"" + entry->name + "\", \"error\": \"could not open recording\"}";
+	}
+
+	/* Both writers append, start from empty files */
+	remove(csvPath.c_str());
+	remove(fltPath.c_str());
+	if (!output.ptu.init(csvPath.c_str()) || !output.flightlog.init(fltPath.c_str())) {
+		(*failures)++;
+		return "{\"benchmark\": \"corpus\", \"source\": \"" + entry->name + "\", \"error\": \"could not open output\"}";
+	}
+
+	decoder = entry->type->create();
+	if (!replay.init(&recording, decoder, entry->type->bandwidth, entry->type->resamplerTaps, BENCH_SAMPLERATE, corpus_handler, &output)) {
+		delete decoder;
+		(*failures)++;
+		return "{\"benchmark\": \"corpus\", \"source\": \"" + entry->name + "\", \"error\": \"could not set up the decoder\"}";
+	}
+	stats = replay.run();
+	replay.deinit();
+	delete decoder;
+	output.ptu.deinit();
+	output.flightlog.deinit();
+	*frames = stats.frames;
+
+	if (update) {
+		golden = copy_file(csvPath.c_str(), goldenCsv.c_str()) && copy_file(fltPath.c_str(), goldenFlt.c_str()) ? "updated" : "error";
+	} else {
+		const int csv = compare_files(csvPath.c_str(), goldenCsv.c_str());
+		const int flt = compare_files(fltPath.c_str(), goldenFlt.c_str());
+		golden = csv < 0 || flt < 0 ? "missing" : csv && flt ? "match" : "mismatch";
+	}
+	if (strcmp(golden, "match") && strcmp(golden, "updated")) {
+		fprintf(stderr, "%s: decoded output %s golden files\n", entry->name.c_str(),
+		        !strcmp(golden, "mismatch") ? "differs from the" : "could not be compared with the");
+		(*failures)++;
+	}
+	remove(csvPath.c_str());
+	remove(fltPath.c_str());
+
+	snprintf(buf, sizeof(buf),
+	         "{\"benchmark\": \"corpus\", \"type\": \"%s\", \"source\": \"%s\", \"samples\": %llu, \"seconds\": %.6f, "
+	         "\"samples_per_sec\": %.0f, \"realtime_factor\": %.1f, \"frames\": %d, \"frames_per_min\": %.1f, \"golden\": \"%s\"}",
+	         entry->type->id, entry->name.c_str(), (unsigned long long)stats.samples, stats.elapsed,
+	         stats.elapsed > 0 ? stats.samples / stats.elapsed : 0, stats.elapsed > 0 ? stats.duration / stats.elapsed : 0,
+	         stats.frames, stats.duration > 0 ? stats.frames * 60 / stats.duration : 0, golden);
+	return buf;
+}
+
+static std::string
+bench_snr(const CorpusEntry *entry, float snr, int cleanFrames)
+{
+	radiosonde::Recording recording;
+	radiosonde::Replay replay;
+	radiosonde::Replay::Stats stats;
+	radiosonde::DecoderBase *decoder;
+	char buf[256];
+
+	if (!recording.openWAV(entry->path.c_str())) {
+		return "{\"benchmark\": \"snr\", \"source\": \"" + entry->name + "\", \"error\": \"could not open recording\"}";
+	}
+
+	/* Only the decoder output matters here, the writers were checked already */
+	decoder = entry->type->create();
+	if (!replay.init(&recording, decoder, entry->type->bandwidth, entry->type->resamplerTaps, BENCH_SAMPLERATE, NULL, NULL)) {
+		delete decoder;
+		return "{\"benchmark\": \"snr\", \"source\": \"" + entry->name + "\", \"error\": \"could not set up the decoder\"}";
+	}
+	replay.setNoise(snr);
+	stats = replay.run();
+	replay.deinit();
+	delete decoder;
+
+	snprintf(buf, sizeof(buf),
+	         "{\"benchmark\": \"snr\", \"type\": \"%s\", \"source\": \"%s\", \"snr_db\": %.1f, \"frames\": %d, \"recovered\": %.3f}",
+	         entry->type->id, entry->name.c_str(), snr, stats.frames, cleanFrames > 0 ? stats.frames / (double)cleanFrames : 0);
+	return buf;
+}
+/* }}} */
+
+/* Regression checks {{{ */
+/**
+ * Compare results with an earlier run. Both are matched line by line, by the
+ * fields that identify a benchmark, so the baseline has to be a file written
+ * by this program
+ */
+static int
+check_baseline(const char *path, const std::vector<std::string> &results, double rateTolerance, double frameTolerance)
+{
+	static const char *keys[] = {"benchmark", "type", "source", "kernel", "bandwidth", "taps", "snr_db"};
+	std::vector<std::string> baseline;
+	char line[1024];
+	int failures = 0;
+	FILE *fd;
+
+	if (!(fd = fopen(path, "r"))) {
+		fprintf(stderr, "%s: could not open baseline\n", path);
+		return 1;
+	}
+	while (fgets(line, sizeof(line), fd)) {
+		if (strstr(line, "\"benchmark\"")) baseline.push_back(line);
+	}
+	fclose(fd);
+
+	for (const auto &result : results) {
+		std::string id;
+
+		for (const char *key : keys) id += json_value(result, key) + "/";
+		for (const auto &base : baseline) {
+			std::string baseId;
+
+			for (const char *key : keys) baseId += json_value(base, key) + "/";
+			if (baseId != id) continue;
+
+			const std::string rate = json_value(result, "samples_per_sec"), baseRate = json_value(base, "samples_per_sec");
+			const std::string frames = json_value(result, "frames"), baseFrames = json_value(base, "frames");
+			if (!rate.empty() && !baseRate.empty() && atof(rate.c_str()) < atof(baseRate.c_str()) * (1 - rateTolerance / 100)) {
+				fprintf(stderr, "Regression: %s%s samples/s, was %s\n", id.c_str(), rate.c_str(), baseRate.c_str());
+				failures++;
+			}
+			if (!frames.empty() && !baseFrames.empty() && atof(frames.c_str()) < atof(baseFrames.c_str()) * (1 - frameTolerance / 100)) {
+				fprintf(stderr, "Regression: %s%s frames, was %s\n", id.c_str(), frames.c_str(), baseFrames.c_str());
+				failures++;
+			}
+			break;
+		}
+	}
+
+	return failures;
+}
+
+/* Value of a top-level field in a result line, without quotes, empty if absent */
+static std::string
+json_value(const std::string &line, const char *key)
+{
+	const std::string field = std::string("\"") + key + "\": ";
+	size_t start, end;
+
+	if ((start = line.find(field)) == std::string::npos) return "";
+	start += field.size();
+	if (line[start] == '"') {
+		start++;
+		end = line.find('"', start);
+	} else {
+		end = line.find_first_of(",}", start);
+	}
+	return line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
+
+/* 1 if both files have the same contents, 0 if not, -1 if either can't be read */
+static int
+compare_files(const char *a, const char *b)
+{
+	FILE *fa, *fb;
+	char bufA[4096], bufB[4096];
+	size_t lenA, lenB;
+	int same = 1;
+
+	if (!(fa = fopen(a, "rb"))) return -1;
+	if (!(fb = fopen(b, "rb"))) {
+		fclose(fa);
+		return -1;
+	}
+	do {
+		lenA = fread(bufA, 1, sizeof(bufA), fa);
+		lenB = fread(bufB, 1, sizeof(bufB), fb);
+		if (lenA != lenB || memcmp(bufA, bufB, lenA)) same = 0;
+	} while (same && lenA > 0);
+
+	fclose(fa);
+	fclose(fb);
+	return same;
+}
+
+static bool
+copy_file(const char *src, const char *dst)
+{
+	FILE *in, *out;
+	char buf[4096];
+	size_t len;
+	bool ok = true;
+
+	if (!(in = fopen(src, "rb"))) return false;
+	if (!(out = fopen(dst, "wb"))) {
+		fclose(in);
+		return false;
+	}
+	while ((len = fread(buf, 1, sizeof(buf), in)) > 0) ok &= fwrite(buf, 1, len, out) == len;
+
+	fclose(in);
+	ok &= !fclose(out);
+	return ok;
+}
+/* }}} */
+
+/* Signal sources {{{ */
+static uint32_t
+lcg(uint32_t *state)
+{
+	*state = *state * 1664525 + 1013904223;
+	return *state;
+}
+
+static float
+noise(uint32_t *state)
+{
+	return (lcg(state) >> 8) / (float)(1 << 24) * 2 - 1;
+}
+
+static void
+synth_fsk(std::vector<float> &out, double samplerate, double duration)
+{
+	const size_t count = samplerate * duration;
+	const double samplesPerSymbol = samplerate / BENCH_BAUDRATE;
+	uint32_t state = 1;
+	float symbol = 0, level = 0;
+
+	/* Random NRZ symbols through a one-pole lowpass, plus noise. Same seed
+	 * every time, so that runs are comparable */
+	out.resize(count);
+	for (size_t i=0; i<count; i++) {
+		if (fmod(i, samplesPerSymbol) < 1) symbol = lcg(&state) & 0x80000000 ? 1 : -1;
+		level += 0.3f * (symbol - level);
+		out[i] = 0.8f * level + 0.2f * noise(&state);
+	}
+}
+
+static bool
+load_recording(Source *source, const char *spec)
+{
+	radiosonde::Recording recording;
+	radiosonde::Replay replay;
+	const char *sep;
+	char id[32];
+
+	if (!(sep = strchr(spec, ':')) || sep - spec >= (long)sizeof(id)) return false;
+	snprintf(id, sizeof(id), "%.*s", (int)(sep - spec), spec);
+	if (!(source->type = radiosonde::findSondeType(id))) return false;
+	if (!recording.openWAV(sep + 1)) return false;
+
+	/* Run the recording through the frontend once, so that decoders are
+	 * timed on their own */
+	AudioCapture capture(&source->audio);
+	if (!replay.init(&recording, &capture, source->type->bandwidth, source->type->resamplerTaps, BENCH_SAMPLERATE, NULL, NULL)) return false;
+	replay.run();
+	replay.deinit();
+
+	source->name = sep + 1;
+	return true;
+}
+
+/* One type:file.wav per line, relative to the list. Blank lines and lines
+ * starting with # are skipped */
+static bool
+load_corpus(std::vector<CorpusEntry> &corpus, const char *list)
+{
+	const char *sep = strrchr(list, '/');
+	const std::string base = sep ? std::string(list, sep - list + 1) : "";
+	char line[1024], *end, *colon;
+	FILE *fd;
+
+	if (!(fd = fopen(list, "r"))) return false;
+	while (fgets(line, sizeof(line), fd)) {
+		CorpusEntry entry;
+
+		end = line + strlen(line);
+		while (end > line && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t')) *--end = 0;
+		if (!line[0] || line[0] == '#') continue;
+
+		if (!(colon = strchr(line, ':'))) {
+			fclose(fd);
+			return false;
+		}
+		*colon = 0;
+		if (!(entry.type = radiosonde::findSondeType(line))) {
+			fclose(fd);
+			return false;
+		}
+		entry.name = colon + 1;
+		entry.path = colon[1] == '/' ? entry.name : base + entry.name;
+		corpus.push_back(entry);
+	}
+
+	fclose(fd);
+	return true;
+}
+
+static bool
+parse_sweep(const char *spec, float *min, float *max, float *step)
+{
+	return sscanf(spec, "%f:%f:%f", min, max, step) == 3 && *step > 0 && *max >= *min;
+}
+/* }}} */
+
+static double
+now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void
+frame_handler(SondeFullData *data, void *ctx)
+{
+	FrameCounter *counter = (FrameCounter*)ctx;
+	counter->frames++;
+}
+
+static void
+corpus_handler(SondeFullData *data, void *ctx)
+{
+	CorpusOutput *output = (CorpusOutput*)ctx;
+	output->ptu.addPoint(data);
+	output->flightlog.addPoint(data);
+}
@@ -0,0 +1,155 @@
+#include <chrono>
+#include "asyncwriter.hpp"
+
+using namespace radiosonde;
+
+AsyncWriter::AsyncWriter()
+{
+	m_batch = NULL;
+	m_batchSize = 0;
+	m_write = NULL;
+	m_flush = NULL;
+	m_ctx = NULL;
+	m_flushInterval = m_flushSize = 0;
+	m_maxDepth = 0;
+	m_written = m_dropped = 0;
+	m_running = false;
+	m_syncRequested = m_syncDone = 0;
+}
+
+void
+AsyncWriter::init(int capacity, int flushInterval, int flushSize,
+                  void (*write)(const SondeFullData *data, int count, void *ctx), void (*flush)(void *ctx), void *ctx)
+{
+	if (m_batch) deinit();
+
+	m_queue.init(capacity);
+	m_batchSize = m_queue.capacity();
+	m_batch = new SondeFullData[m_batchSize];
+	m_write = write;
+	m_flush = flush;
+	m_ctx = ctx;
+	setFlushPolicy(flushInterval, flushSize);
+	m_maxDepth = 0;
+	m_written = m_dropped = 0;
+
+	m_running = true;
+	m_thread = std::thread(&AsyncWriter::workerLoop, this);
+}
+
+void
+AsyncWriter::deinit()
+{
+	if (!m_batch) return;
+
+	{
+		std::lock_guard<std::mutex> lck(m_wakeMtx);
+		m_running = false;
+	}
+	m_wakeCV.notify_one();
+	m_thread.join();
+
+	delete[] m_batch;
+	m_batch = NULL;
+}
+
+bool
+AsyncWriter::push(const SondeFullData &data)
+{
+	size_t depth, maxDepth;
+
+	if (!m_queue.push(data)) {
+		m_dropped++;
+		return false;
+	}
+
+	/* Keep track of the high-water mark, to tell how close we got to dropping frames */
+	depth = m_queue.size();
+	maxDepth = m_maxDepth.load(std::memory_order_relaxed);
+	while (depth > maxDepth && !m_maxDepth.compare_exchange_weak(maxDepth, depth, std::memory_order_relaxed));
+
+	/* Only wake up the writer once there is a full batch, the timeout takes care of the rest */
+	if (depth >= (size_t)m_flushSize.load(std::memory_order_relaxed)) m_wakeCV.notify_one();
+	return true;
+}
+
+void
+AsyncWriter::sync()
+{
+	std::unique_lock<std::mutex> lck(m_wakeMtx);
+	unsigned long request;
+
+	if (!m_running) return;
+
+	request = ++m_syncRequested;
+	m_wakeCV.notify_one();
+	m_syncCV.wait(lck, [&]{ return m_syncDone >= request; });
+}
+
+void
+AsyncWriter::setFlushPolicy(int flushInterval, int flushSize)
+{
+	m_flushInterval = flushInterval > 0 ? flushInterval : 1;
+	m_flushSize = flushSize > 0 ? flushSize : 1;
+}
+
+/* Private methods {{{ */
+void
+AsyncWriter::workerLoop()
+{
+	auto lastFlush = std::chrono::steady_clock::now();
+	unsigned long syncRequested;
+	bool running;
+	uint64_t start;
+	int count, unflushed;
+
+	unflushed = 0;
+	for (;;) {
+		const auto interval = std::chrono::milliseconds(m_flushInterval.load());
+		const size_t flushSize = m_flushSize.load();
+
+		{
+			std::unique_lock<std::mutex> lck(m_wakeMtx);
+			m_wakeCV.wait_until(lck, lastFlush + interval, [&]{
+				return !m_running || m_syncRequested != m_syncDone || m_queue.size() >= flushSize;
+			});
+			running = m_running;
+			syncRequested = m_syncRequested;
+		}
+
+		/* Write out everything that is available, in batches */
+		do {
+			count = 0;
+			while (count < m_batchSize && m_queue.pop(m_batch[count])) count++;
+			if (!count) break;
+
+			start = nowNs();
+			m_write(m_batch, count, m_ctx);
+			m_writeNs.add(nowNs() - start);
+			m_batches.add(1);
+			m_written += count;
+			unflushed += count;
+		} while (count == m_batchSize);
+
+		const auto now = std::chrono::steady_clock::now();
+		if (unflushed >= (int)flushSize || now - lastFlush >= interval || !running || syncRequested != m_syncDone) {
+			if (unflushed) {
+				start = nowNs();
+				m_flush(m_ctx);
+				m_flushNs.add(nowNs() - start);
+				m_flushes.add(1);
+			}
+			unflushed = 0;
+			lastFlush = now;
+		}
+
+		if (syncRequested != m_syncDone) {
+			std::lock_guard<std::mutex> lck(m_wakeMtx);
+			m_syncDone = syncRequested;
+			m_syncCV.notify_all();
+		}
+
+		if (!running) break;
+	}
+}
+/* }}} */
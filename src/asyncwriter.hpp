@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "decode/common.hpp"
+#include "metrics.hpp"
+#include "queue.hpp"
+
+namespace radiosonde {
+	/**
+	 * Moves file output off the DSP threads. Decoded frames are pushed into a
+	 * bounded lock-free queue, and a dedicated thread hands them over to the
+	 * write callback in batches, calling the flush callback every flushInterval
+	 * milliseconds or every flushSize frames, whichever comes first.
+	 *
+	 * If the writer thread falls behind and the queue fills up, new frames are
+	 * dropped instead of stalling the caller.
+	 */
+	class AsyncWriter {
+	public:
+		AsyncWriter();
+		~AsyncWriter() { deinit(); };
+
+		/**
+		 * Start the writer thread.
+		 *
+		 * @param capacity maximum number of frames waiting to be written
+		 * @param flushInterval maximum time between flushes, in milliseconds
+		 * @param flushSize maximum number of frames between flushes
+		 * @param write function to call with every batch of frames
+		 * @param flush function to call to commit the written frames to disk
+		 * @param ctx opaque pointer passed to the callback functions
+		 */
+		void init(int capacity, int flushInterval, int flushSize,
+		          void (*write)(const SondeFullData *data, int count, void *ctx), void (*flush)(void *ctx), void *ctx);
+
+		/**
+		 * Write and flush any frames still in the queue, then stop the writer thread
+		 */
+		void deinit();
+
+		/**
+		 * Queue a frame to be written. Never blocks nor allocates.
+		 *
+		 * @param data frame to write
+		 * @return true on success, false if the frame was dropped
+		 */
+		bool push(const SondeFullData &data);
+
+		/**
+		 * Wait until all the frames queued so far have been written and flushed
+		 */
+		void sync();
+
+		/**
+		 * Change how often frames are flushed. Safe to call while running.
+		 *
+		 * @param flushInterval maximum time between flushes, in milliseconds
+		 * @param flushSize maximum number of frames between flushes
+		 */
+		void setFlushPolicy(int flushInterval, int flushSize);
+
+		size_t depth() const { return m_queue.size(); }
+		size_t maxDepth() const { return m_maxDepth; }
+		size_t capacity() const { return m_queue.capacity(); }
+		uint64_t written() const { return m_written; }
+		uint64_t dropped() const { return m_dropped; }
+		uint64_t batches() const { return m_batches.get(); }
+		uint64_t flushes() const { return m_flushes.get(); }
+		uint64_t writeTime() const { return m_writeNs.get(); }    /* Nanoseconds spent in the write callback */
+		uint64_t flushTime() const { return m_flushNs.get(); }    /* Nanoseconds spent in the flush callback */
+
+	private:
+		void workerLoop();
+
+		BoundedQueue<SondeFullData> m_queue;
+		SondeFullData *m_batch;
+		int m_batchSize;
+
+		void (*m_write)(const SondeFullData *data, int count, void *ctx);
+		void (*m_flush)(void *ctx);
+		void *m_ctx;
+
+		std::atomic<int> m_flushInterval, m_flushSize;
+		std::atomic<size_t> m_maxDepth;
+		std::atomic<uint64_t> m_written, m_dropped;
+		Counter m_batches, m_flushes, m_writeNs, m_flushNs;
+
+		std::thread m_thread;
+		std::mutex m_wakeMtx;
+		std::condition_variable m_wakeCV, m_syncCV;
+		bool m_running;
+		unsigned long m_syncRequested, m_syncDone;
+	};
+}
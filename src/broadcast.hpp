@@ -0,0 +1,191 @@
+#pragma once
+
+#include <dsp/block.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace radiosonde {
+	/**
+	 * Zero-copy fan-out block. Every buffer read from the input stream is
+	 * handed as-is to all the bound readers, which see the upstream readBuf
+	 * directly. The input is flushed only once every reader is done with it,
+	 * so the slowest reader sets the pace, same as dsp::routing::Splitter.
+	 */
+	template<class T>
+	class Broadcast : public dsp::block {
+		public:
+			/**
+			 * Read-only view onto the broadcast buffer. It can be used as the
+			 * input of any block expecting a dsp::stream<T>, but must never be
+			 * written to, nor have its readBuf modified.
+			 */
+			class Reader : public dsp::stream<T> {
+				friend class Broadcast;
+				public:
+					Reader() {
+						/* Never owns any samples: drop the buffers allocated by dsp::stream */
+						dsp::stream<T>::free();
+						m_parent = NULL;
+						m_ready = m_readerStop = false;
+						m_size = 0;
+					}
+					~Reader() { this->readBuf = NULL; }
+
+					int read() override {
+						std::unique_lock<std::mutex> lck(m_parent->m_mtx);
+						m_parent->m_dataCV.wait(lck, [this]{ return m_ready || m_readerStop; });
+						return m_readerStop ? -1 : m_size;
+					}
+
+					void flush() override {
+						std::lock_guard<std::mutex> lck(m_parent->m_mtx);
+						release();
+					}
+
+					void stopReader() override {
+						if (!m_parent) return;
+						std::lock_guard<std::mutex> lck(m_parent->m_mtx);
+						m_readerStop = true;
+						release();
+						m_parent->m_dataCV.notify_all();
+					}
+
+					void clearReadStop() override {
+						if (!m_parent) return;
+						std::lock_guard<std::mutex> lck(m_parent->m_mtx);
+						m_readerStop = false;
+					}
+
+					void stopWriter() override {
+						if (!m_parent) return;
+						std::lock_guard<std::mutex> lck(m_parent->m_mtx);
+						m_parent->m_writerStop = true;
+						m_parent->m_doneCV.notify_all();
+					}
+
+					void clearWriteStop() override {
+						if (!m_parent) return;
+						std::lock_guard<std::mutex> lck(m_parent->m_mtx);
+						m_parent->m_writerStop = false;
+					}
+
+				private:
+					/* Must be called with the parent mutex held */
+					void release() {
+						if (!m_ready) return;
+						m_ready = false;
+						if (--m_parent->m_pending == 0) m_parent->m_doneCV.notify_all();
+					}
+
+					Broadcast *m_parent;
+					bool m_ready, m_readerStop;
+					int m_size;
+			};
+
+			Broadcast() {}
+			~Broadcast() {
+				if (!dsp::block::_block_init) return;
+				dsp::block::stop();
+				dsp::block::unregisterInput(m_in);
+				dsp::block::_block_init = false;
+			}
+
+			void init(dsp::stream<T> *in) {
+				m_in = in;
+				m_pending = 0;
+				m_writerStop = false;
+
+				dsp::block::registerInput(m_in);
+				dsp::block::_block_init = true;
+			}
+
+			void setInput(dsp::stream<T> *in) {
+				assert(dsp::block::_block_init);
+				std::lock_guard<std::recursive_mutex> lck(dsp::block::ctrlMtx);
+				dsp::block::tempStop();
+				dsp::block::unregisterInput(m_in);
+				m_in = in;
+				dsp::block::registerInput(m_in);
+				dsp::block::tempStart();
+			}
+
+			/**
+			 * Start handing buffers to a reader. If the reader is already bound,
+			 * this method has no effect.
+			 *
+			 * @param reader reader to bind
+			 */
+			void bindReader(Reader *reader) {
+				assert(dsp::block::_block_init);
+				std::lock_guard<std::recursive_mutex> lck(dsp::block::ctrlMtx);
+				if (std::find(m_readers.begin(), m_readers.end(), reader) != m_readers.end()) return;
+
+				dsp::block::tempStop();
+				reader->m_parent = this;
+				m_readers.push_back(reader);
+				dsp::block::registerOutput(reader);
+				dsp::block::tempStart();
+			}
+
+			/**
+			 * Stop handing buffers to a reader. If the reader is not bound, this
+			 * method has no effect.
+			 *
+			 * @param reader reader to unbind
+			 */
+			void unbindReader(Reader *reader) {
+				assert(dsp::block::_block_init);
+				std::lock_guard<std::recursive_mutex> lck(dsp::block::ctrlMtx);
+				auto it = std::find(m_readers.begin(), m_readers.end(), reader);
+				if (it == m_readers.end()) return;
+
+				dsp::block::tempStop();
+				dsp::block::unregisterOutput(reader);
+				m_readers.erase(it);
+				dsp::block::tempStart();
+			}
+
+			int run() {
+				int count;
+
+				if ((count = m_in->read()) < 0) return -1;
+
+				{
+					std::unique_lock<std::mutex> lck(m_mtx);
+
+					/* Publish the input buffer to every active reader */
+					m_pending = 0;
+					for (Reader *reader : m_readers) {
+						if (reader->m_readerStop) continue;
+						reader->readBuf = m_in->readBuf;
+						reader->m_size = count;
+						reader->m_ready = true;
+						m_pending++;
+					}
+					m_dataCV.notify_all();
+
+					/* Wait for all of them to be done with it */
+					m_doneCV.wait(lck, [this]{ return m_pending == 0 || m_writerStop; });
+					if (m_writerStop) {
+						for (Reader *reader : m_readers) reader->m_ready = false;
+						m_pending = 0;
+						return -1;
+					}
+				}
+
+				m_in->flush();
+				return 0;
+			}
+
+		private:
+			dsp::stream<T> *m_in;
+			std::vector<Reader*> m_readers;
+
+			std::mutex m_mtx;
+			std::condition_variable m_dataCV, m_doneCV;
+			int m_pending;
+			bool m_writerStop;
+	};
+}
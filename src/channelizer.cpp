@@ -0,0 +1,159 @@
+#include <math.h>
+#include <string.h>
+#include "channelizer.hpp"
+
+using namespace radiosonde;
+
+Channelizer::Channelizer()
+{
+	m_channels = m_length = 0;
+	m_taps = NULL;
+	m_history = NULL;
+	m_rotation[0] = m_rotation[1] = NULL;
+	m_fftIn = m_fftOut = NULL;
+	m_plan = NULL;
+}
+
+bool
+Channelizer::init(int channels, int tapsPerBranch)
+{
+	double sum, x, w;
+
+	if (m_taps) deinit();
+	if (channels < 2 || channels % 2 || tapsPerBranch < 1) return false;
+
+	m_channels = channels;
+	m_length = channels * tapsPerBranch;
+
+	/* Prototype filter: Blackman-windowed sinc, cut off at the channel spacing,
+	 * which is the output Nyquist frequency, unity gain at DC. With the
+	 * channels oversampled by 2, what aliases back from above it lands outside
+	 * the passband (channel spacing / 2). Symmetric, so it does not need to be
+	 * time-reversed to be used as a dot product against the history */
+	m_taps = new float[m_length];
+	sum = 0;
+	for (int i=0; i<m_length; i++) {
+		x = i - (m_length - 1) / 2.0;
+		w = 0.42 - 0.5 * cos(2 * M_PI * i / (m_length - 1)) + 0.08 * cos(4 * M_PI * i / (m_length - 1));
+		m_taps[i] = w * (x == 0 ? 1.0 : sin(2 * M_PI * x / channels) / (2 * M_PI * x / channels));
+		sum += m_taps[i];
+	}
+	for (int i=0; i<m_length; i++) m_taps[i] /= sum;
+
+	/* Phase correction for each channel, accounting for the hop size being half
+	 * the FFT size: the newest sample index alternates between D-1 and 2D-1
+	 * modulo the number of channels */
+	for (int i=0; i<2; i++) {
+		const int n = (i + 1) * (channels / 2) - 1;
+		m_rotation[i] = new dsp::complex_t[channels];
+		for (int k=0; k<channels; k++) {
+			const double phase = -2 * M_PI * ((long)k * n % channels) / channels;
+			m_rotation[i][k] = dsp::complex_t{(float)cos(phase), (float)sin(phase)};
+		}
+	}
+
+	m_history = new dsp::complex_t[m_length];
+	m_fftIn = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * channels);
+	m_fftOut = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * channels);
+	m_plan = fftwf_plan_dft_1d(channels, m_fftIn, m_fftOut, FFTW_BACKWARD, FFTW_ESTIMATE);
+
+	reset();
+	return true;
+}
+
+void
+Channelizer::deinit()
+{
+	if (!m_taps) return;
+
+	fftwf_destroy_plan(m_plan);
+	fftwf_free(m_fftIn);
+	fftwf_free(m_fftOut);
+	delete[] m_taps;
+	delete[] m_history;
+	delete[] m_rotation[0];
+	delete[] m_rotation[1];
+
+	m_taps = NULL;
+	m_history = NULL;
+	m_rotation[0] = m_rotation[1] = NULL;
+	m_fftIn = m_fftOut = NULL;
+	m_plan = NULL;
+	m_channels = m_length = 0;
+}
+
+void
+Channelizer::reset()
+{
+	if (!m_taps) return;
+	memset(m_history, 0, sizeof(*m_history) * m_length);
+	m_fill = 0;
+	m_parity = 0;
+}
+
+int
+Channelizer::channelForOffset(double offset, double samplerate) const
+{
+	const long channel = lround(offset * m_channels / samplerate);
+	return ((channel % m_channels) + m_channels) % m_channels;
+}
+
+double
+Channelizer::channelOffset(int channel, double samplerate) const
+{
+	if (channel >= m_channels / 2) channel -= m_channels;
+	return channel * samplerate / m_channels;
+}
+
+int
+Channelizer::process(const dsp::complex_t *in, int count, const int *channels, int nchannels, dsp::complex_t **out)
+{
+	const int hopSize = decimation();
+	int outCount = 0;
+	int i, n;
+
+	for (i=0; i<count; i += n) {
+		/* Append new samples to the end of the history */
+		n = hopSize - m_fill;
+		if (n > count - i) n = count - i;
+		memcpy(&m_history[m_length - hopSize + m_fill], &in[i], sizeof(*in) * n);
+		m_fill += n;
+		if (m_fill < hopSize) break;
+
+		hop(channels, nchannels, out, outCount++);
+
+		memmove(m_history, &m_history[hopSize], sizeof(*m_history) * (m_length - hopSize));
+		m_fill = 0;
+	}
+
+	return outCount;
+}
+
+/* Private methods {{{ */
+void
+Channelizer::hop(const int *channels, int nchannels, dsp::complex_t **out, int offset)
+{
+	/* Polyphase partial sums, in reverse order within the FFT frame */
+	for (int j=0; j<m_channels; j++) {
+		m_fftIn[m_channels - 1 - j][0] = 0;
+		m_fftIn[m_channels - 1 - j][1] = 0;
+	}
+	for (int base=0; base<m_length; base += m_channels) {
+		const float *taps = &m_taps[base];
+		const dsp::complex_t *hist = &m_history[base];
+		for (int j=0; j<m_channels; j++) {
+			m_fftIn[m_channels - 1 - j][0] += taps[j] * hist[j].re;
+			m_fftIn[m_channels - 1 - j][1] += taps[j] * hist[j].im;
+		}
+	}
+
+	fftwf_execute(m_plan);
+
+	for (int i=0; i<nchannels; i++) {
+		const int k = channels[i];
+		const dsp::complex_t bin = {m_fftOut[k][0], m_fftOut[k][1]};
+		out[i][offset] = bin * m_rotation[m_parity][k];
+	}
+	m_parity ^= 1;
+}
+/* }}} */
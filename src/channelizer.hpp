@@ -0,0 +1,86 @@
+#pragma once
+
+#include <dsp/types.h>
+#include <fftw3.h>
+
+namespace radiosonde {
+	/**
+	 * 2x oversampled polyphase filter bank channelizer. Splits a wideband IQ
+	 * stream into evenly spaced channels (spacing = samplerate / channels), each
+	 * one translated to baseband and output at twice the channel spacing.
+	 *
+	 * All channels cost a single FFT per output sample, regardless of how many of
+	 * them are actually being used.
+	 */
+	class Channelizer {
+	public:
+		Channelizer();
+		~Channelizer() { deinit(); };
+
+		/**
+		 * Set up the filter bank.
+		 *
+		 * @param channels number of channels, must be even
+		 * @param tapsPerBranch length of the prototype filter, in multiples of the
+		 *        number of channels
+		 * @return true on success, false otherwise
+		 */
+		bool init(int channels, int tapsPerBranch = 12);
+		void deinit();
+
+		/**
+		 * Reset the internal history, as if the channelizer was just initialized
+		 */
+		void reset();
+
+		int channels() const { return m_channels; }
+
+		/**
+		 * Number of input samples per output sample (on each channel)
+		 */
+		int decimation() const { return m_channels / 2; }
+
+		/**
+		 * Get the channel whose center is closest to a given frequency offset.
+		 *
+		 * @param offset offset from the center of the input, in Hz
+		 * @param samplerate input samplerate, in Hz
+		 * @return channel index
+		 */
+		int channelForOffset(double offset, double samplerate) const;
+
+		/**
+		 * Get the center of a channel, relative to the center of the input.
+		 *
+		 * @param channel channel index
+		 * @param samplerate input samplerate, in Hz
+		 * @return center frequency offset, in Hz
+		 */
+		double channelOffset(int channel, double samplerate) const;
+
+		/**
+		 * Channelize a block of samples.
+		 *
+		 * @param in input samples
+		 * @param count number of input samples
+		 * @param channels indices of the channels to output
+		 * @param nchannels number of channels to output
+		 * @param out one buffer per requested channel, each one with space for
+		 *        at least count / decimation() + 1 samples
+		 * @return number of samples written to each of the output buffers
+		 */
+		int process(const dsp::complex_t *in, int count, const int *channels, int nchannels, dsp::complex_t **out);
+
+	private:
+		void hop(const int *channels, int nchannels, dsp::complex_t **out, int offset);
+
+		int m_channels, m_length;
+		float *m_taps;
+		dsp::complex_t *m_history;
+		dsp::complex_t *m_rotation[2];
+		int m_fill, m_parity;
+
+		fftwf_complex *m_fftIn, *m_fftOut;
+		fftwf_plan m_plan;
+	};
+}
@@ -0,0 +1,136 @@
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "atmo.hpp"
+
+#define ISA_TABLE_STEP 50.0f    /* Meters between table entries */
+#define ISA_TABLE_MAX 86000.0f  /* Top of the ISA layers */
+#define ISA_TABLE_SIZE ((int)(ISA_TABLE_MAX / ISA_TABLE_STEP) + 2)
+
+static struct IsaTable {
+	IsaTable() {
+		for (int i=0; i<ISA_TABLE_SIZE; i++) pressure[i] = altitude_to_pressure_exact(i * ISA_TABLE_STEP);
+	}
+	float pressure[ISA_TABLE_SIZE];
+} isa_table;
+
+static inline float
+magnus(float temp, float logrh)
+{
+	const float tmp = (logrh + (17.27f * temp / (237.3f + temp))) / 17.27f;
+	return 237.3f * tmp  / (1 - tmp);
+}
+
+/* fast_logf() only handles positive, finite, normal inputs: anything else
+ * gives NAN, as logf() used to through magnus() */
+static inline bool
+log_valid(float x)
+{
+	return x >= FLT_MIN && x <= FLT_MAX;
+}
+
+static inline float
+isa_interp(float alt)
+{
+	const float pos = alt / ISA_TABLE_STEP;
+	const int idx = (int)pos;
+	const float frac = pos - idx;
+	return isa_table.pressure[idx] + frac * (isa_table.pressure[idx+1] - isa_table.pressure[idx]);
+}
+
+float
+fast_logf(float x)
+{
+	const float ln2 = 0.69314718f;
+	uint32_t bits;
+	float m, s, s2;
+	int e;
+
+	/* x = m * 2^e, with m in [sqrt(2)/2, sqrt(2)) */
+	memcpy(&bits, &x, sizeof(bits));
+	e = (int)((bits >> 23) & 0xFF) - 127;
+	bits = (bits & 0x007FFFFF) | 0x3F800000;
+	memcpy(&m, &bits, sizeof(m));
+	if (m > 1.41421356f) {
+		m *= 0.5f;
+		e++;
+	}
+
+	/* ln(m) = 2 atanh(s), with |s| < 0.172: three terms of the series are
+	 * enough to get within 2e-6 */
+	s = (m - 1) / (m + 1);
+	s2 = s * s;
+	return e * ln2 + 2 * s * (1 + s2 * (1.0f/3 + s2 * (1.0f/5 + s2 * (1.0f/7))));
+}
+
+float
+dewpt(float temp, float rh)
+{
+	const float x = rh / 100.0f;
+
+	if (!log_valid(x)) return NAN;
+	return magnus(temp, fast_logf(x));
+}
+
+float
+altitude_to_pressure(float alt)
+{
+	if (!(alt >= 0 && alt < ISA_TABLE_MAX)) return altitude_to_pressure_exact(alt);
+	return isa_interp(alt);
+}
+
+float
+altitude_to_pressure_exact(float alt)
+{
+	const float g0 = 9.80665;
+	const float M = 0.0289644;
+	const float R_star = 8.3144598;
+
+	const float hbs[] = {0.0,      11000.0, 20000.0, 32000.0, 47000.0, 51000.0, 71000.0};
+	const float Lbs[] = {-0.0065,  0.0,     0.001,   0.0028,  0.0,     -0.0028, -0.002};
+	const float Pbs[] = {101325.0, 22632.1, 5474.89, 868.019, 110.906, 66.9389, 3.95642};
+	const float Tbs[] = {288.15,   216.65,  216.65,  228.65,  270.65,  270.65,  214.65};
+	const int layers = sizeof(Lbs)/sizeof(*Lbs);
+
+	float Lb, Pb, Tb, hb;
+	int b;
+
+	for (b=0; b<layers-1; b++) {
+		if (alt < hbs[b+1]) break;
+	}
+	Lb = Lbs[b];
+	Pb = Pbs[b];
+	Tb = Tbs[b];
+	hb = hbs[b];
+
+	if (Lb != 0) {
+		return 1e-2 * Pb * powf((Tb + Lb * (alt - hb)) / Tb, - (g0 * M) / (R_star * Lb));
+	}
+	return 1e-2 * Pb * expf(-g0 * M * (alt - hb) / (R_star * Tb));
+}
+
+void
+dewpt_batch(const float *temp, const float *rh, float *out, size_t count)
+{
+	for (size_t i=0; i<count; i++) {
+		const float x = rh[i] / 100.0f;
+		const float dewpt = magnus(temp[i], fast_logf(x));
+		out[i] = log_valid(x) ? dewpt : NAN;
+	}
+}
+
+void
+altitude_to_pressure_batch(const float *alt, float *out, size_t count)
+{
+	for (size_t i=0; i<count; i++) {
+		/* Clamp instead of branching, then fix up the few out-of-range points.
+		 * The table has a spare entry past ISA_TABLE_MAX, so that the same
+		 * range as altitude_to_pressure() can be interpolated */
+		const float clamped = fminf(fmaxf(alt[i], 0.0f), ISA_TABLE_MAX);
+		out[i] = isa_interp(clamped);
+	}
+	for (size_t i=0; i<count; i++) {
+		if (!(alt[i] >= 0 && alt[i] < ISA_TABLE_MAX)) out[i] = altitude_to_pressure_exact(alt[i]);
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * Compute the dew point from temperature and relative humidity (Magnus
+ * formula), using fast_logf()
+ *
+ * @param temp temperature, in degrees Celsius
+ * @param rh relative humidity, in percent. Must be positive and finite
+ * @return dew point, in degrees Celsius, NAN if the humidity is zero,
+ *         negative, infinite or NAN
+ */
+float dewpt(float temp, float rh);
+
+/**
+ * Estimate the pressure at a given altitude according to the International
+ * Standard Atmosphere. Interpolates a precomputed table, with a relative error
+ * below 1e-4 compared to altitude_to_pressure_exact()
+ *
+ * @param alt altitude, in meters
+ * @return pressure, in hPa
+ */
+float altitude_to_pressure(float alt);
+
+/**
+ * Same as altitude_to_pressure(), evaluating the ISA model directly
+ */
+float altitude_to_pressure_exact(float alt);
+
+/**
+ * Natural logarithm approximation for positive, finite, normal inputs. The
+ * absolute error is below 2e-6 over that range. The sign bit is ignored, and
+ * zero, denormals, infinities and NAN give meaningless finite results, so
+ * callers have to check the input
+ */
+float fast_logf(float x);
+
+/**
+ * Batch versions of the above, for reprocessing whole logs at once, with the
+ * same domain and results. The loops are branch-free, so that the compiler
+ * can vectorize them
+ *
+ * @param temp/rh/alt input arrays
+ * @param out output array
+ * @param count number of elements in each array
+ */
+void dewpt_batch(const float *temp, const float *rh, float *out, size_t count);
+void altitude_to_pressure_batch(const float *alt, float *out, size_t count);
@@ -1,20 +1,74 @@
 #pragma once
-#include <string>
+#include <stdio.h>
+#include <time.h>
+
+#define SERIAL_MAXLEN 32
+
+/* Type of the auxiliary payload attached to a frame */
+enum SondeAuxType {
+	AUX_NONE = 0,
+	AUX_OZONE = 1,              /* Ozone sensor (e.g. ECC ozonesonde via RS41 XDATA) */
+};
+
+/* Groups of fields received as part of the current frame, see SondeFullData::fields */
+enum SondeFieldMask {
+	HAS_SEQ = 1 << 0,
+	HAS_POS = 1 << 1,           /* lat, lon, alt */
+	HAS_SPEED = 1 << 2,         /* spd, hdg, climb */
+	HAS_TIME = 1 << 3,
+	HAS_PTU = 1 << 4,           /* temp, rh, dewpt, pressure, calibration status */
+	HAS_SERIAL = 1 << 5,
+	HAS_SHUTDOWN = 1 << 6,      /* burstkill */
+	HAS_AUX = 1 << 7,
+	HAS_ALL = (1 << 8) - 1,
+};
+
+/**
+ * Auxiliary instrument data, tagged by type. Kept in binary form so that the
+ * decoder does not need to format anything, see formatAuxData() for a text
+ * representation.
+ */
+struct SondeAuxData {
+	int type;                   /* One of SondeAuxType */
+	union {
+		struct {
+			float o3_mpa;       /* Ozone partial pressure (mPa) */
+		} ozone;
+	};
+};
+
+/**
+ * Quality of the signal a frame was decoded from, measured on the FM
+ * discriminator output fed to the decoder (see radiosonde::FMDiscriminator:
+ * 1 is a frequency offset of half the discriminator bandwidth)
+ */
+struct SondeSignalQuality {
+	float offset;               /* Mean of the discriminator output: carrier offset from the center of the channel */
+	float deviation;            /* Standard deviation of the discriminator output: FSK deviation, plus noise */
+	int badFragments;           /* Fragments that were parsed but held no valid data (e.g. CRC errors) during the frame */
+};
+
+/* Trivially copyable, so that it can be handed over between threads without allocating */
 
 class SondeFullData {
 public:
 	SondeFullData() { init(); }
 	void init() {
-		serial = "";
+		serial[0] = 0;
 		seq = time = burstkill = 0;
 		lat = lon = alt = 0;
 		spd = hdg = climb = 0;
 		temp = rh = dewpt = pressure = 0;
 		calibrated = false;
-		auxData = "";
+		calib_percent = 0;
+		aux.type = AUX_NONE;
+		quality.offset = quality.deviation = 0;
+		quality.badFragments = 0;
+		fields = 0;
+		changed = HAS_ALL;
 	};
 
-	std::string serial;         /* Serial number */
+	char serial[SERIAL_MAXLEN]; /* Serial number */
 	int seq;                    /* Frame sequence number */
 	time_t time;                /* Onboard time */
 	int burstkill;              /* Time to shutdown, -1 if inactive */
@@ -24,5 +78,28 @@ public:
 	float dewpt, pressure;      /* Dew point (degrees C), pressure (hPa) */
 	bool calibrated;            /* Whether all the calibration data has been received */
 	float calib_percent;        /* Calibration status (0-100) */
-	std::string auxData;        /* Auxiliary freeform data */
+	SondeAuxData aux;           /* Auxiliary instrument data */
+	SondeSignalQuality quality; /* Signal the frame was received from */
+	int fields;                 /* Fields updated since the frame started (SondeFieldMask). The others hold previous values */
+	int changed;                /* Fields that differ from the previous frame of the same decoder (SondeFieldMask) */
 };
+
+/**
+ * Format auxiliary data as human-readable text.
+ *
+ * @param aux data to format
+ * @param buf output buffer
+ * @param len size of the output buffer
+ * @return number of characters written, as snprintf()
+ */
+static inline int
+formatAuxData(const SondeAuxData *aux, char *buf, size_t len)
+{
+	switch (aux->type) {
+		case AUX_OZONE:
+			return snprintf(buf, len, "O3=%.2fmPa", aux->ozone.o3_mpa);
+		default:
+			if (len) buf[0] = '\0';
+			return 0;
+	}
+}
@@ -1,8 +1,16 @@
 #pragma once
 
+#include <algorithm>
 #include <dsp/block.h>
+#include <math.h>
 #include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "atmo.hpp"
 #include "common.hpp"
+#include "../metrics.hpp"
+#include "../sched.hpp"
 extern "C" {
 #include "sondedump/include/c50.h"
 #include "sondedump/include/dfm09.h"
@@ -14,108 +22,341 @@ extern "C" {
 }
 
 #define LEN(x) (sizeof(x)/sizeof(*x))
-
-static float dewpt(float temp, float rh);
-static float altitude_to_pressure(float alt);
+#define MIN_NATIVE_SAMPLERATE 20000     /* About two samples per symbol at the fastest baudrate (M10, 9600bd) */
+#define FRAME_TIMEOUT 1500              /* Emit an incomplete frame after this long without new data (ms) */
 
 namespace radiosonde {
+	/**
+	 * Protocol-agnostic interface to a decoder block, so that decoders can be
+	 * rewired and started/stopped without knowing the underlying sonde type
+	 */
+	class DecoderBase : public ScheduledBlock<dsp::block> {
+		public:
+			virtual ~DecoderBase() {}
+
+			virtual void init(dsp::stream<float> *in, int samplerate, void (*callback)(SondeFullData *data, void *ctx), void *ctx) = 0;
+			virtual void deinit(void) = 0;
+
+			/**
+			 * Change the stream the decoder reads from. Safe to call while the
+			 * decoder is running.
+			 *
+			 * @param in new input stream
+			 */
+			virtual void setInput(dsp::stream<float> *in) = 0;
+
+			/**
+			 * Change the samplerate the decoder expects its input at. Safe to
+			 * call while the decoder is running, but any partially received
+			 * frame is lost.
+			 *
+			 * @param samplerate new samplerate, in Hz
+			 */
+			virtual void setSamplerate(int samplerate) = 0;
+
+			/**
+			 * Accumulate the input of the block thread before decoding it, so
+			 * that the decoder is called on a few large buffers instead of
+			 * many small ones, at the cost of some latency. A batch is decoded
+			 * as soon as either limit is reached. Has no effect on process().
+			 *
+			 * @param minSamples samples to accumulate, 0 for no minimum
+			 * @param latencyMs longest time a sample can wait for its batch to
+			 *        fill, in milliseconds, 0 for no limit. With both set to 0,
+			 *        every input buffer is decoded as soon as it is read
+			 */
+			virtual void setBatching(int minSamples, int latencyMs) = 0;
+
+			/**
+			 * Decode a block of samples, invoking the callback once per frame,
+			 * as soon as all the fields the previous frame carried have been
+			 * received (or when the next frame starts, whichever comes first).
+			 * This is what the block thread runs on every input buffer, exposed
+			 * so that decoders initialized without an input stream can be
+			 * driven manually.
+			 *
+			 * @param in FM-demodulated samples
+			 * @param count number of samples in the buffer
+			 */
+			virtual void process(const float *in, int count) = 0;
+
+			/**
+			 * Counters updated by the thread running the decoder, safe to read
+			 * from any other thread
+			 */
+			const BlockMetrics &metrics() const { return m_metrics; }
+
+		protected:
+			BlockMetrics m_metrics;
+	};
+
+	/**
+	 * Instantiate a decoder of the given type, for use in factory tables
+	 */
+	template<class D>
+	DecoderBase *createDecoder() { return new D(); }
+
+	/**
+	 * Get the decimation to apply to a demodulated signal before feeding it to
+	 * a decoder at its native samplerate: the largest power of two that keeps
+	 * the samplerate above MIN_NATIVE_SAMPLERATE.
+	 *
+	 * @param samplerate samplerate of the demodulated signal, in Hz
+	 * @return decimation factor, 1 if the signal should be used as-is
+	 */
+	static inline int nativeDecimation(float samplerate) {
+		int decimation = 1;
+		while (samplerate / (2 * decimation) >= MIN_NATIVE_SAMPLERATE) decimation *= 2;
+		return decimation;
+	}
+
 	template<typename T, T* (*decoder_init)(int), void (*decoder_deinit)(T*), ParserStatus (*decoder_get)(T*, SondeData*, const float*, size_t)>
-	class Decoder : public dsp::block {
+	class Decoder : public DecoderBase {
 		public:
-			Decoder() {}
+			Decoder() {
+				m_decoder = NULL;
+				m_samplerate = 0;
+				m_batchSize = m_batchLatency = 0;
+				m_batchCapacity = 0;
+				m_batchStart = 0;
+				resetFrame();
+			}
 			~Decoder() {
 				if (!dsp::block::_block_init) return;
 				dsp::block::stop();
-				dsp::block::unregisterInput(m_in);
+				if (m_in) dsp::block::unregisterInput(m_in);
 				dsp::block::_block_init = false;
 
-				decoder_deinit(m_decoder);
+				if (m_decoder) decoder_deinit(m_decoder);
 			}
 
-			void init(dsp::stream<float> *in, int samplerate, void (*callback)(SondeFullData *data, void *ctx), void *ctx) {
+			/* Initializing a decoder again at the same samplerate keeps its
+			 * state, e.g. the calibration data received so far (see DecoderPool) */
+			void init(dsp::stream<float> *in, int samplerate, void (*callback)(SondeFullData *data, void *ctx), void *ctx) override {
 				m_in = in;
 				m_ctx = ctx;
 				m_callback = callback;
-				m_decoder = decoder_init(samplerate);
-				m_count = m_offset = 0;
+				if (!m_decoder || samplerate != m_samplerate) {
+					if (m_decoder) decoder_deinit(m_decoder);
+					m_decoder = decoder_init(samplerate);
+					m_samplerate = samplerate;
+					m_count = m_offset = 0;
+					m_sensorPressure = 0;
+					m_pressureAlt = NAN;
+					resetFrame();
+				}
+				reserveBatch();
 
-				dsp::block::registerInput(m_in);
+				if (m_in) dsp::block::registerInput(m_in);
 				dsp::block::_block_init = true;
 			}
 
-			void deinit(void) {
+			void deinit(void) override {
 				dsp::block::stop();
-				dsp::block::unregisterInput(m_in);
+				if (m_in) dsp::block::unregisterInput(m_in);
 
+				if (m_decoder) decoder_deinit(m_decoder);
+				m_decoder = NULL;
+			}
+
+			void setInput(dsp::stream<float> *in) override {
+				assert(dsp::block::_block_init);
+				std::lock_guard<std::recursive_mutex> lck(dsp::block::ctrlMtx);
+				if (in == m_in) return;
+				dsp::block::tempStop();
+				if (m_in) dsp::block::unregisterInput(m_in);
+				m_in = in;
+				if (m_in) dsp::block::registerInput(m_in);
+				dsp::block::tempStart();
+			}
+
+			void setSamplerate(int samplerate) override {
+				assert(dsp::block::_block_init);
+				std::lock_guard<std::recursive_mutex> lck(dsp::block::ctrlMtx);
+				if (samplerate == m_samplerate) return;
+				dsp::block::tempStop();
 				decoder_deinit(m_decoder);
+				m_decoder = decoder_init(samplerate);
+				m_samplerate = samplerate;
+				m_idle = 0;
+				m_batch.clear();
+				reserveBatch();
+				dsp::block::tempStart();
+			}
+
+			void setBatching(int minSamples, int latencyMs) override {
+				std::lock_guard<std::recursive_mutex> lck(dsp::block::ctrlMtx);
+				if (minSamples == m_batchSize && latencyMs == m_batchLatency) return;
+				dsp::block::tempStop();
+				m_batchSize = minSamples > 0 ? minSamples : 0;
+				m_batchLatency = latencyMs > 0 ? latencyMs : 0;
+				reserveBatch();
+				dsp::block::tempStart();
 			}
 
 			int run() {
-				SondeData fragment;
+				uint64_t start, now;
 				int count;
+				bool ready;
 
 				assert(dsp::block::_block_init);
 
+				start = nowNs();
 				if ((count = m_in->read()) < 0) return -1;
+				now = nowNs();
+				m_metrics.waitNs.add(now - start);
+				m_metrics.reads.add(1);
+
+				/* The batch never grows past what reserveBatch() allocated: if
+				 * the new input does not fit, decode what is there first */
+				if (!m_batch.empty() && m_batch.size() + count > m_batchCapacity) decodeBatch(now);
+
+				/* Unbatched: decode straight out of the stream buffer */
+				if (!m_batchSize && !m_batchLatency) {
+					process(m_in->readBuf, count);
+					m_in->flush();
+					return 0;
+				}
 
-				while (decoder_get(m_decoder, &fragment, m_in->readBuf, count) != PROCEED) {
-					std::ostringstream auxStream;
+				/* Release the writer before decoding anything, it does not have to
+				 * wait for the batch to fill */
+				if (m_batch.empty()) m_batchStart = start;
+				m_batch.insert(m_batch.end(), m_in->readBuf, m_in->readBuf + count);
+				m_in->flush();
+
+				ready = false;
+				if (m_batchSize && (int)m_batch.size() >= m_batchSize) ready = true;
+				if (m_batchLatency && now - m_batchStart >= (uint64_t)m_batchLatency * 1000000ULL) ready = true;
+				if (ready) decodeBatch(now);
+				return 0;
+			}
+
+			void process(const float *in, int count) override {
+				SondeData fragment;
+				uint64_t start, busy;
+				float sum, sumSq;
+
+				/* Only time the decoder itself, not the callback */
+				busy = 0;
+				start = nowNs();
+
+				/* Signal quality, over all the samples since the last frame */
+				sum = sumSq = 0;
+				for (int i=0; i<count; i++) {
+					sum += in[i];
+					sumSq += in[i] * in[i];
+				}
+				m_qualitySum += sum;
+				m_qualitySumSq += sumSq;
+				m_qualityCount += count;
+
+				while (decoder_get(m_decoder, &fragment, in, count) != PROCEED) {
+					busy += nowNs() - start;
+
+					if (!fragment.fields) {
+						m_metrics.badFrames.add(1);
+						m_badFragments++;
+						start = nowNs();
+						continue;
+					}
+					m_metrics.frames.add(1);
+					m_idle = 0;
+
+					/* A new frame starts: the previous one is complete, and none
+					 * of the fields are current yet. Decoders that do not report
+					 * a sequence number are split on the onboard time instead */
+					if (fragment.fields & DATA_SEQ) m_hasSeq = true;
+					if (m_hasSeq ? (fragment.fields & DATA_SEQ) && fragment.seq != m_data.seq
+					             : (fragment.fields & DATA_TIME) && fragment.time != m_data.time) {
+						if (m_data.fields && !m_frameDone) emit();
+						m_frameMask = m_data.fields;
+						m_data.fields = 0;
+						m_frameDone = false;
+					}
 
 					if (fragment.fields & DATA_SEQ) {
 						m_data.seq = fragment.seq;
+						m_data.fields |= HAS_SEQ;
 					}
 
 					if (fragment.fields & DATA_POS) {
+						m_data.fields |= HAS_POS;
 						m_data.lat = fragment.lat;
 						m_data.lon = fragment.lon;
 						m_data.alt = fragment.alt;
 					}
 
 					if (fragment.fields & DATA_SPEED) {
+						m_data.fields |= HAS_SPEED;
 						m_data.spd = fragment.speed;
 						m_data.hdg = fragment.heading;
 						m_data.climb = fragment.climb;
 					}
 
 					if (fragment.fields & DATA_TIME) {
+						m_data.fields |= HAS_TIME;
 						m_data.time = fragment.time;
 					}
 
 					if (fragment.fields & DATA_PTU) {
+						m_data.fields |= HAS_PTU;
 						m_data.calib_percent = fragment.calib_percent;
 						m_data.calibrated = m_data.calib_percent >= 100.0f;
-						m_data.temp = fragment.temp;
-						m_data.rh = fragment.rh;
-						m_data.pressure = fragment.pressure;
-						m_data.dewpt = dewpt(m_data.temp, m_data.rh);
+						m_sensorPressure = fragment.pressure;
+
+						/* PTU is only updated once per frame, but re-sent along with
+						 * every other fragment */
+						if (fragment.temp != m_data.temp || fragment.rh != m_data.rh) {
+							m_data.temp = fragment.temp;
+							m_data.rh = fragment.rh;
+							m_data.dewpt = dewpt(m_data.temp, m_data.rh);
+						}
 					}
 
+					/* Almost always the same as the last one */
 					if (fragment.fields & DATA_SERIAL) {
-						m_data.serial = fragment.serial;
+						m_data.fields |= HAS_SERIAL;
+						if (strncmp(m_data.serial, fragment.serial, sizeof(m_data.serial)-1)) {
+							snprintf(m_data.serial, sizeof(m_data.serial), "%s", fragment.serial);
+						}
 					}
 
 					if (fragment.fields & DATA_SHUTDOWN) {
+						m_data.fields |= HAS_SHUTDOWN;
 						m_data.burstkill = fragment.shutdown;
 					}
 
 					/* Auxiliary data */
 					if (fragment.fields & DATA_OZONE) {
-						auxStream.precision(2);
-						auxStream << "O3=" << std::fixed << fragment.o3_mpa << "mPa";
-						m_data.auxData = auxStream.str();
+						m_data.fields |= HAS_AUX;
+						m_data.aux.type = AUX_OZONE;
+						m_data.aux.ozone.o3_mpa = fragment.o3_mpa;
 					}
 
-					if (m_data.pressure <= 0) {
+					/* Fall back to the standard atmosphere if there is no pressure sensor */
+					if (m_sensorPressure > 0) {
+						m_data.pressure = m_sensorPressure;
+					} else if (m_data.alt != m_pressureAlt) {
 						m_data.pressure = altitude_to_pressure(m_data.alt);
+						m_pressureAlt = m_data.alt;
 					}
 
-					if (fragment.fields) {
-						m_callback(&m_data, m_ctx);
-					}
+					/* Everything the previous frame carried is here, no need to
+					 * wait for the next one. Later fragments of this frame only
+					 * update the data for the next one */
+					if (!m_frameDone && m_frameMask && (m_data.fields & m_frameMask) == m_frameMask) emit();
+
+					start = nowNs();
 				}
+				busy += nowNs() - start;
 
-				m_in->flush();
-				return 0;
+				/* The signal was lost mid-frame, output what was received */
+				m_idle += count;
+				if (m_data.fields && !m_frameDone && m_idle > (int64_t)m_samplerate * FRAME_TIMEOUT / 1000) emit();
+
+				m_metrics.samples.add(count);
+				m_metrics.blocks.add(1);
+				m_metrics.busyNs.add(busy);
 			}
 
 		private:
@@ -123,52 +364,85 @@ namespace radiosonde {
 			void (*m_callback)(SondeFullData *data, void *ctx);
 			void *m_ctx;
 			T *m_decoder;
+			int m_samplerate;
 			int m_count, m_offset;
-			SondeFullData m_data;
+			SondeFullData m_data, m_last;
+			float m_sensorPressure, m_pressureAlt;
+			int m_frameMask;            /* Fields received in the previous frame */
+			bool m_frameDone;           /* Whether the current frame has been emitted */
+			bool m_hasSeq;              /* Whether the decoder reports sequence numbers */
+			bool m_hasLast;             /* Whether m_last holds a frame */
+			int64_t m_idle;             /* Samples since the last fragment */
+			std::vector<float> m_batch; /* Input read by run() but not decoded yet */
+			int m_batchSize, m_batchLatency;
+			size_t m_batchCapacity;     /* Samples reserved in m_batch, 0 when not batching */
+			uint64_t m_batchStart;      /* When the oldest sample in m_batch was waited for */
+			double m_qualitySum, m_qualitySumSq;    /* Input statistics since the last frame */
+			int64_t m_qualityCount;
+			int m_badFragments;
+
+			void resetFrame() {
+				m_data.fields = 0;
+				m_hasLast = false;
+				m_frameMask = 0;
+				m_frameDone = false;
+				m_hasSeq = false;
+				m_idle = 0;
+				m_qualitySum = m_qualitySumSq = 0;
+				m_qualityCount = 0;
+				m_badFragments = 0;
+			}
 
-	};
-}
+			/* Allocate the batch up front, so that run() never has to: room for
+			 * a full batch, or for the samples received within the latency
+			 * budget, plus one more read */
+			void reserveBatch() {
+				m_batchCapacity = 0;
+				if (!m_batchSize && !m_batchLatency) return;
 
-static float
-dewpt(float temp, float rh)
-{
-	const float tmp = (logf(rh / 100.0f) + (17.27f * temp / (237.3f + temp))) / 17.27f;
-	return 237.3f * tmp  / (1 - tmp);
-}
-static float
-altitude_to_pressure(float alt)
-{
-	const float g0 = 9.80665;
-	const float M = 0.0289644;
-	const float R_star = 8.3144598;
-
-	const float hbs[] = {0.0,      11000.0, 20000.0, 32000.0, 47000.0, 51000.0, 77000.0};
-	const float Lbs[] = {-0.0065,  0.0,     0.001,   0.0028,  0.0,     -0.0028, -0.002};
-	const float Pbs[] = {101325.0, 22632.1, 5474.89, 868.02,  110.91,  66.94,   3.96};
-	const float Tbs[] = {288.15,   216.65,  216.65,  228.65,  270.65,  270.65,  214.65};
-
-	float Lb, Pb, Tb, hb;
-	int b;
-
-	for (b=0; b<(int)LEN(Lbs)-1; b++) {
-		if (alt < hbs[b+1]) {
-			Lb = Lbs[b];
-			Pb = Pbs[b];
-			Tb = Tbs[b];
-			hb = hbs[b];
-			break;
-		}
-	}
+				m_batchCapacity = std::max((size_t)m_batchSize, (size_t)((int64_t)m_batchLatency * m_samplerate / 1000)) + STREAM_BUFFER_SIZE;
+				m_batch.reserve(m_batchCapacity);
+			}
 
-	if (b == (int)LEN(Lbs) - 1) {
-		Lb = Lbs[b];
-		Pb = Pbs[b];
-		Tb = Tbs[b];
-		hb = hbs[b];
-	}
+			void decodeBatch(uint64_t now) {
+				m_metrics.latencyNs.add(now - m_batchStart);
+				process(m_batch.data(), m_batch.size());
+				m_batch.clear();
+			}
 
-	if (Lb != 0) {
-		return 1e-2 * Pb * powf((Tb + Lb * (alt - hb)) / Tb, - (g0 * M) / (R_star * Lb));
-	}
-	return 1e-2 * Pb * expf(-g0 * M * (alt - hb) / (R_star * Tb));
+			/* Hand the current frame to the callback, flagging what changed since the last one */
+			void emit() {
+				int changed = 0;
+
+				if (m_data.seq != m_last.seq) changed |= HAS_SEQ;
+				if (m_data.lat != m_last.lat || m_data.lon != m_last.lon || m_data.alt != m_last.alt) changed |= HAS_POS;
+				if (m_data.spd != m_last.spd || m_data.hdg != m_last.hdg || m_data.climb != m_last.climb) changed |= HAS_SPEED;
+				if (m_data.time != m_last.time) changed |= HAS_TIME;
+				if (m_data.temp != m_last.temp || m_data.rh != m_last.rh || m_data.pressure != m_last.pressure
+				 || m_data.calib_percent != m_last.calib_percent) changed |= HAS_PTU;
+				if (strcmp(m_data.serial, m_last.serial)) changed |= HAS_SERIAL;
+				if (m_data.burstkill != m_last.burstkill) changed |= HAS_SHUTDOWN;
+				if (m_data.aux.type != m_last.aux.type
+				 || (m_data.aux.type == AUX_OZONE && m_data.aux.ozone.o3_mpa != m_last.aux.ozone.o3_mpa)) changed |= HAS_AUX;
+
+				/* Nothing to compare the first frame against */
+				m_data.changed = m_hasLast ? changed : HAS_ALL;
+
+				if (m_qualityCount) {
+					const double mean = m_qualitySum / m_qualityCount;
+					m_data.quality.offset = mean;
+					m_data.quality.deviation = sqrt(fmax(m_qualitySumSq / m_qualityCount - mean * mean, 0.0));
+				}
+				m_data.quality.badFragments = m_badFragments;
+				m_qualitySum = m_qualitySumSq = 0;
+				m_qualityCount = 0;
+				m_badFragments = 0;
+				m_last = m_data;
+				m_hasLast = true;
+				m_frameDone = true;
+
+				m_callback(&m_data, m_ctx);
+			}
+
+	};
 }
@@ -0,0 +1,71 @@
+#include <math.h>
+#include <string.h>
+#include "decoderpool.hpp"
+
+using namespace radiosonde;
+
+void
+DecoderPool::park(std::unique_ptr<DecoderBase> decoder, int tag, double frequency, float bandwidth, const SondeFullData &data)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	Entry entry;
+
+	if (!decoder || !data.serial[0] || !m_capacity) return;
+
+	/* Only one decoder per sonde: if it was already parked, keep the newest */
+	for (auto it = m_entries.begin(); it != m_entries.end(); it++) {
+		if (it->tag == tag && !strncmp(it->data.serial, data.serial, sizeof(data.serial))) {
+			m_entries.erase(it);
+			break;
+		}
+	}
+
+	if (m_entries.size() >= m_capacity) {
+		auto oldest = m_entries.begin();
+		for (auto it = m_entries.begin(); it != m_entries.end(); it++) {
+			if (it->since < oldest->since) oldest = it;
+		}
+		m_entries.erase(oldest);
+	}
+
+	entry.decoder = std::move(decoder);
+	entry.tag = tag;
+	entry.frequency = frequency;
+	entry.bandwidth = bandwidth;
+	entry.data = data;
+	entry.since = std::chrono::steady_clock::now();
+	m_entries.push_back(std::move(entry));
+}
+
+std::unique_ptr<DecoderBase>
+DecoderPool::take(int tag, double frequency, SondeFullData *data)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	std::unique_ptr<DecoderBase> decoder;
+	auto best = m_entries.end();
+
+	for (auto it = m_entries.begin(); it != m_entries.end(); it++) {
+		if (it->tag != tag || fabs(it->frequency - frequency) >= it->bandwidth / 2) continue;
+		if (best == m_entries.end() || it->data.calib_percent > best->data.calib_percent) best = it;
+	}
+	if (best == m_entries.end()) return decoder;
+
+	decoder = std::move(best->decoder);
+	if (data) *data = best->data;
+	m_entries.erase(best);
+	return decoder;
+}
+
+void
+DecoderPool::clear()
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	m_entries.clear();
+}
+
+size_t
+DecoderPool::size()
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	return m_entries.size();
+}
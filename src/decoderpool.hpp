@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "decode/decoder.hpp"
+
+namespace radiosonde {
+	/**
+	 * Idle decoders, kept around after the channel they were decoding goes
+	 * away. Decoders accumulate per-sonde state over many frames (e.g. the
+	 * RS41 calibration data takes minutes to be received in full): when a
+	 * sonde is picked up again at the same frequency after a fade, handing
+	 * back its old decoder means that calibrated PTU is available from the
+	 * first frame, instead of after another full calibration cycle.
+	 */
+	class DecoderPool {
+	public:
+		DecoderPool(size_t capacity = 16) { m_capacity = capacity; };
+
+		/**
+		 * Add an idle decoder to the pool. Only decoders that decoded a serial
+		 * number are kept, any other decoder is just destroyed. If the pool is
+		 * full, the decoder that has been idle for the longest is evicted.
+		 *
+		 * @param decoder decoder to park, ownership is transferred to the pool
+		 * @param tag opaque value identifying the decoder type
+		 * @param frequency frequency the decoder was used on, in Hz
+		 * @param bandwidth bandwidth of the channel, in Hz
+		 * @param data last data reported by the decoder
+		 */
+		void park(std::unique_ptr<DecoderBase> decoder, int tag, double frequency, float bandwidth, const SondeFullData &data);
+
+		/**
+		 * Take a decoder out of the pool.
+		 *
+		 * @param tag type of decoder to look for
+		 * @param frequency frequency of the new channel, in Hz
+		 * @param data filled with the last data reported by the decoder, if any
+		 * @return a decoder of the given type previously used within the
+		 *         bandwidth of the new channel (the most calibrated one if
+		 *         there are several), or NULL if there is none
+		 */
+		std::unique_ptr<DecoderBase> take(int tag, double frequency, SondeFullData *data);
+
+		void clear();
+		size_t size();
+
+	private:
+		struct Entry {
+			std::unique_ptr<DecoderBase> decoder;
+			int tag;
+			double frequency;
+			float bandwidth;
+			SondeFullData data;
+			std::chrono::steady_clock::time_point since;
+		};
+
+		std::mutex m_mtx;
+		std::vector<Entry> m_entries;
+		size_t m_capacity;
+	};
+}
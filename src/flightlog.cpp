@@ -0,0 +1,453 @@
+#include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "flightlog.hpp"
+#include "gpx.hpp"
+#include "ptu.hpp"
+
+#define FLAG_CALIBRATED (1 << 0)
+
+/* Little-endian serialization helpers {{{ */
+static inline void
+put_u16(uint8_t *buf, uint16_t val)
+{
+	buf[0] = val;
+	buf[1] = val >> 8;
+}
+
+static inline void
+put_u32(uint8_t *buf, uint32_t val)
+{
+	for (int i=0; i<4; i++) buf[i] = val >> (8 * i);
+}
+
+static inline void
+put_u64(uint8_t *buf, uint64_t val)
+{
+	for (int i=0; i<8; i++) buf[i] = val >> (8 * i);
+}
+
+static inline void
+put_f32(uint8_t *buf, float val)
+{
+	uint32_t tmp;
+	memcpy(&tmp, &val, sizeof(tmp));
+	put_u32(buf, tmp);
+}
+
+static inline uint16_t
+get_u16(const uint8_t *buf)
+{
+	return buf[0] | buf[1] << 8;
+}
+
+static inline uint32_t
+get_u32(const uint8_t *buf)
+{
+	uint32_t val = 0;
+	for (int i=0; i<4; i++) val |= (uint32_t)buf[i] << (8 * i);
+	return val;
+}
+
+static inline uint64_t
+get_u64(const uint8_t *buf)
+{
+	uint64_t val = 0;
+	for (int i=0; i<8; i++) val |= (uint64_t)buf[i] << (8 * i);
+	return val;
+}
+
+static inline float
+get_f32(const uint8_t *buf)
+{
+	const uint32_t tmp = get_u32(buf);
+	float val;
+	memcpy(&val, &tmp, sizeof(val));
+	return val;
+}
+/* }}} */
+
+void
+encodeFlightLogFrame(uint8_t *record, const SondeFullData *data, int serialId)
+{
+	const float fields[] = {
+		data->lat, data->lon, data->alt,
+		data->spd, data->hdg, data->climb,
+		data->temp, data->rh, data->dewpt, data->pressure,
+		data->calib_percent,
+	};
+
+	memset(record, 0, FLIGHTLOG_RECORD_SIZE);
+	record[0] = FLIGHTLOG_FRAME;
+	record[1] = data->calibrated ? FLAG_CALIBRATED : 0;
+	put_u16(&record[2], serialId);
+	put_u32(&record[4], data->seq);
+	put_u64(&record[8], data->time);
+	put_u32(&record[16], data->burstkill);
+	for (size_t i=0; i<sizeof(fields)/sizeof(*fields); i++) {
+		put_f32(&record[20 + 4*i], fields[i]);
+	}
+
+	record[64] = data->aux.type;
+	switch (data->aux.type) {
+		case AUX_OZONE:
+			put_f32(&record[68], data->aux.ozone.o3_mpa);
+			break;
+		default:
+			break;
+	}
+}
+
+/* Writer {{{ */
+bool
+FlightLogWriter::init(const char *fname, const radiosonde::SegmentPolicy &policy)
+{
+	uint8_t header[FLIGHTLOG_HEADER_SIZE] = {0};
+
+	deinit();
+
+	memcpy(header, FLIGHTLOG_MAGIC, 8);
+	put_u16(&header[8], FLIGHTLOG_VERSION);
+	put_u16(&header[10], FLIGHTLOG_HEADER_SIZE);
+	put_u16(&header[12], FLIGHTLOG_RECORD_SIZE);
+
+	/* The single file is segment 0, and keeps the dictionary it already has.
+	 * Whatever is there if it can't be appended to is kept aside, not lost */
+	m_dictionaries.clear();
+	if (!policy.segmented() && !resume(fname, m_dictionaries[0])) {
+		m_dictionaries[0] = Dictionary();
+		if (!radiosonde::moveAside(fname)) return false;
+	}
+
+	m_file.setCloseHandler(segmentClosed, this);
+	return m_file.open(fname, policy, header, sizeof(header));
+}
+
+void
+FlightLogWriter::deinit()
+{
+	m_file.close();
+}
+
+void
+FlightLogWriter::addPoint(const SondeFullData *data)
+{
+	uint8_t record[FLIGHTLOG_RECORD_SIZE];
+	int64_t segment;
+
+	if (!m_file.isOpen()) return;
+	if ((segment = m_file.select(data->time, data->serial)) < 0) return;
+
+	/* Each segment defines the serial numbers it uses, once */
+	encodeFlightLogFrame(record, data, serialId(m_dictionaries[segment], data->serial));
+	m_file.write(record, sizeof(record));
+}
+
+void
+FlightLogWriter::flush()
+{
+	m_file.flush();
+}
+
+/**
+ * Look up the ID for a serial number, adding it to the dictionary if needed
+ */
+int
+FlightLogWriter::serialId(Dictionary &dict, const char *serial)
+{
+	uint8_t record[FLIGHTLOG_RECORD_SIZE] = {0};
+
+	if (!serial[0]) return FLIGHTLOG_NO_SERIAL;
+	if (dict.last >= 0 && dict.serials[dict.last] == serial) return dict.last;
+
+	for (size_t i=0; i<dict.serials.size(); i++) {
+		if (dict.serials[i] == serial) return (dict.last = i);
+	}
+	if (dict.serials.size() >= FLIGHTLOG_NO_SERIAL) return FLIGHTLOG_NO_SERIAL;
+
+	dict.last = dict.serials.size();
+	dict.serials.push_back(serial);
+
+	record[0] = FLIGHTLOG_SERIAL;
+	put_u16(&record[2], dict.last);
+	strncpy((char*)&record[4], serial, SERIAL_MAXLEN);
+	m_file.write(record, sizeof(record));
+
+	return dict.last;
+}
+
+/**
+ * Load the serial dictionary of an existing log, and cut off any partially
+ * written record so that new ones stay aligned.
+ *
+ * @return true if there is nothing to resume or the log can be appended to,
+ *         false if it is from another version or not a flight log at all
+ */
+bool
+FlightLogWriter::resume(const char *fname, Dictionary &dict)
+{
+	uint8_t header[FLIGHTLOG_HEADER_SIZE], record[FLIGHTLOG_RECORD_SIZE];
+	long end;
+	FILE *fd;
+
+	if (!(fd = fopen(fname, "r+b"))) return true;
+
+	if (fread(header, sizeof(header), 1, fd) != 1 || memcmp(header, FLIGHTLOG_MAGIC, 8)
+	 || get_u16(&header[8]) != FLIGHTLOG_VERSION || get_u16(&header[10]) != FLIGHTLOG_HEADER_SIZE
+	 || get_u16(&header[12]) != FLIGHTLOG_RECORD_SIZE) {
+		fclose(fd);
+		return false;
+	}
+
+	end = FLIGHTLOG_HEADER_SIZE;
+	while (fread(record, sizeof(record), 1, fd) == 1) {
+		if (record[0] == FLIGHTLOG_SERIAL) {
+			const uint16_t id = get_u16(&record[2]);
+			if (id >= dict.serials.size()) dict.serials.resize(id + 1);
+			dict.serials[id] = std::string((const char*)&record[4], strnlen((const char*)&record[4], SERIAL_MAXLEN));
+		}
+		end += sizeof(record);
+	}
+
+	fflush(fd);
+#ifdef _WIN32
+	_chsize(_fileno(fd), end);
+#else
+	if (ftruncate(fileno(fd), end) < 0) {
+		fclose(fd);
+		return false;
+	}
+#endif
+	fclose(fd);
+	return true;
+}
+
+void
+FlightLogWriter::segmentClosed(int64_t id, void *ctx)
+{
+	FlightLogWriter *_this = (FlightLogWriter*)ctx;
+	_this->m_dictionaries.erase(id);
+}
+/* }}} */
+
+/* Reader {{{ */
+FlightLogReader::FlightLogReader()
+{
+	m_data = NULL;
+	m_size = m_recordSize = 0;
+	m_mapping = NULL;
+}
+
+bool
+FlightLogReader::open(const char *fname)
+{
+	size_t headerSize;
+
+	close();
+
+	/* Map the whole file */
+#ifdef _WIN32
+	HANDLE file, mapping;
+	LARGE_INTEGER size;
+
+	file = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart < FLIGHTLOG_HEADER_SIZE) {
+		CloseHandle(file);
+		return false;
+	}
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping) return false;
+
+	m_data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!m_data) {
+		CloseHandle(mapping);
+		return false;
+	}
+	m_mapping = mapping;
+	m_size = size.QuadPart;
+#else
+	struct stat st;
+	void *ptr;
+	int fd;
+
+	if ((fd = ::open(fname, O_RDONLY)) < 0) return false;
+	if (fstat(fd, &st) < 0 || st.st_size < FLIGHTLOG_HEADER_SIZE) {
+		::close(fd);
+		return false;
+	}
+	ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (ptr == MAP_FAILED) return false;
+
+	m_data = (const uint8_t*)ptr;
+	m_size = st.st_size;
+#endif
+
+	/* Validate the header. Newer minor revisions may append fields to the
+	 * records, which are skipped over */
+	headerSize = get_u16(&m_data[10]);
+	m_recordSize = get_u16(&m_data[12]);
+	if (memcmp(m_data, FLIGHTLOG_MAGIC, 8) || get_u16(&m_data[8]) > FLIGHTLOG_VERSION
+	 || headerSize < FLIGHTLOG_HEADER_SIZE || m_recordSize < FLIGHTLOG_RECORD_SIZE_V1) {
+		close();
+		return false;
+	}
+
+	/* Index frames and build the serial dictionary */
+	for (size_t offset = headerSize; offset + m_recordSize <= m_size; offset += m_recordSize) {
+		const uint8_t *record = &m_data[offset];
+
+		switch (record[0]) {
+			case FLIGHTLOG_FRAME:
+				m_frames.push_back(offset);
+				break;
+			case FLIGHTLOG_SERIAL: {
+				const uint16_t id = get_u16(&record[2]);
+				if (id >= m_serials.size()) m_serials.resize(id + 1);
+				m_serials[id] = std::string((const char*)&record[4], strnlen((const char*)&record[4], SERIAL_MAXLEN));
+				break;
+			}
+			default:
+				break;
+		}
+	}
+
+	return true;
+}
+
+void
+FlightLogReader::close()
+{
+	if (!m_data) return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(m_data);
+	CloseHandle((HANDLE)m_mapping);
+#else
+	munmap((void*)m_data, m_size);
+#endif
+
+	m_data = NULL;
+	m_mapping = NULL;
+	m_size = m_recordSize = 0;
+	m_frames.clear();
+	m_serials.clear();
+}
+
+bool
+FlightLogReader::getFrame(size_t idx, SondeFullData *data) const
+{
+	const uint8_t *record;
+	uint16_t id;
+	float *fields[] = {
+		&data->lat, &data->lon, &data->alt,
+		&data->spd, &data->hdg, &data->climb,
+		&data->temp, &data->rh, &data->dewpt, &data->pressure,
+		&data->calib_percent,
+	};
+
+	if (idx >= m_frames.size()) return false;
+	record = &m_data[m_frames[idx]];
+
+	data->init();
+	data->calibrated = record[1] & FLAG_CALIBRATED;
+	id = get_u16(&record[2]);
+	if (id < m_serials.size()) {
+		snprintf(data->serial, sizeof(data->serial), "%s", m_serials[id].c_str());
+	}
+	data->seq = (int32_t)get_u32(&record[4]);
+	data->time = (int64_t)get_u64(&record[8]);
+	data->burstkill = (int32_t)get_u32(&record[16]);
+	for (size_t i=0; i<sizeof(fields)/sizeof(*fields); i++) {
+		*fields[i] = get_f32(&record[20 + 4*i]);
+	}
+
+	/* Version 1 logs have no aux data */
+	if (m_recordSize >= FLIGHTLOG_RECORD_SIZE) {
+		switch (record[64]) {
+			case AUX_OZONE:
+				data->aux.type = AUX_OZONE;
+				data->aux.ozone.o3_mpa = get_f32(&record[68]);
+				break;
+			default:
+				break;
+		}
+	}
+
+	return true;
+}
+
+size_t
+FlightLogReader::findFrame(time_t time) const
+{
+	size_t lo = 0, hi = m_frames.size();
+
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if ((time_t)get_u64(&m_data[m_frames[mid] + 8]) < time) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+bool
+FlightLogReader::exportCSV(const char *fname) const
+{
+	PTUWriter writer;
+	SondeFullData data;
+
+	/* PTUWriter appends to existing files, start from scratch instead */
+	remove(fname);
+	if (!writer.init(fname)) return false;
+	for (size_t i=0; i<frameCount(); i++) {
+		getFrame(i, &data);
+		writer.addPoint(&data);
+	}
+	writer.deinit();
+	return true;
+}
+
+bool
+FlightLogReader::exportGPX(const char *fname) const
+{
+	GPXWriter writer;
+	SondeFullData data;
+	std::vector<std::vector<size_t>> tracks(m_serials.size());
+
+	/* Group frames by serial number, so that each sonde gets a single track
+	 * even if frames from several of them are interleaved */
+	for (size_t i=0; i<frameCount(); i++) {
+		const uint16_t id = get_u16(&m_data[m_frames[i] + 2]);
+		if (id < tracks.size()) tracks[id].push_back(i);
+	}
+
+	/* GPXWriter appends to existing files, start from scratch instead */
+	remove(fname);
+	if (!writer.init(fname)) return false;
+
+	for (size_t id=0; id<tracks.size(); id++) {
+		if (tracks[id].empty()) continue;
+
+		writer.startTrack(m_serials[id].c_str());
+		for (size_t idx : tracks[id]) {
+			getFrame(idx, &data);
+			writer.addTrackPoint(data.time, data.lat, data.lon, data.alt, data.spd, data.hdg);
+		}
+		writer.stopTrack();
+	}
+	writer.deinit();
+	return true;
+}
+/* }}} */
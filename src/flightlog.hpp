@@ -0,0 +1,162 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "decode/common.hpp"
+#include "segment.hpp"
+
+/**
+ * Binary flight log format. A 16 byte header is followed by fixed-size
+ * records, all fields little-endian:
+ *
+ * Header:  magic "SDRPPFLT", u16 version, u16 header size, u16 record size, u16 reserved
+ * Frame:   u8 type (0), u8 flags (bit 0: calibrated), u16 serial ID, i32 seq,
+ *          i64 time, i32 burstkill, f32 lat, lon, alt, spd, hdg, climb,
+ *          temp, rh, dewpt, pressure, calib_percent,
+ *          (since version 2) u8 aux type, u8[3] reserved, f32 aux value
+ * Serial:  u8 type (1), u8 reserved, u16 serial ID, char serial[SERIAL_MAXLEN]
+ *
+ * Serial records map IDs to serial numbers, and are written the first time a
+ * serial number is seen, before the frame referencing it. Frames without a
+ * serial number use ID 0xFFFF.
+ */
+#define FLIGHTLOG_MAGIC "SDRPPFLT"
+#define FLIGHTLOG_VERSION 2
+#define FLIGHTLOG_HEADER_SIZE 16
+#define FLIGHTLOG_RECORD_SIZE 72
+#define FLIGHTLOG_RECORD_SIZE_V1 64
+#define FLIGHTLOG_NO_SERIAL 0xFFFF
+
+enum FlightLogRecordType {
+	FLIGHTLOG_FRAME = 0,
+	FLIGHTLOG_SERIAL = 1,
+};
+
+/**
+ * Encode a frame record.
+ *
+ * @param record output buffer, FLIGHTLOG_RECORD_SIZE bytes long
+ * @param data frame to encode
+ * @param serialId ID of the serial number, or FLIGHTLOG_NO_SERIAL
+ */
+void encodeFlightLogFrame(uint8_t *record, const SondeFullData *data, int serialId);
+
+/**
+ * Writer for binary flight logs, the compact counterpart to PTUWriter. Each
+ * segment (see radiosonde::SegmentedFile) is a complete log, with its own
+ * header and serial dictionary.
+ */
+class FlightLogWriter {
+public:
+	~FlightLogWriter() { deinit(); };
+
+	/**
+	 * Open the log. Without segmentation, frames are appended to an existing
+	 * log of the same version. Anything else already at that path (a log from
+	 * another version, or not a flight log at all) is renamed to
+	 * <fname>.old, or <fname>.old-N if that exists too, and a new log is
+	 * started.
+	 *
+	 * @param fname path to the log
+	 * @param policy how to split the log into segments
+	 * @return true on success, false otherwise
+	 */
+	bool init(const char *fname, const radiosonde::SegmentPolicy &policy = radiosonde::SegmentPolicy());
+	void deinit();
+
+	/**
+	 * Log a new point to file.
+	 *
+	 * @param data data to log
+	 */
+	void addPoint(const SondeFullData *data);
+
+	/**
+	 * Commit buffered points to disk
+	 */
+	void flush();
+
+private:
+	struct Dictionary {
+		std::vector<std::string> serials;
+		int last = -1;                      /* Index of the last serial looked up, -1 if none */
+	};
+
+	int serialId(Dictionary &dict, const char *serial);
+	bool resume(const char *fname, Dictionary &dict);
+	static void segmentClosed(int64_t id, void *ctx);
+
+	radiosonde::SegmentedFile m_file;
+	std::unordered_map<int64_t, Dictionary> m_dictionaries;    /* Serials defined in each open segment */
+};
+
+/**
+ * Read-only, memory-mapped view of a binary flight log. Frames can be
+ * accessed in any order, and the whole log can be converted to the same CSV
+ * and GPX formats the plugin writes.
+ */
+class FlightLogReader {
+public:
+	FlightLogReader();
+	~FlightLogReader() { close(); };
+
+	/**
+	 * Map a flight log into memory. A truncated last record (e.g. after a
+	 * crash) is ignored.
+	 *
+	 * @param fname path to the log
+	 * @return true on success, false otherwise
+	 */
+	bool open(const char *fname);
+	void close();
+
+	size_t frameCount() const { return m_frames.size(); }
+
+	/**
+	 * Decode a frame.
+	 *
+	 * @param idx frame index, between 0 and frameCount()
+	 * @param data where to store the decoded frame
+	 * @return true on success, false if the index is out of range
+	 */
+	bool getFrame(size_t idx, SondeFullData *data) const;
+
+	/**
+	 * Find the first frame at or after a given time. Assumes frames were logged
+	 * in chronological order.
+	 *
+	 * @param time UTC time to look for
+	 * @return frame index, or frameCount() if all frames are older
+	 */
+	size_t findFrame(time_t time) const;
+
+	/**
+	 * Convert the log to CSV, in the same format as PTUWriter.
+	 *
+	 * @param fname path to the output file
+	 * @return true on success, false otherwise
+	 */
+	bool exportCSV(const char *fname) const;
+
+	/**
+	 * Convert the log to a GPX file, with one track per serial number.
+	 * Frames without a serial number are skipped.
+	 *
+	 * @param fname path to the output file
+	 * @return true on success, false otherwise
+	 */
+	bool exportGPX(const char *fname) const;
+
+private:
+	const uint8_t *m_data;
+	size_t m_size;
+	size_t m_recordSize;
+	void *m_mapping;
+
+	std::vector<size_t> m_frames;           /* Offset of each frame record */
+	std::vector<std::string> m_serials;     /* Serial number for each ID */
+};
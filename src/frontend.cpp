@@ -0,0 +1,291 @@
+#include <math.h>
+#include <string.h>
+#include <mutex>
+#include "frontend.hpp"
+
+using namespace radiosonde;
+
+/* Arctangent of y/x over the whole circle, max error about 1e-5 rad. Uses
+ * atan2(y, x) = pi/2 - sign(x) pi/4 - atan(r), with r in [-1, 1] for any x and
+ * y, so that there are no branches or selects and loops calling it vectorize */
+static inline float
+fast_atan2(float y, float x)
+{
+	const float ay = fabsf(y) + 1e-30f;
+	const float sx = copysignf(1.0f, x);
+	const float r = (x - sx * ay) / (fabsf(x) + ay);
+	const float s = r * r;
+	const float atanr = r * (0.99986600f + s * (-0.33029950f + s * (0.18014100f + s * (-0.08513300f + s * 0.02083510f))));
+
+	return copysignf((float)M_PI_2 - sx * (float)M_PI_4 - atanr, y);
+}
+
+/* Dot product of N samples, with 8 independent accumulators so that the
+ * compiler can map them to SIMD lanes without reassociating the sum */
+template<int N>
+static float
+dot(const float *x, const float *taps)
+{
+	float acc[8] = {0};
+
+	for (int i=0; i<N; i += 8) {
+		for (int j=0; j<8; j++) acc[j] += x[i+j] * taps[i+j];
+	}
+	return ((acc[0] + acc[4]) + (acc[1] + acc[5])) + ((acc[2] + acc[6]) + (acc[3] + acc[7]));
+}
+
+static const struct {
+	int taps;
+	float (*kernel)(const float *x, const float *taps);
+} kernels[] = {
+	{8, dot<8>},
+	{16, dot<16>},
+	{24, dot<24>},
+	{32, dot<32>},
+	{48, dot<48>},
+	{64, dot<64>},
+};
+
+/* FMDiscriminator {{{ */
+FMDiscriminator::FMDiscriminator()
+{
+	m_samplerate = m_bandwidth = 0;
+	m_gain = 0;
+	m_last = dsp::complex_t{1, 0};
+}
+
+void
+FMDiscriminator::init(dsp::stream<dsp::complex_t> *in, double samplerate, double bandwidth)
+{
+	m_samplerate = samplerate;
+	m_bandwidth = bandwidth;
+	update();
+	reset();
+	dsp::Processor<dsp::complex_t, float>::init(in);
+}
+
+void
+FMDiscriminator::setSamplerate(double samplerate)
+{
+	std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+	m_samplerate = samplerate;
+	update();
+}
+
+void
+FMDiscriminator::setBandwidth(double bandwidth)
+{
+	std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+	m_bandwidth = bandwidth;
+	update();
+}
+
+void
+FMDiscriminator::reset()
+{
+	std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+	m_last = dsp::complex_t{1, 0};
+}
+
+int
+FMDiscriminator::process(int count, const dsp::complex_t *in, float *out)
+{
+	float re, im;
+
+	if (count <= 0) return 0;
+
+	/* Phase of in[i] * conj(in[i-1]) */
+	re = in[0].re * m_last.re + in[0].im * m_last.im;
+	im = in[0].im * m_last.re - in[0].re * m_last.im;
+	out[0] = fast_atan2(im, re) * m_gain;
+	for (int i=1; i<count; i++) {
+		re = in[i].re * in[i-1].re + in[i].im * in[i-1].im;
+		im = in[i].im * in[i-1].re - in[i].re * in[i-1].im;
+		out[i] = fast_atan2(im, re) * m_gain;
+	}
+
+	m_last = in[count-1];
+	return count;
+}
+
+int
+FMDiscriminator::run()
+{
+	int count;
+
+	if ((count = _in->read()) < 0) return -1;
+	process(count, _in->readBuf, out.writeBuf);
+	_in->flush();
+	if (!out.swap(count)) return -1;
+	return count;
+}
+
+/* Private methods {{{ */
+void
+FMDiscriminator::update()
+{
+	/* Same scaling as dsp::demod::FM: the deviation is half the bandwidth */
+	m_gain = m_bandwidth > 0 ? m_samplerate / (M_PI * m_bandwidth) : 0;
+}
+/* }}} */
+/* }}} */
+
+/* FixedResampler {{{ */
+FixedResampler::FixedResampler()
+{
+	m_inSamplerate = m_outSamplerate = 0;
+	m_taps = FRONTEND_TAPS;
+	m_interp = m_decim = 1;
+	m_kernel = NULL;
+	m_phase = m_offset = 0;
+}
+
+void
+FixedResampler::init(dsp::stream<float> *in, double inSamplerate, double outSamplerate, int tapsPerPhase)
+{
+	m_inSamplerate = inSamplerate;
+	m_outSamplerate = outSamplerate;
+	m_taps = supported(tapsPerPhase) ? tapsPerPhase : FRONTEND_TAPS;
+	design();
+	dsp::Processor<float, float>::init(in);
+}
+
+void
+FixedResampler::setInSamplerate(double samplerate)
+{
+	std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+	tempStop();
+	m_inSamplerate = samplerate;
+	design();
+	tempStart();
+}
+
+void
+FixedResampler::setOutSamplerate(double samplerate)
+{
+	std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+	tempStop();
+	m_outSamplerate = samplerate;
+	design();
+	tempStart();
+}
+
+void
+FixedResampler::setTapsPerPhase(int tapsPerPhase)
+{
+	if (!supported(tapsPerPhase) || tapsPerPhase == m_taps) return;
+
+	std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+	tempStop();
+	m_taps = tapsPerPhase;
+	design();
+	tempStart();
+}
+
+void
+FixedResampler::reset()
+{
+	std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+	m_history.assign(m_taps - 1, 0.0f);
+	m_phase = m_offset = 0;
+}
+
+int
+FixedResampler::process(int count, const float *in, float *out)
+{
+	const int keep = m_taps - 1;
+	int outCount = 0;
+
+	if (count <= 0) return 0;
+
+	/* The window for the input sample at index i starts at m_history[i] */
+	if ((int)m_history.size() < keep + count) m_history.resize(keep + count);
+	memcpy(m_history.data() + keep, in, sizeof(*in) * count);
+
+	while (m_offset < count) {
+		out[outCount++] = m_kernel(m_history.data() + m_offset, m_phases.data() + m_phase * m_taps);
+		m_phase += m_decim;
+		m_offset += m_phase / m_interp;
+		m_phase %= m_interp;
+	}
+	m_offset -= count;
+
+	memmove(m_history.data(), m_history.data() + count, sizeof(float) * keep);
+	return outCount;
+}
+
+int
+FixedResampler::run()
+{
+	int count, outCount;
+
+	if ((count = _in->read()) < 0) return -1;
+	outCount = process(count, _in->readBuf, out.writeBuf);
+	_in->flush();
+	if (!out.swap(outCount)) return -1;
+	return outCount;
+}
+
+bool
+FixedResampler::supported(int tapsPerPhase)
+{
+	for (auto &k : kernels) {
+		if (k.taps == tapsPerPhase) return true;
+	}
+	return false;
+}
+
+/* Private methods {{{ */
+static long
+gcd(long a, long b)
+{
+	while (b) {
+		const long t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+void
+FixedResampler::design()
+{
+	const long in = lround(m_inSamplerate), out = lround(m_outSamplerate);
+	const long g = gcd(in, out);
+	double cutoff, sum, x, w;
+	std::vector<double> proto;
+	int length;
+
+	m_interp = g ? out / g : 1;
+	m_decim = g ? in / g : 1;
+	for (auto &k : kernels) {
+		if (k.taps == m_taps) m_kernel = k.kernel;
+	}
+
+	/* Prototype filter at the interpolated rate: Blackman-windowed sinc, cut
+	 * off at 80% of the lower of the two Nyquist frequencies, unity gain at
+	 * DC for each branch */
+	length = m_interp * m_taps;
+	cutoff = 0.4 * fmin(in, out) / ((double)in * m_interp);
+	proto.resize(length);
+	sum = 0;
+	for (int i=0; i<length; i++) {
+		x = i - (length - 1) / 2.0;
+		w = 0.42 - 0.5 * cos(2 * M_PI * i / (length - 1)) + 0.08 * cos(4 * M_PI * i / (length - 1));
+		proto[i] = w * (x == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * x) / (M_PI * x));
+		sum += proto[i];
+	}
+
+	/* Split into branches, each one reversed so that it can be used as a dot
+	 * product against the history (oldest sample first) */
+	m_phases.resize(length);
+	for (int p=0; p<m_interp; p++) {
+		for (int k=0; k<m_taps; k++) {
+			m_phases[p * m_taps + (m_taps - 1 - k)] = proto[k * m_interp + p] * m_interp / sum;
+		}
+	}
+
+	reset();
+}
+/* }}} */
+/* }}} */
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <vector>
+#include <dsp/processor.h>
+#include <dsp/types.h>
+#include "sched.hpp"
+
+#define FRONTEND_TAPS 16        /* Default taps per phase of the resampler */
+
+namespace radiosonde {
+	/**
+	 * FM discriminator, a drop-in replacement for dsp::demod::FM<float> without
+	 * the post-demodulation filters. The phase difference between consecutive
+	 * samples is computed from their conjugate product with a polynomial
+	 * arctangent instead of libm's atan2(), so that the loop has no branches or
+	 * calls and can be vectorized by the compiler. With the default flags that
+	 * means SSE2 on x86-64 and NEON on AArch64; AVX needs -march flags, and
+	 * 32-bit ARM stays scalar, as GCC does not vectorize float loops for
+	 * ARMv7 NEON without -funsafe-math-optimizations.
+	 */
+	class FMDiscriminator : public ScheduledBlock<dsp::Processor<dsp::complex_t, float>> {
+	public:
+		FMDiscriminator();
+
+		/**
+		 * Set up the discriminator.
+		 *
+		 * @param in input stream, NULL when driven through process()
+		 * @param samplerate input samplerate, in Hz
+		 * @param bandwidth bandwidth of the signal, in Hz. A frequency offset of
+		 *        bandwidth/2 maps to an output of 1, as with dsp::demod::FM
+		 */
+		void init(dsp::stream<dsp::complex_t> *in, double samplerate, double bandwidth);
+
+		void setSamplerate(double samplerate);
+		void setBandwidth(double bandwidth);
+
+		/**
+		 * Reset the internal state, as if the discriminator was just initialized
+		 */
+		void reset();
+
+		int process(int count, const dsp::complex_t *in, float *out);
+		int run() override;
+
+	private:
+		void update();
+
+		double m_samplerate, m_bandwidth;
+		float m_gain;
+		dsp::complex_t m_last;
+	};
+
+	/**
+	 * Polyphase rational resampler for real signals, a drop-in replacement for
+	 * dsp::multirate::RationalResampler<float>. The length of each polyphase
+	 * branch is fixed at compile time (a multiple of 8, see supported()), so
+	 * that the dot products are fully unrolled (and vectorized, where the
+	 * discriminator is) instead of looping over a runtime number of taps.
+	 */
+	class FixedResampler : public ScheduledBlock<dsp::Processor<float, float>> {
+	public:
+		FixedResampler();
+
+		/**
+		 * Set up the resampler.
+		 *
+		 * @param in input stream, NULL when driven through process()
+		 * @param inSamplerate input samplerate, in Hz
+		 * @param outSamplerate output samplerate, in Hz
+		 * @param tapsPerPhase taps in each polyphase branch, one of supported()
+		 */
+		void init(dsp::stream<float> *in, double inSamplerate, double outSamplerate, int tapsPerPhase = FRONTEND_TAPS);
+
+		void setInSamplerate(double samplerate);
+		void setOutSamplerate(double samplerate);
+		void setTapsPerPhase(int tapsPerPhase);
+
+		/**
+		 * Reset the internal history, as if the resampler was just initialized
+		 */
+		void reset();
+
+		/**
+		 * Resample a block of samples.
+		 *
+		 * @param count number of input samples
+		 * @param in input samples
+		 * @param out output buffer, with space for at least
+		 *        count * outSamplerate / inSamplerate + 1 samples
+		 * @return number of samples written to the output buffer
+		 */
+		int process(int count, const float *in, float *out);
+		int run() override;
+
+		/**
+		 * Check whether there is a kernel for a given number of taps per phase
+		 *
+		 * @param tapsPerPhase taps in each polyphase branch
+		 * @return true if the resampler can be set up with that many taps
+		 */
+		static bool supported(int tapsPerPhase);
+
+	private:
+		void design();
+
+		double m_inSamplerate, m_outSamplerate;
+		int m_taps, m_interp, m_decim;
+		float (*m_kernel)(const float *x, const float *taps);
+		std::vector<float> m_phases;        /* One reversed branch after the other */
+		std::vector<float> m_history;       /* Last m_taps-1 input samples, then the current block */
+		int m_phase, m_offset;
+	};
+}
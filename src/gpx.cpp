@@ -2,27 +2,43 @@
 #include <math.h>
 #include <string.h>
 #include <ctype.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 #include "gpx.hpp"
 
 #define GPX_TIME_FORMAT "%Y-%m-%dT%H:%M:%SZ"
+#define GPX_HEADER "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\" ?>\n" \
+                   "<gpx xmlns=\"http://www.topografix.com/GPX/1/1\" version=\"1.1\" creator=\"SDR++\">\n"
+#define GPX_TRACK_END "</trkseg>\n</trk>\n"
+#define GPX_END "</gpx>\n"
+#define RECOVERY_WINDOW 65536   /* How far from the end of the file to look for the last complete element */
 
 bool
-GPXWriter::init(const char *fname)
+GPXWriter::init(const char *fname, const char *resumeTrack)
 {
 	if (m_fd) deinit();
 
-	m_fd = fopen(fname, "wb");
-	if (!m_fd) return false;
-
 	m_lat = m_lon = m_alt = m_time = 0;
-
 	m_trackActive = false;
-	fprintf(m_fd,
-			"<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\" ?>\n"
-			"<gpx xmlns=\"http://www.topografix.com/GPX/1/1\" version=\"1.1\" creator=\"SDR++\">\n"
-	);
-	m_offset = ftell(m_fd);
-	terminateFile();
+	m_terminated = false;
+
+	/* Append to the existing file if it looks like one of ours, start over otherwise */
+	m_fd = fopen(fname, "r+b");
+	if (m_fd && !recover(resumeTrack)) {
+		fclose(m_fd);
+		m_fd = NULL;
+	}
+
+	if (!m_fd) {
+		m_fd = fopen(fname, "w+b");
+		if (!m_fd) return false;
+		fputs(GPX_HEADER, m_fd);
+	}
+
+	checkpoint();
 	return true;
 }
 
@@ -30,7 +46,8 @@ void
 GPXWriter::deinit()
 {
 	if (!m_fd) return;
-	terminateFile();
+	stopTrack();
+	checkpoint();
 	fclose(m_fd);
 	m_fd = NULL;
 }
@@ -38,6 +55,8 @@ GPXWriter::deinit()
 void
 GPXWriter::startTrack(const char *name)
 {
+	int len;
+
 	if (!m_fd) return;
 	if (m_trackActive && !strcmp(name, sondeSerial)) return;
 	for (int i=0; name[i] != '\0'; i++) if (!isgraph(name[i])) return;
@@ -48,12 +67,9 @@ GPXWriter::startTrack(const char *name)
 
 	strncpy(sondeSerial, name, sizeof(sondeSerial)-1);
 
-	fseek(m_fd, m_offset, SEEK_SET);
-	fprintf(m_fd, "<trk>\n<name>%s</name>\n<trkseg>\n", name);
-	m_offset = ftell(m_fd);
+	len = snprintf(m_buf, sizeof(m_buf), "<trk>\n<name>%s</name>\n<trkseg>\n", name);
+	append(m_buf, len);
 	m_trackActive = true;
-
-	terminateFile();
 }
 
 
@@ -61,17 +77,18 @@ void
 GPXWriter::stopTrack()
 {
 	if (!m_fd || !m_trackActive) return;
-	stopTrackInternal();
+	append(GPX_TRACK_END, sizeof(GPX_TRACK_END)-1);
 	m_trackActive = false;
-	terminateFile();
+	checkpoint();
 }
 
 void
 GPXWriter::addTrackPoint(time_t time, float lat, float lon, float alt, float spd, float hdg)
 {
-	if (!m_fd || !m_trackActive) return;
-	fseek(m_fd, m_offset, SEEK_SET);
 	char timestr[sizeof("YYYY-MM-DDThh:mm:ssZ")+1];
+	int len;
+
+	if (!m_fd || !m_trackActive) return;
 
 	if (isnan(lat) || isnan(lon) || isnan(alt)) return;
 	if (lat == 0 && lon == 0 && alt == 0) return;       /* -ffast-math breaks NaN */
@@ -83,39 +100,158 @@ GPXWriter::addTrackPoint(time_t time, float lat, float lon, float alt, float spd
 	m_time = time;
 
 	strftime(timestr, sizeof(timestr), GPX_TIME_FORMAT, gmtime(&time));
-	fprintf(m_fd, "<trkpt lat=\"%f\" lon=\"%f\">\n", lat, lon);
-	fprintf(m_fd, "<time>%s</time>\n", timestr);
-	fprintf(m_fd, "<ele>%f</ele>\n", alt);
-	fprintf(m_fd, "<speed>%f</speed>\n", spd);
-	fprintf(m_fd, "<course>%f</course>\n", hdg);
-	fprintf(m_fd, "</trkpt>\n");
-	m_offset = ftell(m_fd);
+	len = snprintf(m_buf, sizeof(m_buf),
+	               "<trkpt lat=\"%f\" lon=\"%f\">\n"
+	               "<time>%s</time>\n"
+	               "<ele>%f</ele>\n"
+	               "<speed>%f</speed>\n"
+	               "<course>%f</course>\n"
+	               "</trkpt>\n",
+	               lat, lon, timestr, alt, spd, hdg);
+	if (len >= (int)sizeof(m_buf)) return;
+	append(m_buf, len);
+}
 
-	terminateFile();
+void
+GPXWriter::addPoint(const SondeFullData *data)
+{
+	if (!(data->changed & HAS_POS)) return;
+	addTrackPoint(data->time, data->lat, data->lon, data->alt, data->spd, data->hdg);
 }
 
 void
-GPXWriter::terminateFile()
+GPXWriter::flush()
 {
-	unsigned long offset = m_offset;
 	if (!m_fd) return;
+	fflush(m_fd);
+}
+
+void
+GPXWriter::checkpoint()
+{
+	if (!m_fd || m_terminated) return;
+
+	m_offset = ftell(m_fd);
+	if (m_trackActive) fputs(GPX_TRACK_END, m_fd);
+	fputs(GPX_END, m_fd);
+	fflush(m_fd);
+	truncate();
+	m_terminated = true;
+}
+
+/* Private methods {{{ */
+/**
+ * Find the last complete element in the file, discard anything after it,
+ * and close the track it belongs to if it was left open, unless it is the
+ * one to resume. Leaves the file positioned at the new end.
+ */
+bool
+GPXWriter::recover(const char *resumeTrack)
+{
+	/* End of each element to look for, and whether it leaves a track open */
+	const struct {
+		const char *tag;
+		bool trackOpen;
+	} anchors[] = {
+		{"</trkpt>\n", true},
+		{"<trkseg>\n", true},
+		{"</trk>\n", false},
+		{"creator=\"SDR++\">\n", false},
+	};
+	char header[sizeof(GPX_HEADER)];
+	char nameTag[sizeof(sondeSerial) + 32];
+	char *tail, *found, *lastName;
+	long size, start, end;
+	size_t len;
+	bool trackOpen, resume;
+
+	/* Check the header first */
+	len = fread(header, 1, sizeof(header)-1, m_fd);
+	header[len] = '\0';
+	if (strncmp(header, GPX_HEADER, sizeof(GPX_HEADER)-1)) return false;
+
+	fseek(m_fd, 0, SEEK_END);
+	size = ftell(m_fd);
+	start = size > RECOVERY_WINDOW ? size - RECOVERY_WINDOW : 0;
+
+	tail = new char[size - start + 1];
+	fseek(m_fd, start, SEEK_SET);
+	len = fread(tail, 1, size - start, m_fd);
+	tail[len] = '\0';
+
+	end = -1;
+	trackOpen = false;
+	for (size_t i=0; i<sizeof(anchors)/sizeof(*anchors); i++) {
+		found = NULL;
+		for (char *ptr = tail; (ptr = strstr(ptr, anchors[i].tag)); ptr++) found = ptr;
+		if (!found) continue;
+
+		const long anchorEnd = start + (found - tail) + strlen(anchors[i].tag);
+		if (anchorEnd > end) {
+			end = anchorEnd;
+			trackOpen = anchors[i].trackOpen;
+		}
+	}
+	if (end < 0) {
+		delete[] tail;
+		return false;
+	}
 
-	fseek(m_fd, m_offset, SEEK_SET);
+	/* Check whether the last track is the one to resume. If it was closed
+	 * properly, reopen it by dropping its closing tags too */
+	resume = false;
+	if (resumeTrack && strlen(resumeTrack) < sizeof(sondeSerial)) {
+		snprintf(nameTag, sizeof(nameTag), "<trk>\n<name>%s</name>\n", resumeTrack);
+		lastName = NULL;
+		for (char *ptr = tail; (ptr = strstr(ptr, "<trk>\n")) && ptr - tail < end - start; ptr++) lastName = ptr;
 
-	if (m_trackActive) stopTrackInternal();
+		if (lastName && !strncmp(lastName, nameTag, strlen(nameTag))) {
+			if (trackOpen) {
+				resume = true;
+			} else if (end - start >= (long)sizeof(GPX_TRACK_END)-1
+			        && !strncmp(&tail[end - start - (sizeof(GPX_TRACK_END)-1)], GPX_TRACK_END, sizeof(GPX_TRACK_END)-1)) {
+				end -= sizeof(GPX_TRACK_END)-1;
+				resume = true;
+			}
+		}
+	}
+	delete[] tail;
 
-	fprintf(m_fd, "</gpx>\n");
+	/* Drop the closing tags or the partially written element, then close the
+	 * track unless it is being resumed */
+	fseek(m_fd, end, SEEK_SET);
+	if (trackOpen && !resume) fputs(GPX_TRACK_END, m_fd);
 	fflush(m_fd);
-	m_offset = offset;
+	truncate();
+
+	if (resume) {
+		strncpy(sondeSerial, resumeTrack, sizeof(sondeSerial)-1);
+		m_trackActive = true;
+	}
+	return true;
 }
 
 void
-GPXWriter::stopTrackInternal()
+GPXWriter::append(const char *data, size_t len)
 {
-	if (!m_fd) return;
-	fseek(m_fd, m_offset, SEEK_SET);
-	fprintf(m_fd, "</trkseg>\n</trk>\n");
-	m_offset = ftell(m_fd);
-
+	/* Write over the closing tags, if any */
+	if (m_terminated) {
+		fseek(m_fd, m_offset, SEEK_SET);
+		m_terminated = false;
+	}
+	fwrite(data, 1, len, m_fd);
 }
 
+/**
+ * Cut the file at the current position. Must be called right after a flush
+ */
+void
+GPXWriter::truncate()
+{
+#ifdef _WIN32
+	_chsize(_fileno(m_fd), ftell(m_fd));
+#else
+	if (ftruncate(fileno(m_fd), ftell(m_fd)) < 0) return;
+#endif
+}
+/* }}} */
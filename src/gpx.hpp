@@ -2,10 +2,13 @@
 
 #include <stdio.h>
 #include <time.h>
+#include "decode/common.hpp"
 
 /**
- * Wrapper around a GPX file. Will take care of terminating the file properly
- * every time, regardless of whether a track is currently being updated.
+ * Wrapper around a GPX file. Points are appended to the end of the file, and
+ * the closing tags are only written when a track is stopped, when the file is
+ * closed, and on checkpoint(). If the file is left unterminated (e.g. after a
+ * crash), it is repaired the next time it is opened.
  */
 
 class GPXWriter {
@@ -13,7 +16,17 @@ public:
 	GPXWriter() { m_fd = NULL; };
 	~GPXWriter() { deinit(); };
 
-	bool init(const char *fname);
+	/**
+	 * Open a GPX file. If the file already exists, new tracks are appended to
+	 * it, after closing any track that was left open.
+	 *
+	 * @param fname path to the file
+	 * @param resumeTrack if the last track in the file has this name, keep
+	 *        adding points to it instead of closing it. NULL to always start
+	 *        from a new track
+	 * @return true on success, false otherwise
+	 */
+	bool init(const char *fname, const char *resumeTrack = NULL);
 	void deinit();
 
 	/**
@@ -43,13 +56,36 @@ public:
 	 */
 	void addTrackPoint(time_t time, float lat, float lon, float alt, float spd, float hdg);
 
+	/**
+	 * Add the position of a frame to the current track, unless it is the
+	 * same as in the previous frame (see SondeFullData::changed).
+	 *
+	 * @param data frame to log
+	 */
+	void addPoint(const SondeFullData *data);
+
+	/**
+	 * Commit buffered points to disk
+	 */
+	void flush();
+
+	/**
+	 * Write the closing tags and flush, so that the file on disk is a valid
+	 * GPX document. The tags are overwritten by the next point.
+	 */
+	void checkpoint();
+
 private:
-	void terminateFile();
-	void stopTrackInternal();
+	bool recover(const char *resumeTrack);
+	void append(const char *data, size_t len);
+	void truncate();
+
 	FILE *m_fd;
-	unsigned long m_offset;
+	long m_offset;          /* Where the closing tags start, if m_terminated */
+	bool m_terminated;
 	bool m_trackActive;
 	char sondeSerial[64];
+	char m_buf[512];
 
 	float m_lat, m_lon, m_alt;
 	time_t m_time;
@@ -0,0 +1,141 @@
+#include <string.h>
+#include "gpxtracks.hpp"
+
+bool
+GPXTrackSet::init(const char *fname, int maxOpen)
+{
+	const char *dot, *sep;
+
+	if (m_active) deinit();
+
+	/* Split the path around the extension, to insert the serial number in between */
+	dot = strrchr(fname, '.');
+	sep = strpbrk(dot ? dot : fname, "/\\");
+	if (dot && !sep) {
+		m_prefix = std::string(fname, dot - fname);
+		m_suffix = dot;
+	} else {
+		m_prefix = fname;
+		m_suffix = ".gpx";
+	}
+
+	m_maxOpen = maxOpen > 0 ? maxOpen : 1;
+	m_open = 0;
+	m_clock = 0;
+	m_lastTrack = NULL;
+	m_lastSerial.clear();
+	m_active = true;
+	return true;
+}
+
+void
+GPXTrackSet::deinit()
+{
+	if (!m_active) return;
+	stopTracks();
+	m_active = false;
+}
+
+void
+GPXTrackSet::addTrackPoint(const char *serial, time_t time, float lat, float lon, float alt, float spd, float hdg)
+{
+	GPXWriter *writer;
+
+	if (!m_active || !serial[0]) return;
+
+	/* Consecutive points usually belong to the same sonde, skip the lookup */
+	if (m_lastTrack && m_lastSerial == serial) {
+		writer = m_lastTrack->writer.get();
+		m_lastTrack->lastUsed = ++m_clock;
+	} else {
+		writer = openTrack(serial);
+	}
+	if (!writer) return;
+
+	writer->addTrackPoint(time, lat, lon, alt, spd, hdg);
+}
+
+void
+GPXTrackSet::addPoint(const SondeFullData *data)
+{
+	if (!(data->changed & HAS_POS)) return;
+	addTrackPoint(data->serial, data->time, data->lat, data->lon, data->alt, data->spd, data->hdg);
+}
+
+void
+GPXTrackSet::stopTracks()
+{
+	for (auto &track : m_tracks) {
+		if (track.second.writer) track.second.writer->deinit();
+	}
+	m_tracks.clear();
+	m_open = 0;
+	m_lastTrack = NULL;
+	m_lastSerial.clear();
+}
+
+void
+GPXTrackSet::flush()
+{
+	for (auto &track : m_tracks) {
+		if (track.second.writer) track.second.writer->flush();
+	}
+}
+
+void
+GPXTrackSet::checkpoint()
+{
+	for (auto &track : m_tracks) {
+		if (track.second.writer) track.second.writer->checkpoint();
+	}
+}
+
+std::string
+GPXTrackSet::trackPath(const char *serial) const
+{
+	std::string path = m_prefix + "_";
+
+	/* Keep the serial number from messing with the path */
+	for (const char *ptr = serial; *ptr; ptr++) {
+		path += strchr("/\\:*?\"<>|", *ptr) ? '_' : *ptr;
+	}
+	return path + m_suffix;
+}
+
+/* Private methods {{{ */
+GPXWriter*
+GPXTrackSet::openTrack(const char *serial)
+{
+	Track &track = m_tracks[serial];
+	Track *oldest = NULL;
+
+	track.lastUsed = ++m_clock;
+
+	if (!track.writer) {
+		/* Make room by closing the least recently updated file */
+		if (m_open >= m_maxOpen) {
+			for (auto &other : m_tracks) {
+				if (!other.second.writer) continue;
+				if (!oldest || other.second.lastUsed < oldest->lastUsed) oldest = &other.second;
+			}
+			if (oldest) {
+				oldest->writer.reset();
+				m_open--;
+			}
+			m_lastTrack = NULL;
+		}
+
+		track.writer.reset(new GPXWriter());
+		if (!track.writer->init(trackPath(serial).c_str(), serial)) {
+			track.writer.reset();
+			return NULL;
+		}
+		track.writer->startTrack(serial);
+		m_open++;
+	}
+
+	m_lastSerial = serial;
+	m_lastTrack = &track;
+	return track.writer.get();
+}
+/* }}} */
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "gpx.hpp"
+
+/**
+ * Set of GPX tracks, one file per serial number. Points for different sondes
+ * can be interleaved freely, each one is appended to its own file without
+ * affecting the others.
+ *
+ * At most a fixed number of files is kept open at once: when a new sonde shows
+ * up and the limit has been reached, the least recently updated file is
+ * closed, and reopened if more points arrive for it later. Points logged
+ * after a file is reopened are added to the same track.
+ */
+class GPXTrackSet {
+public:
+	GPXTrackSet() { m_active = false; };
+	~GPXTrackSet() { deinit(); };
+
+	/**
+	 * Set up the track set.
+	 *
+	 * @param fname base path of the output files. The track for each serial
+	 *        number is written to this path, with the serial number appended
+	 *        to the file name (e.g. radiosonde.gpx -> radiosonde_S1234567.gpx)
+	 * @param maxOpen maximum number of files to keep open at once
+	 * @return true on success, false otherwise
+	 */
+	bool init(const char *fname, int maxOpen = 32);
+	void deinit();
+
+	/**
+	 * Add a point to the track for a serial number, starting a new one if needed.
+	 *
+	 * @param serial serial number of the sonde
+	 * @param time UTC time of the new point
+	 * @param lat latitude of the point, in degrees
+	 * @param lon longitude of the point, in degrees
+	 * @param alt altitude of the point, in meters
+	 * @param spd GPS speed, in meters per second
+	 * @param hdg heading, in degrees
+	 */
+	void addTrackPoint(const char *serial, time_t time, float lat, float lon, float alt, float spd, float hdg);
+
+	/**
+	 * Add the position of a frame to the track for its serial number, unless
+	 * it is the same as in the previous frame (see SondeFullData::changed).
+	 *
+	 * @param data frame to log
+	 */
+	void addPoint(const SondeFullData *data);
+
+	/**
+	 * Terminate all tracks, and close all files
+	 */
+	void stopTracks();
+
+	/**
+	 * Commit buffered points to disk
+	 */
+	void flush();
+
+	/**
+	 * Write the closing tags in all open files
+	 */
+	void checkpoint();
+
+	/**
+	 * Get the path of the file a serial number is logged to.
+	 *
+	 * @param serial serial number of the sonde
+	 * @return path to the GPX file
+	 */
+	std::string trackPath(const char *serial) const;
+
+private:
+	struct Track {
+		std::unique_ptr<GPXWriter> writer;
+		unsigned long lastUsed;
+	};
+
+	GPXWriter *openTrack(const char *serial);
+
+	bool m_active;
+	std::string m_prefix, m_suffix;
+	size_t m_maxOpen, m_open;
+	unsigned long m_clock;
+	std::unordered_map<std::string, Track> m_tracks;
+	std::string m_lastSerial;
+	Track *m_lastTrack;
+};
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <string.h>
+#include "history.hpp"
+#include "metrics.hpp"
+
+using namespace radiosonde;
+
+FlightHistory::FlightHistory()
+{
+	m_trackCount = 0;
+	m_capacity = 0;
+}
+
+void
+FlightHistory::init(int tracks, size_t capacity)
+{
+	/* One spare slot for the sample being written while a snapshot is taken */
+	m_tracks.reset(new Track[tracks]);
+	m_trackCount = tracks;
+	m_capacity = capacity + 1;
+
+	for (int i=0; i<tracks; i++) {
+		Track *track = &m_tracks[i];
+
+		track->busy.store(0);
+		track->generation.store(0);
+		track->count.store(0);
+		track->lastUpdate.store(0);
+		track->serial[0] = 0;
+		track->time.reset(new time_t[m_capacity]);
+		for (int j=0; j<FIELD_COUNT; j++) track->values[j].reset(new float[m_capacity]);
+	}
+}
+
+void
+FlightHistory::push(const SondeFullData &data)
+{
+	Track *track;
+	unsigned generation;
+
+	if (!data.serial[0] || !m_trackCount) return;
+
+	if ((track = find(data.serial, &generation))) {
+		if (track->busy.exchange(1, std::memory_order_acquire)) return;
+
+		/* Recycled for another sonde in the meantime */
+		if (track->generation.load(std::memory_order_relaxed) != generation) {
+			track->busy.store(0, std::memory_order_release);
+			return;
+		}
+	} else if (!(track = claim(data.serial))) {
+		return;
+	}
+
+	append(track, data);
+	track->busy.store(0, std::memory_order_release);
+}
+
+void
+FlightHistory::list(std::vector<std::string> &serials) const
+{
+	std::vector<std::pair<uint64_t, std::string>> tracks;
+	char serial[SERIAL_MAXLEN];
+
+	for (int i=0; i<m_trackCount; i++) {
+		const Track *track = &m_tracks[i];
+		const unsigned generation = track->generation.load(std::memory_order_acquire);
+		const uint64_t lastUpdate = track->lastUpdate.load(std::memory_order_relaxed);
+
+		if ((generation & 1) || !lastUpdate) continue;
+		memcpy(serial, track->serial, sizeof(serial));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (track->generation.load(std::memory_order_relaxed) != generation) continue;
+
+		serial[sizeof(serial)-1] = 0;
+		tracks.push_back(std::make_pair(lastUpdate, std::string(serial)));
+	}
+
+	std::sort(tracks.begin(), tracks.end(), [](const std::pair<uint64_t, std::string> &a, const std::pair<uint64_t, std::string> &b) {
+		return a.first > b.first;
+	});
+	serials.clear();
+	for (auto &track : tracks) serials.push_back(track.second);
+}
+
+bool
+FlightHistory::snapshot(const char *serial, Snapshot *out) const
+{
+	const Track *track;
+	unsigned generation;
+	uint64_t start, end, overwritten;
+	size_t count, first;
+
+	if (!(track = find(serial, &generation))) return false;
+
+	end = track->count.load(std::memory_order_acquire);
+	start = end >= m_capacity ? end - m_capacity + 1 : 0;
+	count = end - start;
+	first = start % m_capacity;
+
+	/* Copy the ring in chronological order, in at most two chunks */
+	out->time.resize(count);
+	for (int i=0; i<FIELD_COUNT; i++) out->values[i].resize(count);
+	for (size_t done = 0; done < count; ) {
+		const size_t idx = (first + done) % m_capacity;
+		const size_t chunk = std::min(count - done, m_capacity - idx);
+
+		memcpy(&out->time[done], &track->time[idx], chunk * sizeof(time_t));
+		for (int i=0; i<FIELD_COUNT; i++) memcpy(&out->values[i][done], &track->values[i][idx], chunk * sizeof(float));
+		done += chunk;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	if (track->generation.load(std::memory_order_relaxed) != generation) return false;
+
+	/* Drop the oldest samples if the writer lapped us while copying,
+	 * including the one it might be writing right now */
+	end = track->count.load(std::memory_order_relaxed) + 1;
+	overwritten = end > m_capacity ? end - m_capacity : 0;
+	if (overwritten > start) {
+		const size_t drop = std::min<uint64_t>(overwritten - start, count);
+		out->time.erase(out->time.begin(), out->time.begin() + drop);
+		for (int i=0; i<FIELD_COUNT; i++) out->values[i].erase(out->values[i].begin(), out->values[i].begin() + drop);
+	}
+
+	snprintf(out->serial, sizeof(out->serial), "%s", serial);
+	out->total = start + count;
+	return true;
+}
+
+uint64_t
+FlightHistory::total(const char *serial) const
+{
+	const Track *track;
+	unsigned generation;
+
+	if (!(track = find(serial, &generation))) return 0;
+	return track->count.load(std::memory_order_acquire);
+}
+
+void
+FlightHistory::decimate(const float *in, size_t count, size_t buckets, std::vector<float> &out)
+{
+	out.clear();
+	if (!buckets || count <= 2 * buckets) {
+		out.assign(in, in + count);
+		return;
+	}
+
+	for (size_t i=0; i<buckets; i++) {
+		const size_t begin = i * count / buckets;
+		const size_t end = (i + 1) * count / buckets;
+		size_t min = begin, max = begin;
+
+		for (size_t j=begin+1; j<end; j++) {
+			if (in[j] < in[min]) min = j;
+			if (in[j] > in[max]) max = j;
+		}
+		out.push_back(in[std::min(min, max)]);
+		out.push_back(in[std::max(min, max)]);
+	}
+}
+
+/* Private methods {{{ */
+FlightHistory::Track*
+FlightHistory::find(const char *serial, unsigned *generation) const
+{
+	for (int i=0; i<m_trackCount; i++) {
+		Track *track = &m_tracks[i];
+		const unsigned gen = track->generation.load(std::memory_order_acquire);
+
+		if ((gen & 1) || !track->lastUpdate.load(std::memory_order_relaxed)) continue;
+		if (strncmp(track->serial, serial, sizeof(track->serial))) continue;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (track->generation.load(std::memory_order_relaxed) != gen) continue;
+
+		*generation = gen;
+		return track;
+	}
+	return NULL;
+}
+
+/**
+ * Hand the least recently updated track over to a new sonde.
+ *
+ * @return the track, held by the calling thread, or NULL if it is busy
+ */
+FlightHistory::Track*
+FlightHistory::claim(const char *serial)
+{
+	Track *track = &m_tracks[0];
+	unsigned generation;
+
+	for (int i=1; i<m_trackCount; i++) {
+		if (m_tracks[i].lastUpdate.load(std::memory_order_relaxed) < track->lastUpdate.load(std::memory_order_relaxed)) {
+			track = &m_tracks[i];
+		}
+	}
+	if (track->busy.exchange(1, std::memory_order_acquire)) return NULL;
+
+	generation = track->generation.load(std::memory_order_relaxed);
+	track->generation.store(generation + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	snprintf(track->serial, sizeof(track->serial), "%s", serial);
+	track->count.store(0, std::memory_order_relaxed);
+	track->lastSeq = -1;
+	track->lastTime = 0;
+
+	track->generation.store(generation + 2, std::memory_order_release);
+	return track;
+}
+
+void
+FlightHistory::append(Track *track, const SondeFullData &data)
+{
+	uint64_t count = track->count.load(std::memory_order_relaxed);
+	size_t idx;
+
+	/* Decoders report each frame once, but the same frame can still come in
+	 * again from another channel receiving the same sonde: keep the first */
+	if (count && data.seq == track->lastSeq && data.time == track->lastTime) return;
+	track->lastSeq = data.seq;
+	track->lastTime = data.time;
+	idx = count % m_capacity;
+
+	track->time[idx] = data.time;
+	track->values[FIELD_ALT][idx] = data.alt;
+	track->values[FIELD_CLIMB][idx] = data.climb;
+	track->values[FIELD_TEMP][idx] = data.temp;
+	track->values[FIELD_RH][idx] = data.rh;
+	track->values[FIELD_PRESSURE][idx] = data.pressure;
+
+	track->count.store(count + 1, std::memory_order_release);
+	track->lastUpdate.store(nowNs(), std::memory_order_relaxed);
+}
+/* }}} */
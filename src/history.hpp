@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <time.h>
+#include <vector>
+#include "decode/common.hpp"
+
+namespace radiosonde {
+	/**
+	 * Recent history of the sondes being received, for plotting. Each sonde
+	 * gets a fixed-capacity ring buffer, stored as one array per quantity, with
+	 * one sample per frame: memory use is bounded no matter how long a flight
+	 * is, and once a ring is full the oldest samples are overwritten.
+	 *
+	 * push() never blocks nor allocates, and can be called from multiple
+	 * threads as long as each sonde is fed from a single thread at a time (as
+	 * is the case with one decoder per sonde). If a ring is contended, the
+	 * sample is dropped instead of waiting.
+	 */
+	class FlightHistory {
+	public:
+		enum Field {
+			FIELD_ALT = 0,          /* Altitude (m) */
+			FIELD_CLIMB,            /* Climb rate (m/s) */
+			FIELD_TEMP,             /* Temperature (degrees C) */
+			FIELD_RH,               /* Relative humidity (%) */
+			FIELD_PRESSURE,         /* Pressure (hPa) */
+			FIELD_COUNT
+		};
+
+		/* Consistent copy of a sonde's history, oldest sample first */
+		struct Snapshot {
+			Snapshot() { serial[0] = 0; total = 0; };
+
+			char serial[SERIAL_MAXLEN];
+			uint64_t total;             /* Samples received since the sonde was first seen */
+			std::vector<time_t> time;
+			std::vector<float> values[FIELD_COUNT];
+		};
+
+		FlightHistory();
+
+		/**
+		 * Allocate the ring buffers. Not thread-safe.
+		 *
+		 * @param tracks number of sondes to keep track of. When a new sonde shows
+		 *        up and all tracks are in use, the least recently updated one is
+		 *        recycled
+		 * @param capacity samples kept per sonde
+		 */
+		void init(int tracks, size_t capacity);
+
+		/**
+		 * Record a frame. Frames without a serial number, or repeating the
+		 * last one recorded for the sonde, are ignored.
+		 *
+		 * @param data decoded data
+		 */
+		void push(const SondeFullData &data);
+
+		/**
+		 * List the sondes with any history, most recently updated first.
+		 *
+		 * @param serials vector to fill with the serial numbers
+		 */
+		void list(std::vector<std::string> &serials) const;
+
+		/**
+		 * Copy the history of a sonde.
+		 *
+		 * @param serial serial number of the sonde
+		 * @param out where to store the copy. Its buffers are reused across calls
+		 * @return true on success, false if the sonde has no history
+		 */
+		bool snapshot(const char *serial, Snapshot *out) const;
+
+		/**
+		 * Number of samples recorded for a sonde, a cheap way to tell whether
+		 * a snapshot is out of date
+		 *
+		 * @param serial serial number of the sonde
+		 * @return samples received since the sonde was first seen, 0 if unknown
+		 */
+		uint64_t total(const char *serial) const;
+
+		/**
+		 * Reduce a series to at most 2 * buckets points, keeping the minimum
+		 * and maximum of each bucket (in the order they occur), so that peaks
+		 * survive decimation.
+		 *
+		 * @param in input series
+		 * @param count number of samples in the input
+		 * @param buckets number of buckets, usually the plot width in pixels
+		 * @param out decimated series
+		 */
+		static void decimate(const float *in, size_t count, size_t buckets, std::vector<float> &out);
+
+	private:
+		struct Track {
+			std::atomic<int> busy;              /* Held by the thread currently writing */
+			std::atomic<unsigned> generation;   /* Odd while the track is being handed to a new sonde */
+			std::atomic<uint64_t> count;        /* Samples written since the track was assigned */
+			std::atomic<uint64_t> lastUpdate;   /* Monotonic time of the last sample, 0 if unused */
+			char serial[SERIAL_MAXLEN];
+			int lastSeq;
+			time_t lastTime;
+
+			std::unique_ptr<time_t[]> time;
+			std::unique_ptr<float[]> values[FIELD_COUNT];
+		};
+
+		Track *find(const char *serial, unsigned *generation) const;
+		Track *claim(const char *serial);
+		void append(Track *track, const SondeFullData &data);
+
+		std::unique_ptr<Track[]> m_tracks;
+		int m_trackCount;
+		size_t m_capacity;
+	};
+}
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <core.h>
 #include <config.h>
+#include <float.h>
 #include <gui/gui.h>
 #include <gui/style.h>
 #include <imgui.h>
@@ -13,7 +15,21 @@
 
 #define SNAP_INTERVAL 1000
 #define UNCAL_COLOR IM_COL32(255,234,0,255)
+#define ERROR_COLOR IM_COL32(255,64,64,255)
 #define OUT_SAMPLE_RATE 48000
+#define WIDEBAND_SPACING 100e3  /* Enough for a 50kHz channel anywhere within the channelizer passband */
+#define SCAN_MIN_WIDTH 5e3      /* Narrower signals are carriers or spurs */
+#define SCAN_MAX_WIDTH 60e3     /* Wider signals are not radiosondes */
+#define OUTPUT_QUEUE_SIZE 1024
+#define GPX_CHECKPOINT_INTERVAL 30  /* Seconds between rewrites of the GPX closing tags */
+#define METRICS_INTERVAL 5000       /* Milliseconds between updates of the metrics file */
+#define STATS_INTERVAL 1000         /* Milliseconds between updates of the statistics in the menu */
+#define HISTORY_TRACKS 8            /* Sondes with a profile kept in memory */
+#define HISTORY_SIZE 16384          /* Frames of profile kept per sonde, about 4.5 hours at one per second */
+#define TYPE_SAVE_DELAY 2000        /* Milliseconds a type must stay selected before it is saved to config */
+#define DECODER_IDLE_TIMEOUT 300    /* Seconds a narrowband decoder is kept around after it was last used */
+#define AFC_GAIN 0.5                /* Share of the measured offset corrected after each frame */
+#define AFC_DEADBAND 250            /* Offsets below this are left alone (Hz) */
 
 SDRPP_MOD_INFO {
     /* Name:            */ "radiosonde_decoder",
@@ -24,17 +40,29 @@ SDRPP_MOD_INFO {
 };
 
 ConfigManager config;
+static radiosonde::FrameMerger frameMerger;    /* Shared by all the instances */
 
 RadiosondeDecoderModule::RadiosondeDecoderModule(std::string name)
 {
 	float bw;
 	bool created = false;
 	int typeToSelect;
-	std::string gpxPath, ptuPath;
+	std::string gpxPath, ptuPath, flightLogPath, metricsPath, netAddr, cpuList;
 
 	this->name = name;
+
+	/* Auto has to be wide enough for any of the types it may pick */
+	std::copy(radiosonde::sondeTypes, radiosonde::sondeTypes + SONDE_TYPES_COUNT, supportedTypes);
+	supportedTypes[SONDE_TYPES_COUNT] = {"auto", "Auto", 0, NULL, FRONTEND_TAPS};
+	for (int i=0; i<SONDE_TYPES_COUNT; i++) {
+		supportedTypes[SONDE_TYPES_COUNT].bandwidth = std::max(supportedTypes[SONDE_TYPES_COUNT].bandwidth, supportedTypes[i].bandwidth);
+	}
+
 	selectedType = -1;
 	activeDecoder = NULL;
+	signalOffset = signalDeviation = 0;
+	afcError = NAN;
+	afcPull = 0;
 
 	config.acquire();
 	if (!config.conf.contains(name)) {
@@ -43,71 +71,229 @@ RadiosondeDecoderModule::RadiosondeDecoderModule(std::string name)
 		config.conf[name]["sondeType"] = 0;
 		created = true;
 	}
+	if (!config.conf[name].contains("wideband")) {
+		config.conf[name]["wideband"] = false;
+		config.conf[name]["widebandSpan"] = 2000;
+		config.conf[name]["widebandThreads"] = 0;
+		config.conf[name]["widebandChannels"] = json::array();
+		created = true;
+	}
+	if (!config.conf[name].contains("widebandScan")) {
+		config.conf[name]["widebandScan"] = false;
+		config.conf[name]["scanThreshold"] = 10;
+		config.conf[name]["scanTimeout"] = 60;
+		config.conf[name]["scanType"] = SONDE_TYPES_COUNT;
+		created = true;
+	}
+	if (!config.conf[name].contains("nativeRate")) {
+		config.conf[name]["nativeRate"] = false;
+		created = true;
+	}
+	if (!config.conf[name].contains("gpxPerSerial")) {
+		config.conf[name]["gpxPerSerial"] = false;
+		created = true;
+	}
+	if (!config.conf[name].contains("flightLogPath")) {
+		config.conf[name]["flightLogPath"] = getTempFile("radiosonde.flt");
+		created = true;
+	}
+	if (!config.conf[name].contains("afc")) {
+		config.conf[name]["afc"] = false;
+		created = true;
+	}
+	if (!config.conf[name].contains("logMaxSize")) {
+		config.conf[name]["logMaxSize"] = 0;
+		config.conf[name]["logDaily"] = false;
+		config.conf[name]["logPerSerial"] = false;
+		config.conf[name]["logCompress"] = false;
+		created = true;
+	}
+	if (!config.conf[name].contains("flushInterval")) {
+		config.conf[name]["flushInterval"] = 1000;
+		config.conf[name]["flushSize"] = 32;
+		created = true;
+	}
+	if (!config.conf[name].contains("netAddress")) {
+		config.conf[name]["netAddress"] = "127.0.0.1:55672";
+		config.conf[name]["netTransport"] = NetWriter::TRANSPORT_UDP;
+		config.conf[name]["netFormat"] = NetWriter::FORMAT_JSON;
+		created = true;
+	}
+	if (!config.conf[name].contains("mergeOutput")) {
+		config.conf[name]["mergeOutput"] = false;
+		created = true;
+	}
+	if (!config.conf[name].contains("threadPriority")) {
+		config.conf[name]["threadPriority"] = 0;
+		config.conf[name]["demodCpu"] = -1;
+		config.conf[name]["resamplerCpu"] = -1;
+		config.conf[name]["decoderCpu"] = -1;
+		config.conf[name]["widebandCpus"] = "";
+		created = true;
+	}
+	if (!config.conf[name].contains("decoderBatch")) {
+		config.conf[name]["decoderBatch"] = 0;
+		config.conf[name]["decoderLatency"] = 0;
+		created = true;
+	}
+	if (!config.conf[name].contains("metricsPath")) {
+		config.conf[name]["metricsOutput"] = false;
+		config.conf[name]["metricsPath"] = getTempFile("radiosonde.prom");
+		created = true;
+	}
 	gpxPath = config.conf[name]["gpxPath"];
 	ptuPath = config.conf[name]["ptuPath"];
+	flightLogPath = config.conf[name]["flightLogPath"];
+	metricsPath = config.conf[name]["metricsPath"];
+	netAddr = config.conf[name]["netAddress"];
+	netTransport = config.conf[name]["netTransport"];
+	netFormat = config.conf[name]["netFormat"];
+	mergeOutput = config.conf[name]["mergeOutput"];
+	metricsOutput = config.conf[name]["metricsOutput"];
+	gpxPerSerial = config.conf[name]["gpxPerSerial"];
+	afc = config.conf[name]["afc"];
+	logSegments.maxSize = config.conf[name]["logMaxSize"];
+	logSegments.daily = config.conf[name]["logDaily"];
+	logSegments.perSerial = config.conf[name]["logPerSerial"];
+	logSegments.compress = config.conf[name]["logCompress"];
 	typeToSelect = config.conf[name]["sondeType"];
+	savedType = typeToSelect;
+	wideband = config.conf[name]["wideband"];
+	widebandSpan = config.conf[name]["widebandSpan"];
+	widebandThreads = config.conf[name]["widebandThreads"];
+	widebandScan = config.conf[name]["widebandScan"];
+	scanThreshold = config.conf[name]["scanThreshold"];
+	scanTimeout = config.conf[name]["scanTimeout"];
+	scanType = config.conf[name]["scanType"];
+	nativeRate = config.conf[name]["nativeRate"];
+	flushInterval = config.conf[name]["flushInterval"];
+	flushSize = config.conf[name]["flushSize"];
+	threadPriority = config.conf[name]["threadPriority"];
+	demodCpu = config.conf[name]["demodCpu"];
+	resamplerCpu = config.conf[name]["resamplerCpu"];
+	decoderCpu = config.conf[name]["decoderCpu"];
+	cpuList = config.conf[name]["widebandCpus"];
+	decoderBatch = config.conf[name]["decoderBatch"];
+	decoderLatency = config.conf[name]["decoderLatency"];
 	config.release(created);
 
+	if (scanType < 0 || scanType > SONDE_TYPES_COUNT) scanType = SONDE_TYPES_COUNT;
+
 	strncpy(gpxFilename, gpxPath.c_str(), sizeof(gpxFilename)-1);
 	strncpy(ptuFilename, ptuPath.c_str(), sizeof(ptuFilename)-1);
+	strncpy(flightLogFilename, flightLogPath.c_str(), sizeof(flightLogFilename)-1);
+	strncpy(metricsFilename, metricsPath.c_str(), sizeof(metricsFilename)-1);
+	strncpy(netAddress, netAddr.c_str(), sizeof(netAddress)-1);
+	strncpy(widebandCpus, cpuList.c_str(), sizeof(widebandCpus)-1);
+
+	outputWriter.init(OUTPUT_QUEUE_SIZE, flushInterval, flushSize, writeBatch, flushOutput, this);
+	history.init(HISTORY_TRACKS, HISTORY_SIZE);
+	mergeSource = mergeOutput ? frameMerger.addSource(mergedDataHandler, this) : -1;
+
+	widebandRx = NULL;
+	newChannelFreq = 403.0;
+	newChannelType = 0;
 
-	bw = std::get<1>(supportedTypes[typeToSelect]);
-	vfo = sigpath::vfoManager.createVFO(name, ImGui::WaterfallVFO::REF_CENTER, 0, bw, bw, bw, bw, true);
-	vfo->setSnapInterval(SNAP_INTERVAL);
-	fmDemod.init(vfo->output, bw, bw/2.0f, false);
-
-	/* Resampler to 48kHz */
-	resampler.init(&fmDemod.out, bw, OUT_SAMPLE_RATE);
-
-	dfm09decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	c50decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	imet4decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	ims100decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	m10decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	mrzn1decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-	rs41decoder.init(&resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, this);
-
-	fmDemod.start();
-	resampler.start();
-	onTypeSelected(this, typeToSelect);
+	bw = supportedTypes[typeToSelect].bandwidth;
+	if (wideband) {
+		/* Narrowband path is wired in when switching out of wideband mode */
+		vfo = NULL;
+		fmDemod.init(NULL, bw, bw/2.0f);
+	} else {
+		vfo = sigpath::vfoManager.createVFO(name, ImGui::WaterfallVFO::REF_CENTER, 0, bw, bw, bw, bw, true);
+		vfo->setSnapInterval(SNAP_INTERVAL);
+		fmDemod.init(vfo->output, bw, bw/2.0f);
+	}
+	channelBw = resamplerBw = bw;
+
+	/* Resampler to 48kHz, or decimator to the native decoder samplerate */
+	resampler.init(&fmDemod.out, bw, OUT_SAMPLE_RATE, supportedTypes[typeToSelect].resamplerTaps);
+	nativeDecimator.init(&fmDemod.out, 1);
+
+	/* Decoders themselves are only created when their type is selected */
+	lockedType = -1;
+	for (int i=0; i<SONDE_TYPES_COUNT; i++) {
+		decoderCtx[i].module = this;
+		decoderCtx[i].type = i;
+	}
+
+	/* Auto-detect front end: the resampler output is shared by all the
+	 * decoders, each one behind a low-pass filter matched to its bandwidth */
+	autoBroadcast.init(&resampler.out);
+	for (int i=0; i<SONDE_TYPES_COUNT; i++) {
+		const float cutoff = supportedTypes[i].bandwidth / 2.0f;
+
+		autoFiltered[i] = cutoff < OUT_SAMPLE_RATE / 2.0f;
+		if (!autoFiltered[i]) continue;
+
+		autoTaps[i] = dsp::taps::lowPass(cutoff, cutoff / 2.0f, OUT_SAMPLE_RATE);
+		autoFilters[i].init(&autoReaders[i], autoTaps[i]);
+	}
+
+	/* Applied by each block when it starts */
+	applySchedules(this);
+	applyBatching(this);
+
+	if (wideband) {
+		selectedType = typeToSelect;
+		startWideband(this);
+	} else {
+		onTypeSelected(this, typeToSelect);
+	}
 	enabled = true;
 
+	if (metricsOutput) metricsExporter.init(metricsFilename, METRICS_INTERVAL, collectMetrics, this);
+
 	gui::menu.registerEntry(name, menuHandler, this, this);
 }
 
 RadiosondeDecoderModule::~RadiosondeDecoderModule()
 {
+	metricsExporter.deinit();
+	saveSelectedType(this, true);
 	if (isEnabled()) disable();
+	for (auto &decoder : decoders) decoder.reset();     /* Before the streams they read from */
+	if (mergeSource >= 0) {
+		frameMerger.removeSource(mergeSource);
+		mergeSource = -1;
+	}
 	if (vfo) {
 		sigpath::vfoManager.deleteVFO(vfo);
 		vfo = NULL;
 	}
+	for (int i=0; i<SONDE_TYPES_COUNT; i++) {
+		if (autoFiltered[i]) dsp::taps::free(autoTaps[i]);
+	}
+	outputWriter.deinit();
 	gui::menu.removeEntry(name);
 }
 
 void
 RadiosondeDecoderModule::enable() {
-	/* Make a new VFO, wire it into the DSP path, then start the appropriate decoder */
-	onTypeSelected(this, selectedType);
-
-	fmDemod.start();
-	resampler.start();
+	if (wideband) {
+		startWideband(this);
+	} else {
+		startNarrowband(this);
+	}
 	enabled = true;
 }
 
 void
 RadiosondeDecoderModule::disable() {
-	if (activeDecoder) activeDecoder->stop();
-	activeDecoder = NULL;
-
-	fmDemod.stop();
-	resampler.stop();
-
-	if (vfo) sigpath::vfoManager.deleteVFO(vfo);
-	vfo = NULL;
+	if (wideband) {
+		stopWideband(this);
+	} else {
+		stopNarrowband(this);
+	}
 
+	/* Let the writer catch up before closing the track */
+	outputWriter.sync();
+	writerMtx.lock();
 	gpxWriter.stopTrack();
-	lastData.init();
+	gpxTracks.stopTracks();
+	writerMtx.unlock();
+
+	lastData.store(SondeFullData());
 	enabled = false;
 }
 
@@ -128,36 +314,70 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 	const ImVec2 wh = ImGui::GetContentRegionAvail();
 	const float width = wh.x;
 	char time[64];
-	bool gpxStatusChanged, ptuStatusChanged;
+	char typeName[64];
+	char auxText[64];
+	bool gpxStatusChanged, ptuStatusChanged, flightLogStatusChanged, netStatusChanged, metricsStatusChanged, segmentsChanged;
+	SondeFullData data;
+
+	/* Auto-detect found a decoder producing valid frames: spin down the others */
+	if (_this->autoDetect && !_this->autoLocked && _this->lockedType >= 0) {
+		stopAutoDetect(ctx, _this->lockedType);
+	}
+	saveSelectedType(ctx, false);
+	releaseIdleDecoders(ctx);
+	applyAfc(ctx);
 
 	if (!_this->enabled) style::beginDisabled();
 
+	/* Wideband mode toggle {{{ */
+	if (ImGui::Checkbox(CONCAT("Wideband##_radiosonde_wideband_", _this->name), &_this->wideband)) {
+		onWidebandChanged(ctx);
+	}
+	if (ImGui::Checkbox(CONCAT("Native samplerate##_radiosonde_native_", _this->name), &_this->nativeRate)) {
+		onNativeRateChanged(ctx);
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Feed decoders at the channel bandwidth instead of resampling to 48kHz.\nAuto-detect always runs at 48kHz.");
+	}
+	/* }}} */
 	/* Type combobox {{{ */
-	ImGui::LeftLabel("Type");
-	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
-	if (ImGui::BeginCombo(CONCAT("##_radiosonde_type_", _this->name), std::get<0>(_this->supportedTypes[_this->selectedType]))) {
-		for (int i=0; i<IM_ARRAYSIZE(_this->supportedTypes); i++) {
-			const char *curItem = std::get<0>(_this->supportedTypes[i]);
-			bool selected = _this->selectedType == i;
+	if (_this->wideband) {
+		widebandMenu(ctx);
+	} else {
+		if (_this->autoDetect && _this->lockedType >= 0) {
+			snprintf(typeName, sizeof(typeName), "%s (%s)",
+			         _this->supportedTypes[_this->selectedType].name,
+			         _this->supportedTypes[_this->lockedType].name);
+		} else {
+			snprintf(typeName, sizeof(typeName), "%s", _this->supportedTypes[_this->selectedType].name);
+		}
+		ImGui::LeftLabel("Type");
+		ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+		if (ImGui::BeginCombo(CONCAT("##_radiosonde_type_", _this->name), typeName)) {
+			for (int i=0; i<IM_ARRAYSIZE(_this->supportedTypes); i++) {
+				const char *curItem = _this->supportedTypes[i].name;
+				bool selected = _this->selectedType == i;
 
-			if (ImGui::Selectable(curItem, selected)) {
-				onTypeSelected(ctx, i);
-			}
-			if (selected) {
-				ImGui::SetItemDefaultFocus();
+				if (ImGui::Selectable(curItem, selected)) {
+					onTypeSelected(ctx, i);
+				}
+				if (selected) {
+					ImGui::SetItemDefaultFocus();
+				}
 			}
+			ImGui::EndCombo();
 		}
-		ImGui::EndCombo();
 	}
 	/* }}} */
 	/* Sonde data display {{{ */
+	_this->lastData.load(data);
 	ImGui::SetNextItemWidth(width);
-	if (ImGui::BeginTable(CONCAT("##radiosonde_data_", _this->name), 2, ImGuiTableFlags_SizingFixedFit)) {
+	if (!_this->wideband && ImGui::BeginTable(CONCAT("##radiosonde_data_", _this->name), 2, ImGuiTableFlags_SizingFixedFit)) {
 		ImGui::TableNextColumn();
 		ImGui::Text("Serial no.");
 		if (_this->enabled) {
 			ImGui::TableNextColumn();
-			ImGui::Text("%s", _this->lastData.serial.c_str());
+			ImGui::Text("%s", data.serial);
 		}
 
 		ImGui::TableNextRow();
@@ -165,14 +385,14 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 		ImGui::Text("Frame no.");
 		if (_this->enabled) {
 			ImGui::TableNextColumn();
-			ImGui::Text("%d", _this->lastData.seq);
+			ImGui::Text("%d", data.seq);
 		}
 
 		ImGui::TableNextRow();
 		ImGui::TableNextColumn();
 		ImGui::Text("Onboard time");
 		if (_this->enabled) {
-			if (strftime(time, sizeof(time), "%a %b %d %Y %H:%M:%S", gmtime(&_this->lastData.time))) {
+			if (strftime(time, sizeof(time), "%a %b %d %Y %H:%M:%S", gmtime(&data.time))) {
 				ImGui::TableNextColumn();
 				ImGui::Text("%s", time);
 			}
@@ -187,7 +407,7 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 		ImGui::Text("Latitude");
 		if (_this->enabled) {
 			ImGui::TableNextColumn();
-			ImGui::Text("%8.5f%c", fabs(_this->lastData.lat), (_this->lastData.lat >= 0 ? 'N' : 'S'));
+			ImGui::Text("%8.5f%c", fabs(data.lat), (data.lat >= 0 ? 'N' : 'S'));
 		}
 
 		ImGui::TableNextRow();
@@ -195,7 +415,7 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 		ImGui::Text("Longitude");
 		if (_this->enabled) {
 			ImGui::TableNextColumn();
-			ImGui::Text("%8.5f%c", fabs(_this->lastData.lon), (_this->lastData.lon >= 0 ? 'E' : 'W'));
+			ImGui::Text("%8.5f%c", fabs(data.lon), (data.lon >= 0 ? 'E' : 'W'));
 		}
 
 		ImGui::TableNextRow();
@@ -203,7 +423,7 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 		ImGui::Text("Altitude");
 		if (_this->enabled) {
 			ImGui::TableNextColumn();
-			ImGui::Text("%.1fm", _this->lastData.alt);
+			ImGui::Text("%.1fm", data.alt);
 		}
 
 		ImGui::TableNextRow();
@@ -211,7 +431,7 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 		ImGui::Text("Speed");
 		if (_this->enabled) {
 			ImGui::TableNextColumn();
-			ImGui::Text("%.1fm/s", _this->lastData.spd);
+			ImGui::Text("%.1fm/s", data.spd);
 		}
 
 		ImGui::TableNextRow();
@@ -219,7 +439,7 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 		ImGui::Text("Heading");
 		if (_this->enabled) {
 			ImGui::TableNextColumn();
-			ImGui::Text("%.0f°", _this->lastData.hdg);
+			ImGui::Text("%.0f°", data.hdg);
 		}
 
 		ImGui::TableNextRow();
@@ -227,7 +447,7 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 		ImGui::Text("Climb");
 		if (_this->enabled) {
 			ImGui::TableNextColumn();
-			ImGui::Text("%.1fm/s", _this->lastData.climb);
+			ImGui::Text("%.1fm/s", data.climb);
 		}
 
 		ImGui::TableNextRow();
@@ -239,11 +459,11 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 		ImGui::Text("Temperature");
 		if (_this->enabled) {
 			ImGui::TableNextColumn();
-			if (!_this->lastData.calibrated) ImGui::PushStyleColor(ImGuiCol_Text, UNCAL_COLOR);
-			ImGui::Text("%.1f°C", _this->lastData.temp);
-			if (!_this->lastData.calibrated) ImGui::PopStyleColor();
-			if (!_this->lastData.calibrated && ImGui::IsItemHovered()) {
-				ImGui::SetTooltip("Calibration data not yet complete (%.0f%%).", _this->lastData.calib_percent);
+			if (!data.calibrated) ImGui::PushStyleColor(ImGuiCol_Text, UNCAL_COLOR);
+			ImGui::Text("%.1f°C", data.temp);
+			if (!data.calibrated) ImGui::PopStyleColor();
+			if (!data.calibrated && ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("Calibration data not yet complete (%.0f%%).", data.calib_percent);
 			}
 		}
 
@@ -252,11 +472,11 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 		ImGui::Text("Humidity");
 		if (_this->enabled) {
 			ImGui::TableNextColumn();
-			if (!_this->lastData.calibrated) ImGui::PushStyleColor(ImGuiCol_Text, UNCAL_COLOR);
-			ImGui::Text("%.1f%%", _this->lastData.rh);
-			if (!_this->lastData.calibrated) ImGui::PopStyleColor();
-			if (!_this->lastData.calibrated && ImGui::IsItemHovered()) {
-				ImGui::SetTooltip("Calibration data not yet complete (%.0f%%).", _this->lastData.calib_percent);
+			if (!data.calibrated) ImGui::PushStyleColor(ImGuiCol_Text, UNCAL_COLOR);
+			ImGui::Text("%.1f%%", data.rh);
+			if (!data.calibrated) ImGui::PopStyleColor();
+			if (!data.calibrated && ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("Calibration data not yet complete (%.0f%%).", data.calib_percent);
 			}
 		}
 
@@ -265,11 +485,11 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 		ImGui::Text("Dew point");
 		if (_this->enabled) {
 			ImGui::TableNextColumn();
-			if (!_this->lastData.calibrated) ImGui::PushStyleColor(ImGuiCol_Text, UNCAL_COLOR);
-			ImGui::Text("%.1f°C", _this->lastData.dewpt);
-			if (!_this->lastData.calibrated) ImGui::PopStyleColor();
-			if (!_this->lastData.calibrated && ImGui::IsItemHovered()) {
-				ImGui::SetTooltip("Calibration data not yet complete (%.0f%%).", _this->lastData.calib_percent);
+			if (!data.calibrated) ImGui::PushStyleColor(ImGuiCol_Text, UNCAL_COLOR);
+			ImGui::Text("%.1f°C", data.dewpt);
+			if (!data.calibrated) ImGui::PopStyleColor();
+			if (!data.calibrated && ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("Calibration data not yet complete (%.0f%%).", data.calib_percent);
 			}
 		}
 
@@ -278,11 +498,11 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 		ImGui::Text("Pressure");
 		if (_this->enabled) {
 			ImGui::TableNextColumn();
-			if (!_this->lastData.calibrated) ImGui::PushStyleColor(ImGuiCol_Text, UNCAL_COLOR);
-			ImGui::Text("%.1fhPa", _this->lastData.pressure);
-			if (!_this->lastData.calibrated) ImGui::PopStyleColor();
-			if (!_this->lastData.calibrated && ImGui::IsItemHovered()) {
-				ImGui::SetTooltip("Calibration data not yet complete (%.0f%%).", _this->lastData.calib_percent);
+			if (!data.calibrated) ImGui::PushStyleColor(ImGuiCol_Text, UNCAL_COLOR);
+			ImGui::Text("%.1fhPa", data.pressure);
+			if (!data.calibrated) ImGui::PopStyleColor();
+			if (!data.calibrated && ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("Calibration data not yet complete (%.0f%%).", data.calib_percent);
 			}
 		}
 
@@ -291,11 +511,51 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 		ImGui::Text("Aux. data");
 		if (_this->enabled) {
 			ImGui::TableNextColumn();
-			ImGui::Text("%s", _this->lastData.auxData.c_str());
+			formatAuxData(&data.aux, auxText, sizeof(auxText));
+			ImGui::Text("%s", auxText);
+		}
+
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGui::Text(" ");
+
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGui::Text("Freq. offset");
+		if (_this->enabled) {
+			ImGui::TableNextColumn();
+			ImGui::Text("%+.2fkHz", _this->signalOffset * 1e-3);
+		}
+
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGui::Text("Deviation");
+		if (_this->enabled) {
+			ImGui::TableNextColumn();
+			ImGui::Text("%.2fkHz", _this->signalDeviation * 1e-3);
+		}
+
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGui::Text("Bad fragments");
+		if (_this->enabled) {
+			ImGui::TableNextColumn();
+			ImGui::Text("%d", data.quality.badFragments);
 		}
 
 		ImGui::EndTable();
 	}
+	if (!_this->wideband) {
+		if (ImGui::Checkbox(CONCAT("Automatic frequency control##_radiosonde_afc_", _this->name), &_this->afc)) {
+			_this->afcPull = 0;
+			config.acquire();
+			config.conf[_this->name]["afc"] = _this->afc;
+			config.release(true);
+		}
+		if (ImGui::IsItemHovered()) {
+			ImGui::SetTooltip("Retune the VFO after each frame to follow a drifting sonde, up to half a channel away.\nFreq. offset: carrier offset from the VFO, measured on the demodulated signal.\nBad fragments: data that failed to decode during the last frame.");
+		}
+	}
 	/* }}} */
 	/* GPX output file {{{ */
 	gpxStatusChanged = ImGui::Checkbox(CONCAT("GPX track##_gpx_track_", _this->name), &_this->gpxOutput);
@@ -303,6 +563,15 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
 	gpxStatusChanged |= ImGui::InputText(CONCAT("##_gpx_fname_", _this->name), _this->gpxFilename, sizeof(gpxFilename)-1,
 	                                     ImGuiInputTextFlags_EnterReturnsTrue);
+	if (ImGui::Checkbox(CONCAT("One file per sonde##_gpx_per_serial_", _this->name), &_this->gpxPerSerial)) {
+		config.acquire();
+		config.conf[_this->name]["gpxPerSerial"] = _this->gpxPerSerial;
+		config.release(true);
+		gpxStatusChanged = true;
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Write each sonde to its own file, named after its serial number.\nRecommended when decoding multiple sondes at once.");
+	}
 	if (gpxStatusChanged) onGPXOutputChanged(ctx);
 	/* }}} */
 	/* Log output file {{{ */
@@ -313,32 +582,246 @@ RadiosondeDecoderModule::menuHandler(void *ctx)
 	                                     ImGuiInputTextFlags_EnterReturnsTrue);
 	if (ptuStatusChanged) onPTUOutputChanged(ctx);
 	/* }}} */
+	/* Binary log output file {{{ */
+	flightLogStatusChanged = ImGui::Checkbox(CONCAT("Binary log##_flt_log_", _this->name), &_this->flightLogOutput);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	flightLogStatusChanged |= ImGui::InputText(CONCAT("##_flt_fname_", _this->name), _this->flightLogFilename, sizeof(flightLogFilename)-1,
+	                                           ImGuiInputTextFlags_EnterReturnsTrue);
+	if (flightLogStatusChanged) onFlightLogOutputChanged(ctx);
+	/* }}} */
+	/* Log segments {{{ */
+	segmentsChanged = ImGui::Checkbox(CONCAT("Split per sonde##_log_per_serial_", _this->name), &_this->logSegments.perSerial);
+	ImGui::SameLine();
+	segmentsChanged |= ImGui::Checkbox(CONCAT("Daily##_log_daily_", _this->name), &_this->logSegments.daily);
+	if (radiosonde::SegmentedFile::compressionSupported()) {
+		ImGui::SameLine();
+		segmentsChanged |= ImGui::Checkbox(CONCAT("gzip##_log_compress_", _this->name), &_this->logSegments.compress);
+	}
+	ImGui::LeftLabel("Max log size (MB)");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	segmentsChanged |= ImGui::InputInt(CONCAT("##_log_max_size_", _this->name), &_this->logSegments.maxSize, 1, 100,
+	                                   ImGuiInputTextFlags_EnterReturnsTrue);
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Split the CSV and binary logs into timestamped files next to them, 0 for no size limit.\nThe files are listed by time range in <log>.idx as they are closed.");
+	}
+	if (segmentsChanged) onLogSegmentsChanged(ctx);
+	/* }}} */
+	/* Network output {{{ */
+	netStatusChanged = ImGui::Checkbox(CONCAT("Network##_net_out_", _this->name), &_this->netOutput);
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("UDP: send every frame to host:port (unicast, broadcast or multicast).\nTCP: listen on [host:]port, and stream every frame to the connected clients.");
+	}
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	netStatusChanged |= ImGui::InputText(CONCAT("##_net_addr_", _this->name), _this->netAddress, sizeof(netAddress)-1,
+	                                     ImGuiInputTextFlags_EnterReturnsTrue);
+	ImGui::SetNextItemWidth(width / 2);
+	netStatusChanged |= ImGui::Combo(CONCAT("##_net_transport_", _this->name), &_this->netTransport, "UDP\0TCP server\0");
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	netStatusChanged |= ImGui::Combo(CONCAT("##_net_format_", _this->name), &_this->netFormat, "JSON (Horus UDP)\0Binary\0");
+	if (netStatusChanged) onNetOutputChanged(ctx);
+	/* }}} */
+	/* Merging with other instances {{{ */
+	if (ImGui::Checkbox(CONCAT("Merge with other instances##_radiosonde_merge_", _this->name), &_this->mergeOutput)) {
+		onMergeOutputChanged(ctx);
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Combine the frames decoded by all the instances with this option enabled\n(e.g. one per antenna), filling in missing fields and writing each frame once.\nEach sonde is written to the outputs of the first instance that received it.");
+	}
+	if (_this->mergeOutput) {
+		ImGui::Text("%llu fragments merged, %llu duplicates dropped",
+		            (unsigned long long)frameMerger.merged(), (unsigned long long)frameMerger.duplicates());
+	}
+	/* }}} */
+	/* Output flushing {{{ */
+	ImGui::LeftLabel("Flush every (ms)");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	if (ImGui::InputInt(CONCAT("##_radiosonde_flush_ms_", _this->name), &_this->flushInterval, 100, 1000,
+	                    ImGuiInputTextFlags_EnterReturnsTrue)) {
+		if (_this->flushInterval < 1) _this->flushInterval = 1;
+		_this->outputWriter.setFlushPolicy(_this->flushInterval, _this->flushSize);
+		config.acquire();
+		config.conf[_this->name]["flushInterval"] = _this->flushInterval;
+		config.release(true);
+	}
+	ImGui::LeftLabel("Flush every (frames)");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	if (ImGui::InputInt(CONCAT("##_radiosonde_flush_n_", _this->name), &_this->flushSize, 1, 10,
+	                    ImGuiInputTextFlags_EnterReturnsTrue)) {
+		if (_this->flushSize < 1) _this->flushSize = 1;
+		_this->outputWriter.setFlushPolicy(_this->flushInterval, _this->flushSize);
+		config.acquire();
+		config.conf[_this->name]["flushSize"] = _this->flushSize;
+		config.release(true);
+	}
+	ImGui::Text("Queue: %zu/%zu (peak %zu), %llu dropped",
+	            _this->outputWriter.depth(), _this->outputWriter.capacity(), _this->outputWriter.maxDepth(),
+	            (unsigned long long)_this->outputWriter.dropped());
+	/* }}} */
+	/* Metrics output file {{{ */
+	metricsStatusChanged = ImGui::Checkbox(CONCAT("Metrics##_metrics_", _this->name), &_this->metricsOutput);
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Periodically write the statistics below to a file,\nin the Prometheus text format (e.g. for the node_exporter textfile collector).");
+	}
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	metricsStatusChanged |= ImGui::InputText(CONCAT("##_metrics_fname_", _this->name), _this->metricsFilename, sizeof(metricsFilename)-1,
+	                                         ImGuiInputTextFlags_EnterReturnsTrue);
+	if (metricsStatusChanged) onMetricsOutputChanged(ctx);
+	/* }}} */
+	/* Profile plots {{{ */
+	if (ImGui::CollapsingHeader(CONCAT("Profile##_radiosonde_profile_", _this->name))) {
+		profileMenu(ctx);
+	}
+	/* }}} */
+	/* Statistics {{{ */
+	if (ImGui::CollapsingHeader(CONCAT("Statistics##_radiosonde_stats_", _this->name))) {
+		statsMenu(ctx);
+	}
+	/* }}} */
+	/* Thread scheduling {{{ */
+	if (ImGui::CollapsingHeader(CONCAT("Threads##_radiosonde_threads_", _this->name))) {
+		threadsMenu(ctx);
+	}
+	/* }}} */
 
 	if (!_this->enabled) style::endDisabled();
 }
 
 void
 RadiosondeDecoderModule::sondeDataHandler(SondeFullData *data, void *ctx)
+{
+	DecoderContext *decoderCtx = (DecoderContext*)ctx;
+	RadiosondeDecoderModule *_this = decoderCtx->module;
+	int unlocked = -1;
+
+	/* When auto-detecting, lock onto the first decoder to output a valid frame,
+	 * and discard whatever the other decoders produce */
+	if (_this->autoDetect) {
+		if (!data->serial[0]) return;
+		if (!_this->lockedType.compare_exchange_strong(unlocked, decoderCtx->type) && unlocked != decoderCtx->type) return;
+	}
+
+	/* fmDemod is set up for a bandwidth of channelBw/2, which maps an offset
+	 * of channelBw/4 to 1 */
+	_this->signalOffset = data->quality.offset * _this->channelBw / 4;
+	_this->signalDeviation = data->quality.deviation * _this->channelBw / 4;
+	_this->afcError = _this->signalOffset.load();
+
+	_this->lastData.store(*data);
+	writeData(_this, data);
+}
+
+void
+RadiosondeDecoderModule::widebandDataHandler(SondeFullData *data, void *ctx)
+{
+	/* Per-channel data is kept by the receiver, just log it */
+	writeData(ctx, data);
+}
+
+void
+RadiosondeDecoderModule::widebandSignalHandler(double frequency, float width, void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	int type = _this->scanType;
+
+	/* Guess the type from the occupied bandwidth: pick the narrowest type the
+	 * signal fits in, or the widest one if it does not fit anywhere */
+	if (type == SONDE_TYPES_COUNT) {
+		type = -1;
+		for (int i=0; i<SONDE_TYPES_COUNT; i++) {
+			const float bw = _this->supportedTypes[i].bandwidth;
+			if (bw >= width && (type < 0 || bw < _this->supportedTypes[type].bandwidth)) type = i;
+		}
+		for (int i=0; type < 0 && i<SONDE_TYPES_COUNT; i++) {
+			if (_this->supportedTypes[i].bandwidth == _this->supportedTypes[SONDE_TYPES_COUNT].bandwidth) type = i;
+		}
+	}
+
+	_this->widebandRx->addChannel(frequency, _this->supportedTypes[type].bandwidth, _this->supportedTypes[type].create(),
+	                              type, _this->scanTimeout);
+}
+
+void
+RadiosondeDecoderModule::writeData(void *ctx, SondeFullData *data)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	/* Might be called from multiple threads in wideband mode. File I/O happens
+	 * on the writer thread, so that slow storage does not stall the DSP path.
+	 * When merging, frames come back through mergedDataHandler() */
+	const int mergeSource = _this->mergeSource;
+	if (mergeSource >= 0 && data->serial[0]) {
+		frameMerger.push(*data, mergeSource);
+	} else {
+		_this->outputWriter.push(*data);
+	}
+	_this->history.push(*data);
+}
+
+void
+RadiosondeDecoderModule::writeBatch(const SondeFullData *data, int count, void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	std::lock_guard<std::mutex> lck(_this->writerMtx);
+
+	for (int i=0; i<count; i++) {
+		if (_this->gpxPerSerial) {
+			_this->gpxTracks.addPoint(&data[i]);
+		} else {
+			if (data[i].serial[0]) {
+				_this->gpxWriter.startTrack(data[i].serial);
+			}
+			_this->gpxWriter.addPoint(&data[i]);
+		}
+		_this->ptuWriter.addPoint(&data[i]);
+		_this->flightLogWriter.addPoint(&data[i]);
+		_this->netWriter.addPoint(&data[i]);
+	}
+
+	/* Frames are pushed out as soon as they are written, not on flush */
+	_this->netWriter.flush();
+}
+
+void
+RadiosondeDecoderModule::flushOutput(void *ctx)
 {
 	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
-	_this->lastData = *data;
+	std::lock_guard<std::mutex> lck(_this->writerMtx);
+	const time_t now = time(NULL);
 
-	if (data->serial != "") {
-		_this->gpxWriter.startTrack(data->serial.c_str());
+	/* Only terminate the GPX file once in a while, it can be repaired when
+	 * it is opened again if we crash in between */
+	if (now - _this->lastCheckpoint >= GPX_CHECKPOINT_INTERVAL) {
+		_this->gpxWriter.checkpoint();
+		_this->gpxTracks.checkpoint();
+		_this->lastCheckpoint = now;
+	} else {
+		_this->gpxWriter.flush();
+		_this->gpxTracks.flush();
 	}
-	_this->gpxWriter.addTrackPoint(data->time, data->lat, data->lon, data->alt, data->spd, data->hdg);
-	_this->ptuWriter.addPoint(data);
+	_this->ptuWriter.flush();
+	_this->flightLogWriter.flush();
+	_this->netWriter.flush();
 }
 
 void
 RadiosondeDecoderModule::onGPXOutputChanged(void *ctx)
 {
 	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	_this->writerMtx.lock();
+	_this->gpxWriter.deinit();
+	_this->gpxTracks.deinit();
 	if (_this->gpxOutput) {
-		_this->gpxOutput = _this->gpxWriter.init(_this->gpxFilename);
-	} else {
-		_this->gpxWriter.deinit();
+		if (_this->gpxPerSerial) {
+			_this->gpxOutput = _this->gpxTracks.init(_this->gpxFilename);
+		} else {
+			_this->gpxOutput = _this->gpxWriter.init(_this->gpxFilename);
+		}
 	}
+	_this->writerMtx.unlock();
 
 	if (_this->gpxOutput) {
 		config.acquire();
@@ -351,11 +834,13 @@ void
 RadiosondeDecoderModule::onPTUOutputChanged(void *ctx)
 {
 	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	_this->writerMtx.lock();
 	if (_this->ptuOutput) {
-		_this->ptuOutput = _this->ptuWriter.init(_this->ptuFilename);
+		_this->ptuOutput = _this->ptuWriter.init(_this->ptuFilename, _this->logSegments);
 	} else {
 		_this->ptuWriter.deinit();
 	}
+	_this->writerMtx.unlock();
 	if (_this->ptuOutput) {
 		config.acquire();
 		config.conf[_this->name]["ptuPath"] = _this->ptuFilename;
@@ -364,44 +849,1020 @@ RadiosondeDecoderModule::onPTUOutputChanged(void *ctx)
 }
 
 void
-RadiosondeDecoderModule::onTypeSelected(void *ctx, int selection)
+RadiosondeDecoderModule::onFlightLogOutputChanged(void *ctx)
 {
-	float bw;
 	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	_this->writerMtx.lock();
+	if (_this->flightLogOutput) {
+		_this->flightLogOutput = _this->flightLogWriter.init(_this->flightLogFilename, _this->logSegments);
+	} else {
+		_this->flightLogWriter.deinit();
+	}
+	_this->writerMtx.unlock();
+	if (_this->flightLogOutput) {
+		config.acquire();
+		config.conf[_this->name]["flightLogPath"] = _this->flightLogFilename;
+		config.release(true);
+	}
+}
 
-	/* Ensure that the selection is within bounds */
-	if (selection > sizeof(_this->supportedTypes)/sizeof(_this->supportedTypes[0])) return;
+/* Reopen the logs with the new settings: the current segments are closed
+ * and indexed, the next frame starts new ones */
+void
+RadiosondeDecoderModule::onLogSegmentsChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
 
-	/* Spin down the currently active decoder */
-	_this->lastData.init();
-	if (_this->activeDecoder) _this->activeDecoder->stop();
-	_this->activeDecoder = NULL;
+	if (_this->logSegments.maxSize < 0) _this->logSegments.maxSize = 0;
+	if (_this->ptuOutput) onPTUOutputChanged(ctx);
+	if (_this->flightLogOutput) onFlightLogOutputChanged(ctx);
 
-	/* If selection is negative, just stop here */
-	if (selection < 0) return;
-	_this->selectedType = selection;
+	config.acquire();
+	config.conf[_this->name]["logMaxSize"] = _this->logSegments.maxSize;
+	config.conf[_this->name]["logDaily"] = _this->logSegments.daily;
+	config.conf[_this->name]["logPerSerial"] = _this->logSegments.perSerial;
+	config.conf[_this->name]["logCompress"] = _this->logSegments.compress;
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::onNetOutputChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	_this->writerMtx.lock();
+	if (_this->netOutput) {
+		_this->netOutput = _this->netWriter.init(_this->netAddress, _this->netTransport, _this->netFormat);
+	} else {
+		_this->netWriter.deinit();
+	}
+	_this->writerMtx.unlock();
 
-	/* Save selection to config */
 	config.acquire();
-	config.conf[_this->name]["sondeType"] = selection;
+	config.conf[_this->name]["netAddress"] = _this->netAddress;
+	config.conf[_this->name]["netTransport"] = _this->netTransport;
+	config.conf[_this->name]["netFormat"] = _this->netFormat;
 	config.release(true);
+}
 
-	/* Get new bandwidth */
-	bw = std::get<1>(_this->supportedTypes[selection]);
+void
+RadiosondeDecoderModule::onMergeOutputChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	const int source = _this->mergeSource;
 
-	/* Update VFO */
-	_this->fmDemod.stop();
-	if (_this->vfo) sigpath::vfoManager.deleteVFO(_this->vfo);
-	_this->vfo = sigpath::vfoManager.createVFO(_this->name, ImGui::WaterfallVFO::REF_CENTER, 0, bw, bw, bw, bw, true);
-	_this->vfo->setSnapInterval(SNAP_INTERVAL);
-	_this->fmDemod.setInput(_this->vfo->output);
-	_this->fmDemod.start();
+	if (_this->mergeOutput && source < 0) {
+		_this->mergeSource = frameMerger.addSource(mergedDataHandler, _this);
+	} else if (!_this->mergeOutput && source >= 0) {
+		/* Stop feeding the merger first, then collect what it is still holding */
+		_this->mergeSource = -1;
+		frameMerger.removeSource(source);
+	}
+
+	config.acquire();
+	config.conf[_this->name]["mergeOutput"] = _this->mergeOutput;
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::mergedDataHandler(const SondeFullData *data, void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	_this->outputWriter.push(*data);
+}
+
+void
+RadiosondeDecoderModule::onMetricsOutputChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	_this->metricsExporter.deinit();
+	if (_this->metricsOutput) _this->metricsExporter.init(_this->metricsFilename, METRICS_INTERVAL, collectMetrics, _this);
+
+	config.acquire();
+	config.conf[_this->name]["metricsOutput"] = _this->metricsOutput;
+	config.conf[_this->name]["metricsPath"] = _this->metricsFilename;
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::gatherMetrics(void *ctx, std::vector<MetricsEntry> &entries)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	std::vector<radiosonde::WidebandReceiver::ChannelStatus> channels;
+	MetricsEntry entry;
+	char name[64];
+
+	entries.clear();
+
+	/* Narrowband decoders: idle ones just do not move, released ones are gone */
+	std::unique_lock<std::mutex> decodersLck(_this->decodersMtx);
+	for (int i=0; i<SONDE_TYPES_COUNT; i++) {
+		if (!_this->decoders[i]) continue;
+		entry.name = _this->supportedTypes[i].name;
+		entry.block = "decoder";
+		entry.type = _this->supportedTypes[i].name;
+		entry.frequency = 0;
+		_this->decoders[i]->metrics().snapshot(&entry.metrics);
+		entries.push_back(entry);
+	}
+	decodersLck.unlock();
+
+	/* Wideband receiver and its channels */
+	std::lock_guard<std::mutex> lck(_this->widebandMtx);
+	if (!_this->widebandRx) return;
+
+	entry.name = "Wideband";
+	entry.block = "receiver";
+	entry.type = "";
+	entry.frequency = 0;
+	_this->widebandRx->metrics().snapshot(&entry.metrics);
+	entries.push_back(entry);
+
+	_this->widebandRx->getChannels(channels);
+	for (auto &channel : channels) {
+		snprintf(name, sizeof(name), "%s %.3fMHz", _this->supportedTypes[channel.tag].name, channel.frequency * 1e-6);
+		entry.name = name;
+		entry.block = "decoder";
+		entry.type = _this->supportedTypes[channel.tag].name;
+		entry.frequency = channel.frequency;
+		entry.metrics = channel.metrics;
+		entries.push_back(entry);
+	}
+}
+
+void
+RadiosondeDecoderModule::collectMetrics(radiosonde::MetricSet *set, void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	const std::string writerLabels = radiosonde::MetricSet::label({{"instance", _this->name}});
+	std::vector<MetricsEntry> entries;
+	char frequency[32];
+
+	gatherMetrics(ctx, entries);
 
-	_this->resampler.setInSamplerate(bw);
+	for (auto &entry : entries) {
+		snprintf(frequency, sizeof(frequency), "%.0f", entry.frequency);
+		const std::string labels = radiosonde::MetricSet::label({
+			{"instance", _this->name}, {"block", entry.block}, {"type", entry.type}, {"frequency", frequency}
+		});
+
+		set->add("radiosonde_samples_total", "counter", "Input samples processed", labels, entry.metrics.samples);
+		set->add("radiosonde_blocks_total", "counter", "Input buffers processed", labels, entry.metrics.blocks);
+		set->add("radiosonde_busy_seconds_total", "counter", "Time spent processing input", labels, entry.metrics.busyNs * 1e-9);
+		set->add("radiosonde_wait_seconds_total", "counter", "Time spent waiting for input", labels, entry.metrics.waitNs * 1e-9);
+		if (strcmp(entry.block, "decoder")) continue;
+		set->add("radiosonde_reads_total", "counter", "Input buffers read from the stream", labels, entry.metrics.reads);
+		set->add("radiosonde_batch_latency_seconds_total", "counter", "Time spent waiting for batches to fill", labels, entry.metrics.latencyNs * 1e-9);
+		set->add("radiosonde_frames_total", "counter", "Data fragments decoded", labels, entry.metrics.frames);
+		set->add("radiosonde_bad_frames_total", "counter", "Frames parsed without any valid data", labels, entry.metrics.badFrames);
+	}
 
-	/* Spin up the appropriate decoder */
-	_this->activeDecoder = std::get<2>(_this->supportedTypes[selection]);
-	_this->activeDecoder->start();
+	if (!_this->wideband) {
+		set->add("radiosonde_frequency_offset_hz", "gauge", "Carrier offset of the last frame from the VFO", writerLabels, _this->signalOffset);
+		set->add("radiosonde_deviation_hz", "gauge", "FSK deviation of the last frame", writerLabels, _this->signalDeviation);
+		set->add("radiosonde_afc_correction_hz", "gauge", "VFO correction applied by the AFC", writerLabels, _this->afcPull.load());
+	}
+	set->add("radiosonde_writer_written_total", "counter", "Frames written to the output files", writerLabels, _this->outputWriter.written());
+	set->add("radiosonde_writer_dropped_total", "counter", "Frames dropped because the writer queue was full", writerLabels, _this->outputWriter.dropped());
+	set->add("radiosonde_writer_queue_depth", "gauge", "Frames waiting to be written", writerLabels, _this->outputWriter.depth());
+	set->add("radiosonde_writer_queue_peak", "gauge", "Highest number of frames waiting to be written", writerLabels, _this->outputWriter.maxDepth());
+	set->add("radiosonde_writer_queue_capacity", "gauge", "Size of the writer queue", writerLabels, _this->outputWriter.capacity());
+	set->add("radiosonde_writer_batches_total", "counter", "Batches of frames written", writerLabels, _this->outputWriter.batches());
+	set->add("radiosonde_writer_flushes_total", "counter", "Flushes of the output files", writerLabels, _this->outputWriter.flushes());
+	set->add("radiosonde_writer_write_seconds_total", "counter", "Time spent writing frames", writerLabels, _this->outputWriter.writeTime() * 1e-9);
+	set->add("radiosonde_writer_flush_seconds_total", "counter", "Time spent flushing the output files", writerLabels, _this->outputWriter.flushTime() * 1e-9);
+}
+
+void
+RadiosondeDecoderModule::updateStats(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	const uint64_t now = radiosonde::nowNs();
+	const double elapsed = (now - _this->statsLastUpdate) * 1e-9;
+	uint64_t writerBusy;
+	StatsRow row;
+
+	if (now - _this->statsLastUpdate < STATS_INTERVAL * 1000000ULL) return;
+
+	/* Turn the counters into load figures over the last interval */
+	gatherMetrics(ctx, _this->statsEntries);
+	_this->statsRows.clear();
+	for (auto &entry : _this->statsEntries) {
+		auto prev = _this->statsPrev.find(entry.name);
+
+		if (!entry.metrics.samples) continue;
+		row.name = entry.name;
+		row.frames = entry.metrics.frames;
+		row.badFrames = entry.metrics.badFrames;
+		row.cpu = row.idle = row.calls = row.latency = 0;
+		if (prev != _this->statsPrev.end() && _this->statsLastUpdate) {
+			const uint64_t blocks = entry.metrics.blocks - prev->second.blocks;
+
+			row.cpu = (entry.metrics.busyNs - prev->second.busyNs) * 1e-9 / elapsed;
+			row.idle = (entry.metrics.waitNs - prev->second.waitNs) * 1e-9 / elapsed;
+			row.calls = blocks / elapsed;
+			if (blocks) row.latency = (entry.metrics.latencyNs - prev->second.latencyNs) * 1e-6 / blocks;
+		}
+		_this->statsRows.push_back(row);
+	}
+
+	_this->statsPrev.clear();
+	for (auto &entry : _this->statsEntries) _this->statsPrev[entry.name] = entry.metrics;
+
+	writerBusy = _this->outputWriter.writeTime() + _this->outputWriter.flushTime();
+	_this->writerBusy = _this->statsLastUpdate ? (writerBusy - _this->writerPrevBusy) * 1e-9 / elapsed : 0;
+	_this->writerPrevBusy = writerBusy;
+	_this->statsLastUpdate = now;
+}
+
+void
+RadiosondeDecoderModule::statsMenu(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	updateStats(ctx);
+
+	if (ImGui::BeginTable(CONCAT("##_radiosonde_stats_table_", _this->name), 7, ImGuiTableFlags_SizingFixedFit)) {
+		ImGui::TableSetupColumn("Block");
+		ImGui::TableSetupColumn("CPU");
+		ImGui::TableSetupColumn("Idle");
+		ImGui::TableSetupColumn("Calls/s");
+		ImGui::TableSetupColumn("Latency");
+		ImGui::TableSetupColumn("Frames");
+		ImGui::TableSetupColumn("Bad");
+		ImGui::TableHeadersRow();
+
+		for (auto &row : _this->statsRows) {
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("%s", row.name.c_str());
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f%%", row.cpu * 100);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f%%", row.idle * 100);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.0f", row.calls);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1fms", row.latency);
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", (unsigned long long)row.frames);
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", (unsigned long long)row.badFrames);
+		}
+
+		ImGui::EndTable();
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("CPU: share of one core spent decoding.\nIdle: share of time spent waiting for samples.\nCalls/s: buffers or batches processed per second.\nLatency: average time a batch took to fill (see Threads).\nA block close to 100%% CPU and 0%% idle is falling behind.");
+	}
+
+	ImGui::Text("Writer: %.1f%% CPU, %llu written", _this->writerBusy * 100, (unsigned long long)_this->outputWriter.written());
+}
+
+void
+RadiosondeDecoderModule::profileMenu(void *ctx)
+{
+	static const struct {
+		const char *name, *unit;
+	} fields[radiosonde::FlightHistory::FIELD_COUNT] = {
+		{"Altitude", "m"},
+		{"Climb", "m/s"},
+		{"Temperature", "C"},
+		{"Humidity", "%"},
+		{"Pressure", "hPa"},
+	};
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	const float width = ImGui::GetContentRegionAvail().x;
+	const int buckets = std::max(1, (int)width);
+	radiosonde::FlightHistory::Snapshot &snapshot = _this->historySnapshot;
+	char overlay[64];
+	uint64_t total;
+
+	_this->history.list(_this->historySerials);
+	if (_this->historySerials.empty()) {
+		ImGui::Text("No data yet");
+		return;
+	}
+	if (std::find(_this->historySerials.begin(), _this->historySerials.end(), _this->historySerial) == _this->historySerials.end()) {
+		_this->historySerial = _this->historySerials[0];
+	}
+
+	ImGui::LeftLabel("Sonde");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	if (ImGui::BeginCombo(CONCAT("##_radiosonde_profile_serial_", _this->name), _this->historySerial.c_str())) {
+		for (auto &serial : _this->historySerials) {
+			const bool selected = serial == _this->historySerial;
+			if (ImGui::Selectable(serial.c_str(), selected)) _this->historySerial = serial;
+			if (selected) ImGui::SetItemDefaultFocus();
+		}
+		ImGui::EndCombo();
+	}
+
+	/* Only copy and decimate the history when it changes, drawing is then
+	 * bounded by the plot width regardless of the length of the flight */
+	total = _this->history.total(_this->historySerial.c_str());
+	if (total != _this->historyTotal || buckets != _this->historyWidth || _this->historySerial != snapshot.serial) {
+		if (!_this->history.snapshot(_this->historySerial.c_str(), &snapshot)) return;
+		for (int i=0; i<radiosonde::FlightHistory::FIELD_COUNT; i++) {
+			radiosonde::FlightHistory::decimate(snapshot.values[i].data(), snapshot.values[i].size(), buckets, _this->historyPlots[i]);
+		}
+		_this->historyTotal = total;
+		_this->historyWidth = buckets;
+	}
+	if (snapshot.time.empty()) return;
+
+	for (int i=0; i<radiosonde::FlightHistory::FIELD_COUNT; i++) {
+		const std::vector<float> &plot = _this->historyPlots[i];
+
+		snprintf(overlay, sizeof(overlay), "%s: %.1f%s", fields[i].name, snapshot.values[i].back(), fields[i].unit);
+		ImGui::PlotLines(CONCAT("##_radiosonde_profile_plot_", _this->name + std::to_string(i)), plot.data(), plot.size(), 0,
+		                 overlay, FLT_MAX, FLT_MAX, ImVec2(width, 60));
+	}
+	ImGui::Text("%zu frames, %.0f min", snapshot.time.size(), difftime(snapshot.time.back(), snapshot.time.front()) / 60);
+}
+
+void
+RadiosondeDecoderModule::threadsMenu(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	const float width = ImGui::GetContentRegionAvail().x;
+	std::vector<int> cpus;
+	bool changed = false;
+
+	ImGui::LeftLabel("Real-time priority");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	changed |= ImGui::InputInt(CONCAT("##_radiosonde_rt_prio_", _this->name), &_this->threadPriority, 1, 10,
+	                           ImGuiInputTextFlags_EnterReturnsTrue);
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("SCHED_FIFO priority (1-99) of the threads below, 0 for the default scheduler.\nNeeds CAP_SYS_NICE or a suitable RLIMIT_RTPRIO.");
+	}
+	ImGui::LeftLabel("Demodulator CPU");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	changed |= ImGui::InputInt(CONCAT("##_radiosonde_demod_cpu_", _this->name), &_this->demodCpu, 1, 1,
+	                           ImGuiInputTextFlags_EnterReturnsTrue);
+	ImGui::LeftLabel("Resampler CPU");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	changed |= ImGui::InputInt(CONCAT("##_radiosonde_resampler_cpu_", _this->name), &_this->resamplerCpu, 1, 1,
+	                           ImGuiInputTextFlags_EnterReturnsTrue);
+	ImGui::LeftLabel("Decoder CPU");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	changed |= ImGui::InputInt(CONCAT("##_radiosonde_decoder_cpu_", _this->name), &_this->decoderCpu, 1, 1,
+	                           ImGuiInputTextFlags_EnterReturnsTrue);
+	ImGui::LeftLabel("Wideband CPUs");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	changed |= ImGui::InputText(CONCAT("##_radiosonde_wideband_cpus_", _this->name), _this->widebandCpus, sizeof(widebandCpus)-1,
+	                            ImGuiInputTextFlags_EnterReturnsTrue);
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Cores for the receiver thread, then for each channel worker (e.g. \"4-7\").\nPick cores sharing an L2 cache or NUMA node: each channel then stays on one of them.");
+	}
+
+	if (changed) {
+		if (_this->threadPriority < 0) _this->threadPriority = 0;
+		if (_this->threadPriority > 99) _this->threadPriority = 99;
+		if (_this->demodCpu < -1) _this->demodCpu = -1;
+		if (_this->resamplerCpu < -1) _this->resamplerCpu = -1;
+		if (_this->decoderCpu < -1) _this->decoderCpu = -1;
+		applySchedules(ctx);
+
+		config.acquire();
+		config.conf[_this->name]["threadPriority"] = _this->threadPriority;
+		config.conf[_this->name]["demodCpu"] = _this->demodCpu;
+		config.conf[_this->name]["resamplerCpu"] = _this->resamplerCpu;
+		config.conf[_this->name]["decoderCpu"] = _this->decoderCpu;
+		config.conf[_this->name]["widebandCpus"] = _this->widebandCpus;
+		config.release(true);
+	}
+
+	ImGui::PushStyleColor(ImGuiCol_Text, ERROR_COLOR);
+	if (!radiosonde::parseCpuList(_this->widebandCpus, cpus)) {
+		ImGui::Text("Invalid CPU list");
+	} else if (!_this->threadsScheduled) {
+		ImGui::Text("Could not apply the settings to all the threads");
+	}
+	ImGui::PopStyleColor();
+
+	/* Decoder batching {{{ */
+	changed = false;
+	ImGui::LeftLabel("Decoder batch");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	changed |= ImGui::InputInt(CONCAT("##_radiosonde_decoder_batch_", _this->name), &_this->decoderBatch, 1024, 8192,
+	                           ImGuiInputTextFlags_EnterReturnsTrue);
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Samples to accumulate before running the decoder, 0 to decode every buffer as it comes.\nFewer, larger calls cost less CPU, at the expense of latency.");
+	}
+	ImGui::LeftLabel("Latency budget (ms)");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	changed |= ImGui::InputInt(CONCAT("##_radiosonde_decoder_latency_", _this->name), &_this->decoderLatency, 5, 50,
+	                           ImGuiInputTextFlags_EnterReturnsTrue);
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Decode a batch after this long even if it is not full, 0 for no limit.");
+	}
+
+	if (changed) {
+		if (_this->decoderBatch < 0) _this->decoderBatch = 0;
+		if (_this->decoderLatency < 0) _this->decoderLatency = 0;
+		applyBatching(ctx);
+
+		config.acquire();
+		config.conf[_this->name]["decoderBatch"] = _this->decoderBatch;
+		config.conf[_this->name]["decoderLatency"] = _this->decoderLatency;
+		config.release(true);
+	}
+	/* }}} */
+}
+
+/* Push the thread settings to every block, running or not */
+void
+RadiosondeDecoderModule::applySchedules(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	std::vector<radiosonde::ThreadSchedule> schedules;
+	bool ok = true;
+
+	ok &= _this->fmDemod.setSchedule(radiosonde::ThreadSchedule(_this->demodCpu, _this->threadPriority));
+	ok &= _this->resampler.setSchedule(radiosonde::ThreadSchedule(_this->resamplerCpu, _this->threadPriority));
+	for (int i=0; i<SONDE_TYPES_COUNT; i++) {
+		if (!_this->decoders[i]) continue;
+		ok &= _this->decoders[i]->setSchedule(radiosonde::ThreadSchedule(_this->decoderCpu, _this->threadPriority));
+	}
+
+	std::lock_guard<std::mutex> lck(_this->widebandMtx);
+	if (_this->widebandRx) {
+		widebandSchedules(ctx, schedules);
+		ok &= _this->widebandRx->setThreadSchedule(schedules);
+	}
+	_this->threadsScheduled = ok;
+}
+
+/* Batching only applies to the narrowband decoders, the wideband channels are
+ * already fed one receiver buffer at a time */
+void
+RadiosondeDecoderModule::applyBatching(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	for (int i=0; i<SONDE_TYPES_COUNT; i++) {
+		if (_this->decoders[i]) _this->decoders[i]->setBatching(_this->decoderBatch, _this->decoderLatency);
+	}
+}
+
+/* One entry per wideband thread: the configured cores, or just the priority if there are none */
+void
+RadiosondeDecoderModule::widebandSchedules(void *ctx, std::vector<radiosonde::ThreadSchedule> &schedules)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	std::vector<int> cpus;
+
+	schedules.clear();
+	radiosonde::parseCpuList(_this->widebandCpus, cpus);
+	for (int cpu : cpus) schedules.push_back(radiosonde::ThreadSchedule(cpu, _this->threadPriority));
+	if (schedules.empty() && _this->widebandRx) {
+		schedules.assign(_this->widebandRx->threads(), radiosonde::ThreadSchedule(-1, _this->threadPriority));
+	}
+}
+
+void
+RadiosondeDecoderModule::onTypeSelected(void *ctx, int selection)
+{
+	float bw;
+	int decimation;
+	dsp::stream<float> *decoderInput;
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	/* Ensure that the selection is within bounds */
+	if (selection >= IM_ARRAYSIZE(_this->supportedTypes)) return;
+
+	/* Spin down the currently active decoder(s). lastData only has one writer
+	 * at a time, so it's cleared once their threads are gone */
+	if (_this->autoDetect) stopAutoDetect(ctx, -1);
+	if (_this->activeDecoder) _this->activeDecoder->stop();
+	_this->activeDecoder = NULL;
+	_this->lastData.store(SondeFullData());
+
+	/* If selection is negative, just stop here */
+	if (selection < 0) return;
+	_this->selectedType = selection;
+
+	/* Save selection to config, once the user (or auto-detect) settles on it */
+	_this->typeChangedAt = selection != _this->savedType ? radiosonde::nowNs() : 0;
+
+	/* Whatever the previous type was pulled to does not apply to this one */
+	_this->afcPull = 0;
+	_this->afcError = NAN;
+	_this->signalOffset = _this->signalDeviation = 0;
+
+	/* Get new bandwidth */
+	bw = _this->supportedTypes[selection].bandwidth;
+
+	/* Update VFO and demodulator. They are retuned in place rather than
+	 * recreated, so that the samples already in flight are not lost */
+	if (!_this->vfo) {
+		_this->vfo = sigpath::vfoManager.createVFO(_this->name, ImGui::WaterfallVFO::REF_CENTER, 0, bw, bw, bw, bw, true);
+		_this->vfo->setSnapInterval(SNAP_INTERVAL);
+		_this->fmDemod.setInput(_this->vfo->output);
+	} else if (bw != _this->channelBw) {
+		_this->vfo->setBandwidthLimits(bw, bw, true);
+		_this->vfo->setSampleRate(bw, bw);
+	}
+	if (bw != _this->channelBw) {
+		_this->fmDemod.setSamplerate(bw);
+		_this->fmDemod.setBandwidth(bw/2.0f);
+		_this->channelBw = bw;
+	}
+
+	/* Update the rate conversion stage. Auto-detect always goes through the
+	 * resampler, since all the decoders share the same input */
+	_this->activeDecoder = selection < SONDE_TYPES_COUNT ? getDecoder(ctx, selection) : NULL;
+	if (_this->nativeRate && _this->activeDecoder) {
+		decimation = radiosonde::nativeDecimation(bw);
+		_this->resampler.stop();
+		if (decimation > 1) {
+			_this->nativeDecimator.setRatio(decimation);
+			_this->nativeDecimator.start();
+			decoderInput = &_this->nativeDecimator.out;
+		} else {
+			_this->nativeDecimator.stop();
+			decoderInput = &_this->fmDemod.out;
+		}
+		_this->activeDecoder->setSamplerate(bw / decimation);
+	} else {
+		_this->nativeDecimator.stop();
+		_this->resampler.setTapsPerPhase(_this->supportedTypes[selection].resamplerTaps);
+		if (bw != _this->resamplerBw) {
+			_this->resampler.setInSamplerate(bw);
+			_this->resamplerBw = bw;
+		}
+		_this->resampler.start();
+		decoderInput = &_this->resampler.out;
+		if (_this->activeDecoder) _this->activeDecoder->setSamplerate(OUT_SAMPLE_RATE);
+	}
+	_this->fmDemod.start();
+
+	/* Spin up the appropriate decoder, or all of them if auto-detecting */
+	if (_this->activeDecoder) {
+		_this->activeDecoder->setInput(decoderInput);
+		_this->activeDecoder->start();
+	} else {
+		startAutoDetect(ctx);
+	}
+}
+
+/**
+ * Move the VFO towards the carrier after each frame, within half a channel of
+ * where it was when the type was selected. Runs on the GUI thread, like any
+ * other VFO update.
+ */
+void
+RadiosondeDecoderModule::applyAfc(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	const float error = _this->afcError.exchange(NAN);
+	const double limit = _this->channelBw / 2;
+	const double pull = _this->afcPull;
+	double step;
+
+	if (!_this->afc || !_this->vfo || _this->wideband || isnan(error)) return;
+	if (fabs(error) < AFC_DEADBAND) return;
+
+	step = AFC_GAIN * error;
+	if (pull + step > limit) step = limit - pull;
+	if (pull + step < -limit) step = -limit - pull;
+	if (step == 0) return;
+
+	_this->afcPull = pull + step;
+	sigpath::vfoManager.setOffset(_this->name, sigpath::vfoManager.getOffset(_this->name) + step);
+}
+
+/**
+ * Write the selected type to config, if it changed and has not been changed
+ * again in the last TYPE_SAVE_DELAY milliseconds (or unconditionally if force
+ * is set). The config manager commits it to disk from its own thread.
+ */
+void
+RadiosondeDecoderModule::saveSelectedType(void *ctx, bool force)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	if (!_this->typeChangedAt) return;
+	if (!force && radiosonde::nowNs() - _this->typeChangedAt < TYPE_SAVE_DELAY * 1000000ULL) return;
+
+	config.acquire();
+	config.conf[_this->name]["sondeType"] = _this->selectedType;
+	config.release(true);
+
+	_this->savedType = _this->selectedType;
+	_this->typeChangedAt = 0;
+}
+
+/* Get the decoder for a type, creating it the first time it is needed. Its
+ * schedule and batching settings are applied when it is started */
+radiosonde::DecoderBase*
+RadiosondeDecoderModule::getDecoder(void *ctx, int type)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	std::unique_ptr<radiosonde::DecoderBase> decoder;
+
+	if (_this->decoders[type]) return _this->decoders[type].get();
+
+	decoder.reset(_this->supportedTypes[type].create());
+	decoder->init(&_this->resampler.out, OUT_SAMPLE_RATE, sondeDataHandler, &_this->decoderCtx[type]);
+	decoder->setSchedule(radiosonde::ThreadSchedule(_this->decoderCpu, _this->threadPriority));
+	decoder->setBatching(_this->decoderBatch, _this->decoderLatency);
+	_this->decoderIdleSince[type] = 0;
+
+	std::lock_guard<std::mutex> lck(_this->decodersMtx);
+	_this->decoders[type] = std::move(decoder);
+	return _this->decoders[type].get();
+}
+
+/* Free the decoders that have not run for DECODER_IDLE_TIMEOUT, along with
+ * whatever they were holding (e.g. RS41 calibration data). The decoder of the
+ * selected (or auto-locked) type is never released: it is the one that picks
+ * up the same sonde when the module is enabled again, and keeping its
+ * calibration is what the wideband decoder pool does for removed channels */
+void
+RadiosondeDecoderModule::releaseIdleDecoders(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	const uint64_t now = radiosonde::nowNs();
+
+	for (int i=0; i<SONDE_TYPES_COUNT; i++) {
+		if (!_this->decoders[i]) continue;
+		if (_this->decoders[i]->isRunning() || i == _this->selectedType || i == _this->lockedType) {
+			_this->decoderIdleSince[i] = 0;
+		} else if (!_this->decoderIdleSince[i]) {
+			_this->decoderIdleSince[i] = now;
+		} else if (now - _this->decoderIdleSince[i] >= DECODER_IDLE_TIMEOUT * 1000000000ULL) {
+			std::lock_guard<std::mutex> lck(_this->decodersMtx);
+			_this->decoders[i].reset();
+			_this->decoderIdleSince[i] = 0;
+		}
+	}
+}
+
+void
+RadiosondeDecoderModule::startAutoDetect(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	_this->lockedType = -1;
+	_this->autoLocked = false;
+	_this->autoDetect = true;
+
+	for (int i=0; i<SONDE_TYPES_COUNT; i++) {
+		radiosonde::DecoderBase *decoder = getDecoder(ctx, i);
+
+		decoder->setSamplerate(OUT_SAMPLE_RATE);
+		_this->autoBroadcast.bindReader(&_this->autoReaders[i]);
+		if (_this->autoFiltered[i]) {
+			decoder->setInput(&_this->autoFilters[i].out);
+			_this->autoFilters[i].start();
+		} else {
+			decoder->setInput(&_this->autoReaders[i]);
+		}
+		decoder->start();
+	}
+	_this->autoBroadcast.start();
+}
+
+/**
+ * Spin down the auto-detect decoders. If keep is a valid type, its decoder
+ * is left running, otherwise auto-detection is stopped altogether.
+ */
+void
+RadiosondeDecoderModule::stopAutoDetect(void *ctx, int keep)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	for (int i=0; i<SONDE_TYPES_COUNT; i++) {
+		if (i == keep) continue;
+		if (_this->autoLocked && i != _this->lockedType) continue;    /* Already stopped */
+
+		_this->autoBroadcast.unbindReader(&_this->autoReaders[i]);
+		if (_this->autoFiltered[i]) _this->autoFilters[i].stop();
+		_this->decoders[i]->stop();
+	}
+
+	if (keep >= 0) {
+		_this->autoLocked = true;
+	} else {
+		_this->autoBroadcast.stop();
+		_this->autoDetect = false;
+		_this->autoLocked = false;
+	}
+}
+
+void
+RadiosondeDecoderModule::startNarrowband(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	/* Make a new VFO, wire it into the DSP path, then start the appropriate decoder */
+	onTypeSelected(ctx, _this->selectedType);
+}
+
+void
+RadiosondeDecoderModule::stopNarrowband(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	if (_this->autoDetect) stopAutoDetect(ctx, -1);
+	if (_this->activeDecoder) _this->activeDecoder->stop();
+	_this->activeDecoder = NULL;
+
+	_this->fmDemod.stop();
+	_this->resampler.stop();
+	_this->nativeDecimator.stop();
+
+	if (_this->vfo) sigpath::vfoManager.deleteVFO(_this->vfo);
+	_this->vfo = NULL;
+}
+
+void
+RadiosondeDecoderModule::startWideband(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	std::vector<radiosonde::ThreadSchedule> schedules;
+	radiosonde::WidebandReceiver *receiver;
+	double samplerate;
+	int channels;
+
+	/* The channelizer needs the samplerate to be an even multiple of the spacing */
+	channels = 2 * std::max(1L, lround(_this->widebandSpan * 1e3 / (2 * WIDEBAND_SPACING)));
+	samplerate = channels * WIDEBAND_SPACING;
+
+	_this->vfo = sigpath::vfoManager.createVFO(_this->name, ImGui::WaterfallVFO::REF_CENTER, 0, samplerate, samplerate, samplerate, samplerate, true);
+	_this->vfo->setSnapInterval(SNAP_INTERVAL);
+
+	/* Only published once initialized, the metrics thread may use it right away */
+	receiver = new radiosonde::WidebandReceiver();
+	receiver->init(_this->vfo->output, samplerate, WIDEBAND_SPACING, _this->nativeRate ? 0 : OUT_SAMPLE_RATE, _this->widebandThreads,
+	               widebandDataHandler, _this);
+	receiver->setDecoderPool(&_this->decoderPool);
+	_this->widebandMtx.lock();
+	_this->widebandRx = receiver;
+	_this->widebandMtx.unlock();
+	widebandSchedules(ctx, schedules);
+	_this->threadsScheduled = _this->widebandRx->setThreadSchedule(schedules);
+	_this->widebandCenter = gui::waterfall.getCenterFrequency() + sigpath::vfoManager.getOffset(_this->name);
+	_this->widebandRx->setCenterFrequency(_this->widebandCenter);
+
+	/* Restore the channels from the last session */
+	config.acquire();
+	for (auto &channel : config.conf[_this->name]["widebandChannels"]) {
+		const double frequency = channel["frequency"];
+		const int type = channel["type"];
+
+		if (type < 0 || type >= SONDE_TYPES_COUNT) continue;
+		_this->widebandRx->addChannel(frequency, _this->supportedTypes[type].bandwidth, _this->supportedTypes[type].create(), type);
+	}
+	config.release();
+
+	onScannerChanged(ctx);
+	_this->widebandRx->start();
+}
+
+void
+RadiosondeDecoderModule::stopWideband(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	if (_this->widebandRx) {
+		_this->widebandRx->stop();
+		_this->widebandMtx.lock();
+		delete _this->widebandRx;
+		_this->widebandRx = NULL;
+		_this->widebandMtx.unlock();
+	}
+	_this->widebandStatus.clear();
+
+	if (_this->vfo) sigpath::vfoManager.deleteVFO(_this->vfo);
+	_this->vfo = NULL;
+}
+
+void
+RadiosondeDecoderModule::onWidebandChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	config.acquire();
+	config.conf[_this->name]["wideband"] = _this->wideband;
+	config.release(true);
+
+	if (!_this->enabled) return;
+
+	if (_this->wideband) {
+		stopNarrowband(ctx);
+		_this->lastData.store(SondeFullData());
+		startWideband(ctx);
+	} else {
+		stopWideband(ctx);
+		startNarrowband(ctx);
+	}
+}
+
+void
+RadiosondeDecoderModule::onNativeRateChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	config.acquire();
+	config.conf[_this->name]["nativeRate"] = _this->nativeRate;
+	config.release(true);
+
+	if (!_this->enabled) return;
+
+	/* Rebuild the DSP path with the new decoder samplerate */
+	if (_this->wideband) {
+		stopWideband(ctx);
+		startWideband(ctx);
+	} else {
+		onTypeSelected(ctx, _this->selectedType);
+	}
+}
+
+void
+RadiosondeDecoderModule::saveWidebandChannels(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	json channels = json::array();
+
+	_this->widebandRx->getChannels(_this->widebandStatus);
+	for (auto &status : _this->widebandStatus) {
+		json channel;
+
+		/* Channels found by the scanner only last as long as the signal does */
+		if (status.transient) continue;
+		channel["frequency"] = status.frequency;
+		channel["type"] = status.tag;
+		channels.push_back(channel);
+	}
+
+	config.acquire();
+	config.conf[_this->name]["widebandChannels"] = channels;
+	config.release(true);
+}
+
+void
+RadiosondeDecoderModule::onScannerChanged(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+
+	if (!_this->widebandRx) return;
+	_this->widebandRx->setScanner(_this->widebandScan, _this->scanThreshold, SCAN_MIN_WIDTH, SCAN_MAX_WIDTH,
+	                              widebandSignalHandler, _this);
+}
+
+void
+RadiosondeDecoderModule::widebandMenu(void *ctx)
+{
+	RadiosondeDecoderModule *_this = (RadiosondeDecoderModule*)ctx;
+	const float width = ImGui::GetContentRegionAvail().x;
+	const float minSpan = 2 * WIDEBAND_SPACING / 1e3;
+	int removeId = -1;
+	double center;
+
+	/* Keep channel offsets up to date as the VFO is moved around */
+	if (_this->enabled && _this->widebandRx) {
+		center = gui::waterfall.getCenterFrequency() + sigpath::vfoManager.getOffset(_this->name);
+		if (center != _this->widebandCenter) {
+			_this->widebandCenter = center;
+			_this->widebandRx->setCenterFrequency(center);
+		}
+		_this->widebandRx->getChannels(_this->widebandStatus);
+	}
+
+	/* Captured bandwidth {{{ */
+	ImGui::LeftLabel("Span (kHz)");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	if (ImGui::InputFloat(CONCAT("##_radiosonde_wb_span_", _this->name), &_this->widebandSpan, 100, 1000, "%.0f",
+	                      ImGuiInputTextFlags_EnterReturnsTrue)) {
+		if (_this->widebandSpan < minSpan) _this->widebandSpan = minSpan;
+
+		config.acquire();
+		config.conf[_this->name]["widebandSpan"] = _this->widebandSpan;
+		config.release(true);
+
+		if (_this->enabled) {
+			stopWideband(ctx);
+			startWideband(ctx);
+		}
+	}
+	/* }}} */
+	/* Energy scanner {{{ */
+	if (ImGui::Checkbox(CONCAT("Scan for signals##_radiosonde_wb_scan_", _this->name), &_this->widebandScan)) {
+		config.acquire();
+		config.conf[_this->name]["widebandScan"] = _this->widebandScan;
+		config.release(true);
+		onScannerChanged(ctx);
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Start decoding any signal found in the captured band,\nand stop once it has been silent for a while.");
+	}
+
+	if (!_this->widebandScan) style::beginDisabled();
+	ImGui::LeftLabel("Threshold (dB)");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	if (ImGui::SliderFloat(CONCAT("##_radiosonde_wb_thresh_", _this->name), &_this->scanThreshold, 3, 30, "%.1f")) {
+		config.acquire();
+		config.conf[_this->name]["scanThreshold"] = _this->scanThreshold;
+		config.release(true);
+		onScannerChanged(ctx);
+	}
+
+	ImGui::LeftLabel("Timeout (s)");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	if (ImGui::InputFloat(CONCAT("##_radiosonde_wb_timeout_", _this->name), &_this->scanTimeout, 10, 60, "%.0f",
+	                      ImGuiInputTextFlags_EnterReturnsTrue)) {
+		if (_this->scanTimeout < 1) _this->scanTimeout = 1;
+		config.acquire();
+		config.conf[_this->name]["scanTimeout"] = _this->scanTimeout;
+		config.release(true);
+	}
+
+	ImGui::LeftLabel("Scan type");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	if (ImGui::BeginCombo(CONCAT("##_radiosonde_wb_scantype_", _this->name), _this->supportedTypes[_this->scanType].name)) {
+		for (int i=0; i<SONDE_TYPES_COUNT+1; i++) {
+			bool selected = _this->scanType == i;
+			if (ImGui::Selectable(_this->supportedTypes[i].name, selected)) {
+				_this->scanType = i;
+				config.acquire();
+				config.conf[_this->name]["scanType"] = _this->scanType;
+				config.release(true);
+			}
+			if (selected) {
+				ImGui::SetItemDefaultFocus();
+			}
+		}
+		ImGui::EndCombo();
+	}
+	if (ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Type of decoder to start on new signals.\nAuto picks one based on the occupied bandwidth.");
+	}
+	if (!_this->widebandScan) style::endDisabled();
+	/* }}} */
+	/* Channel list {{{ */
+	if (ImGui::BeginTable(CONCAT("##radiosonde_wb_channels_", _this->name), 5, ImGuiTableFlags_SizingFixedFit)) {
+		for (auto &channel : _this->widebandStatus) {
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			if (!channel.inBand) ImGui::PushStyleColor(ImGuiCol_Text, UNCAL_COLOR);
+			ImGui::Text("%.3fMHz", channel.frequency / 1e6);
+			if (!channel.inBand) ImGui::PopStyleColor();
+			if (!channel.inBand && ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("Outside of the captured band, not being decoded.");
+			}
+			ImGui::TableNextColumn();
+			ImGui::Text("%s%s", _this->supportedTypes[channel.tag].name, channel.transient ? "*" : "");
+			if (channel.transient && ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("Found by the scanner, removed once the signal goes away.");
+			}
+			ImGui::TableNextColumn();
+			ImGui::Text("%s", channel.data.serial);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1fm", channel.data.alt);
+			ImGui::TableNextColumn();
+			if (ImGui::Button(CONCAT("Remove##_radiosonde_wb_rm_", _this->name + std::to_string(channel.id)))) {
+				removeId = channel.id;
+			}
+		}
+		ImGui::EndTable();
+	}
+
+	if (removeId >= 0 && _this->widebandRx) {
+		_this->widebandRx->removeChannel(removeId);
+		saveWidebandChannels(ctx);
+	}
+	/* }}} */
+	/* New channel {{{ */
+	ImGui::LeftLabel("Frequency (MHz)");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX());
+	ImGui::InputDouble(CONCAT("##_radiosonde_wb_freq_", _this->name), &_this->newChannelFreq, 0.01, 0.1, "%.3f");
+
+	ImGui::LeftLabel("Type");
+	ImGui::SetNextItemWidth(width - ImGui::GetCursorPosX() - 50);
+	if (ImGui::BeginCombo(CONCAT("##_radiosonde_wb_type_", _this->name), _this->supportedTypes[_this->newChannelType].name)) {
+		for (int i=0; i<SONDE_TYPES_COUNT; i++) {
+			bool selected = _this->newChannelType == i;
+			if (ImGui::Selectable(_this->supportedTypes[i].name, selected)) {
+				_this->newChannelType = i;
+			}
+			if (selected) {
+				ImGui::SetItemDefaultFocus();
+			}
+		}
+		ImGui::EndCombo();
+	}
+	ImGui::SameLine();
+	if (ImGui::Button(CONCAT("Add##_radiosonde_wb_add_", _this->name), ImVec2(width - ImGui::GetCursorPosX(), 0)) && _this->widebandRx) {
+		_this->widebandRx->addChannel(_this->newChannelFreq * 1e6,
+		                              _this->supportedTypes[_this->newChannelType].bandwidth,
+		                              _this->supportedTypes[_this->newChannelType].create(),
+		                              _this->newChannelType);
+		saveWidebandChannels(ctx);
+	}
+	/* }}} */
 }
 /* }}} */
 
@@ -1,17 +1,36 @@
 #pragma once
 
 #include "dsp/block.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <module.h>
 #include <dsp/multirate/polyphase_resampler.h>
-#include <dsp/demod/fm.h>
+#include <dsp/multirate/power_decimator.h>
+#include <dsp/filter/fir.h>
+#include <dsp/taps/low_pass.h>
 #include <dsp/window/blackman.h>
 #include <signal_path/signal_path.h>
 #include "decode/decoder.hpp"
+#include "decoderpool.hpp"
+#include "asyncwriter.hpp"
+#include "broadcast.hpp"
+#include "seqlock.hpp"
+#include "wideband.hpp"
+#include "flightlog.hpp"
+#include "frontend.hpp"
 #include "gpx.hpp"
+#include "gpxtracks.hpp"
+#include "history.hpp"
+#include "merger.hpp"
+#include "metrics.hpp"
+#include "netwriter.hpp"
 #include "ptu.hpp"
+#include "sched.hpp"
+#include "segment.hpp"
+#include "sondetypes.hpp"
 
-/* Display name, bandwidth, decoder */
-typedef std::tuple<const char*, float, dsp::block*> sondespec_t;
 
 class RadiosondeDecoderModule : public ModuleManager::Instance {
 public:
@@ -26,40 +45,166 @@ public:
 private:
 	std::string name;
 	bool enabled = true;
-	bool gpxOutput = false, ptuOutput = false;
+	bool gpxOutput = false, ptuOutput = false, flightLogOutput = false, metricsOutput = false, netOutput = false;
 	char gpxFilename[2048];
 	char ptuFilename[2048];
+	char flightLogFilename[2048];
+	char metricsFilename[2048];
+	char netAddress[256];
+	int netTransport, netFormat;
 	VFOManager::VFO *vfo;
-	dsp::demod::FM<float> fmDemod;
-	dsp::multirate::RationalResampler<float> resampler;
+	radiosonde::FMDiscriminator fmDemod;
+	radiosonde::FixedResampler resampler;
+	dsp::multirate::PowerDecimator<float> nativeDecimator;
+	bool nativeRate = false;    /* Skip the resampler, and run the decoder at the VFO bandwidth */
 
-	radiosonde::Decoder<RS41Decoder, rs41_decoder_init, rs41_decoder_deinit, rs41_decode> rs41decoder;
-	radiosonde::Decoder<DFM09Decoder, dfm09_decoder_init, dfm09_decoder_deinit, dfm09_decode> dfm09decoder;
-	radiosonde::Decoder<IMS100Decoder, ims100_decoder_init, ims100_decoder_deinit, ims100_decode> ims100decoder;
-	radiosonde::Decoder<M10Decoder, m10_decoder_init, m10_decoder_deinit, m10_decode> m10decoder;
-	radiosonde::Decoder<IMET4Decoder, imet4_decoder_init, imet4_decoder_deinit, imet4_decode> imet4decoder;
-	radiosonde::Decoder<C50Decoder, c50_decoder_init, c50_decoder_deinit, c50_decode> c50decoder;
-	radiosonde::Decoder<MRZN1Decoder, mrzn1_decoder_init, mrzn1_decoder_deinit, mrzn1_decode> mrzn1decoder;
+	/* radiosonde::sondeTypes, followed by Auto (create is NULL, bandwidth is the
+	 * widest of the others) */
+	radiosonde::SondeType supportedTypes[SONDE_TYPES_COUNT + 1];
 
-	const sondespec_t supportedTypes[7] = {
-		sondespec_t("RS41", 1e4, &rs41decoder),
-		sondespec_t("DFM06/09", 1.5e4, &dfm09decoder),
-		sondespec_t("iMS100/RS-11G", 2e4, &ims100decoder),
-		sondespec_t("M10/M20", 5e4, &m10decoder),
-		sondespec_t("iMet-4", 2e4, &imet4decoder),
-		sondespec_t("SRS-C50", 2e4, &c50decoder),
-		sondespec_t("MRZ-N1", 2e4, &mrzn1decoder),
-	};
+	/* Narrowband decoders, created the first time their type is selected and
+	 * released after DECODER_IDLE_TIMEOUT without being used. Only changed from
+	 * the GUI thread, under decodersMtx so that the metrics thread can read them */
+	std::unique_ptr<radiosonde::DecoderBase> decoders[SONDE_TYPES_COUNT];
+	uint64_t decoderIdleSince[SONDE_TYPES_COUNT] = {0};    /* 0 while running */
+	std::mutex decodersMtx;
 	int selectedType = -1;
-	dsp::block *activeDecoder;
+	int savedType;              /* Type currently stored in config */
+	uint64_t typeChangedAt = 0; /* Time selectedType diverged from savedType, 0 if they match */
+	float channelBw;            /* Bandwidth the narrowband VFO and demodulator are tuned to */
+	float resamplerBw;          /* Input samplerate the resampler is set up for */
+	radiosonde::DecoderBase *activeDecoder;
+
+	/* Signal quality of the last narrowband frame, in Hz, and the automatic
+	 * frequency control it drives */
+	std::atomic<float> signalOffset, signalDeviation;
+	std::atomic<float> afcError;    /* Offset left to correct, NAN once applied */
+	bool afc;
+	std::atomic<double> afcPull;    /* Total correction applied since the type was selected, in Hz */
+
+	/* Auto-detect: every decoder reads the demodulated stream, band-limited
+	 * to its own bandwidth, until one of them locks on */
+	struct DecoderContext {
+		RadiosondeDecoderModule *module;
+		int type;
+	} decoderCtx[SONDE_TYPES_COUNT];
+	bool autoDetect = false, autoLocked = false;
+	std::atomic<int> lockedType;
+	radiosonde::Broadcast<float> autoBroadcast;
+	radiosonde::Broadcast<float>::Reader autoReaders[SONDE_TYPES_COUNT];
+	dsp::filter::FIR<float, float> autoFilters[SONDE_TYPES_COUNT];
+	dsp::tap<float> autoTaps[SONDE_TYPES_COUNT];
+	bool autoFiltered[SONDE_TYPES_COUNT];
+
+	/* Wideband mode: several channels decoded out of a single wide VFO */
+	bool wideband = false;
+	float widebandSpan;
+	int widebandThreads;
+	double widebandCenter;
+	radiosonde::WidebandReceiver *widebandRx;
+	std::mutex widebandMtx;     /* Held while widebandRx is created or destroyed, for the metrics thread */
+	radiosonde::DecoderPool decoderPool;    /* Decoders of removed channels, kept across receiver restarts */
+	std::vector<radiosonde::WidebandReceiver::ChannelStatus> widebandStatus;
+	double newChannelFreq;
+	int newChannelType;
+	bool widebandScan;
+	float scanThreshold, scanTimeout;
+	int scanType;           /* SONDE_TYPES_COUNT to guess from the occupied bandwidth */
+
+	/* Pinning and priority of the DSP threads */
+	int threadPriority;         /* SCHED_FIFO priority, 0 for the default policy */
+	int demodCpu, resamplerCpu, decoderCpu;     /* -1 to let the OS decide */
+	char widebandCpus[256];     /* Receiver thread, then the channel workers, e.g. "4-7" */
+	bool threadsScheduled = true;
+	int decoderBatch;           /* Samples to accumulate before decoding, 0 for none */
+	int decoderLatency;         /* Longest wait for a batch to fill (ms), 0 for no limit */
 
-	SondeFullData lastData;
+	radiosonde::Seqlock<SondeFullData> lastData;    /* Written by the DSP thread, read by the GUI */
+
+	/* Profile plots: per-sonde history, and its decimated copy for drawing */
+	radiosonde::FlightHistory history;
+	radiosonde::FlightHistory::Snapshot historySnapshot;
+	std::vector<std::string> historySerials;
+	std::string historySerial;
+	uint64_t historyTotal = 0;
+	int historyWidth = 0;
+	std::vector<float> historyPlots[radiosonde::FlightHistory::FIELD_COUNT];
 	GPXWriter gpxWriter;
+	GPXTrackSet gpxTracks;
+	bool gpxPerSerial;      /* One GPX file per sonde, instead of a single one */
+	radiosonde::SegmentPolicy logSegments;  /* How the CSV and binary logs are split */
 	PTUWriter ptuWriter;
+	FlightLogWriter flightLogWriter;
+	NetWriter netWriter;
+	bool mergeOutput = false;               /* Dedup frames with the other instances before writing them */
+	std::atomic<int> mergeSource;           /* Source ID in the shared merger, -1 when not merging */
+	std::mutex writerMtx;
+	radiosonde::AsyncWriter outputWriter;
+	int flushInterval, flushSize;
+	time_t lastCheckpoint = 0;
+
+	/* Instrumentation: counters from every decoder and from the writer,
+	 * shown in the menu and optionally exported to a Prometheus text file */
+	struct MetricsEntry {
+		std::string name;
+		const char *block;      /* "decoder" or "receiver" */
+		const char *type;
+		double frequency;       /* 0 for the narrowband decoders */
+		radiosonde::BlockMetrics::Snapshot metrics;
+	};
+	struct StatsRow {
+		std::string name;
+		float cpu, idle;        /* Fraction of one core spent processing/waiting over the last update */
+		float calls;            /* Buffers or batches processed per second */
+		float latency;          /* Average time spent waiting for a batch to fill, in ms */
+		uint64_t frames, badFrames;
+	};
+	radiosonde::MetricsExporter metricsExporter;
+	std::vector<MetricsEntry> statsEntries;
+	std::vector<StatsRow> statsRows;
+	std::unordered_map<std::string, radiosonde::BlockMetrics::Snapshot> statsPrev;
+	uint64_t statsLastUpdate = 0;
+	double writerBusy = 0;
+	uint64_t writerPrevBusy = 0;
 
 	static void menuHandler(void *ctx);
 	static void sondeDataHandler(SondeFullData *data, void *ctx);
+	static void widebandDataHandler(SondeFullData *data, void *ctx);
+	static void widebandSignalHandler(double frequency, float width, void *ctx);
+	static void writeData(void *ctx, SondeFullData *data);
+	static void writeBatch(const SondeFullData *data, int count, void *ctx);
+	static void flushOutput(void *ctx);
 	static void onTypeSelected(void *ctx, int selection);
+	static void saveSelectedType(void *ctx, bool force);
+	static void applyAfc(void *ctx);
+	static radiosonde::DecoderBase *getDecoder(void *ctx, int type);
+	static void releaseIdleDecoders(void *ctx);
+	static void startAutoDetect(void *ctx);
+	static void stopAutoDetect(void *ctx, int keep);
+	static void startNarrowband(void *ctx);
+	static void stopNarrowband(void *ctx);
+	static void startWideband(void *ctx);
+	static void stopWideband(void *ctx);
+	static void onWidebandChanged(void *ctx);
+	static void onNativeRateChanged(void *ctx);
+	static void saveWidebandChannels(void *ctx);
+	static void onScannerChanged(void *ctx);
+	static void widebandMenu(void *ctx);
 	static void onGPXOutputChanged(void *ctx);
 	static void onPTUOutputChanged(void *ctx);
+	static void onFlightLogOutputChanged(void *ctx);
+	static void onLogSegmentsChanged(void *ctx);
+	static void onNetOutputChanged(void *ctx);
+	static void onMergeOutputChanged(void *ctx);
+	static void mergedDataHandler(const SondeFullData *data, void *ctx);
+	static void onMetricsOutputChanged(void *ctx);
+	static void gatherMetrics(void *ctx, std::vector<MetricsEntry> &entries);
+	static void collectMetrics(radiosonde::MetricSet *set, void *ctx);
+	static void updateStats(void *ctx);
+	static void statsMenu(void *ctx);
+	static void profileMenu(void *ctx);
+	static void threadsMenu(void *ctx);
+	static void applySchedules(void *ctx);
+	static void applyBatching(void *ctx);
+	static void widebandSchedules(void *ctx, std::vector<radiosonde::ThreadSchedule> &schedules);
 };
@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <string.h>
+#include "merger.hpp"
+
+#define DEFAULT_WINDOW 1500         /* Milliseconds, enough for a few frames of network and DSP latency */
+#define SONDE_TIMEOUT 600           /* Seconds after which a silent sonde is forgotten */
+#define RESET_THRESHOLD 1000        /* Frames behind the last one emitted, past which the sonde is assumed to have restarted */
+
+using namespace radiosonde;
+
+FrameMerger::FrameMerger()
+{
+	m_nextId = 0;
+	m_running = false;
+	m_window = DEFAULT_WINDOW;
+}
+
+FrameMerger::~FrameMerger()
+{
+	std::unique_lock<std::mutex> lck(m_mtx);
+
+	if (!m_running) return;
+	m_running = false;
+	lck.unlock();
+	m_cv.notify_one();
+	m_thread.join();
+}
+
+int
+FrameMerger::addSource(void (*emit)(const SondeFullData *data, void *ctx), void *ctx)
+{
+	Source source;
+	int id;
+
+	source.emit = emit;
+	source.ctx = ctx;
+	{
+		std::lock_guard<std::mutex> lck(m_sourceMtx);
+		id = m_nextId++;
+		m_sources[id] = source;
+	}
+
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (!m_running) {
+		m_running = true;
+		m_thread = std::thread(&FrameMerger::workerLoop, this);
+	}
+	return id;
+}
+
+void
+FrameMerger::removeSource(int id)
+{
+	std::vector<std::pair<int, SondeFullData>> ready;
+	bool last;
+
+	/* Flush whatever is pending, the source might own some of it */
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		expire(std::chrono::steady_clock::now(), true, ready);
+	}
+	emit(ready);
+
+	{
+		std::lock_guard<std::mutex> lck(m_sourceMtx);
+		m_sources.erase(id);
+		last = m_sources.empty();
+	}
+
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		for (auto &sonde : m_sondes) {
+			if (sonde.second.owner == id) sonde.second.owner = -1;
+		}
+		if (!last || !m_running) return;
+
+		/* Nobody left to write to */
+		m_running = false;
+		m_pending.clear();
+		m_sondes.clear();
+	}
+	m_cv.notify_one();
+	m_thread.join();
+}
+
+void
+FrameMerger::push(const SondeFullData &data, int source)
+{
+	const auto now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lck(m_mtx);
+	Key key;
+
+	if (!data.serial[0] || !m_running) return;
+
+	/* Decoders without frame numbers still timestamp every frame */
+	key.serial = data.serial;
+	key.frame = data.fields & HAS_SEQ ? data.seq : (int64_t)data.time;
+
+	auto sonde = m_sondes.find(key.serial);
+	if (sonde == m_sondes.end()) {
+		sonde = m_sondes.insert(std::make_pair(key.serial, Sonde())).first;
+	}
+	if (sonde->second.owner < 0) sonde->second.owner = source;
+	sonde->second.lastSeen = now;
+
+	auto pending = m_pending.find(key);
+	if (pending != m_pending.end()) {
+		mergeFields(&pending->second.data, &data);
+		m_merged.add(1);
+		return;
+	}
+
+	/* Late fragment of a frame that is already out */
+	if (sonde->second.emitted && key.frame <= sonde->second.lastEmitted && sonde->second.lastEmitted - key.frame < RESET_THRESHOLD) {
+		m_duplicates.add(1);
+		return;
+	}
+
+	Pending entry;
+	entry.data = data;
+	entry.deadline = now + std::chrono::milliseconds(m_window);
+	m_pending.insert(std::make_pair(key, entry));
+}
+
+void
+FrameMerger::setWindow(int window)
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_window = std::max(0, window);
+	}
+	m_cv.notify_one();
+}
+
+/* Private methods {{{ */
+void
+FrameMerger::workerLoop()
+{
+	std::vector<std::pair<int, SondeFullData>> ready;
+	std::unique_lock<std::mutex> lck(m_mtx);
+
+	while (m_running) {
+		/* Woken up early by stop requests and window changes */
+		m_cv.wait_for(lck, std::chrono::milliseconds(std::max(10, m_window / 4)));
+		if (!m_running) break;
+
+		expire(std::chrono::steady_clock::now(), false, ready);
+		if (ready.empty()) continue;
+
+		/* Call back without holding the index lock, so that pushes can go on */
+		lck.unlock();
+		emit(ready);
+		ready.clear();
+		lck.lock();
+	}
+}
+
+void
+FrameMerger::emit(const std::vector<std::pair<int, SondeFullData>> &ready)
+{
+	std::lock_guard<std::mutex> lck(m_sourceMtx);
+
+	for (auto &frame : ready) {
+		auto source = m_sources.find(frame.first);
+		if (source != m_sources.end()) source->second.emit(&frame.second, source->second.ctx);
+	}
+}
+
+/**
+ * Move the frames whose reorder window is over (or all of them) to ready,
+ * together with any older pending frame of the same sonde, in frame order.
+ * Called with m_mtx held.
+ */
+void
+FrameMerger::expire(std::chrono::steady_clock::time_point now, bool all, std::vector<std::pair<int, SondeFullData>> &ready)
+{
+	std::unordered_map<std::string, int64_t> newest;
+	std::vector<std::pair<Key, SondeFullData>> frames;
+
+	for (auto &pending : m_pending) {
+		if (!all && pending.second.deadline > now) continue;
+
+		auto it = newest.find(pending.first.serial);
+		if (it == newest.end()) newest[pending.first.serial] = pending.first.frame;
+		else it->second = std::max(it->second, pending.first.frame);
+	}
+
+	for (auto it = m_pending.begin(); it != m_pending.end(); ) {
+		auto limit = newest.find(it->first.serial);
+		if (limit == newest.end() || it->first.frame > limit->second) {
+			it++;
+			continue;
+		}
+		frames.push_back(std::make_pair(it->first, it->second.data));
+		it = m_pending.erase(it);
+	}
+
+	std::sort(frames.begin(), frames.end(), [](const std::pair<Key, SondeFullData> &a, const std::pair<Key, SondeFullData> &b) {
+		return a.first.serial != b.first.serial ? a.first.serial < b.first.serial : a.first.frame < b.first.frame;
+	});
+	for (auto &frame : frames) {
+		Sonde &sonde = m_sondes[frame.first.serial];
+
+		sonde.emitted = true;
+		sonde.lastEmitted = frame.first.frame;
+		ready.push_back(std::make_pair(sonde.owner, frame.second));
+	}
+
+	/* Forget about sondes that went silent, so that the index stays small */
+	for (auto it = m_sondes.begin(); it != m_sondes.end(); ) {
+		if (now - it->second.lastSeen > std::chrono::seconds(SONDE_TIMEOUT)) it = m_sondes.erase(it);
+		else it++;
+	}
+}
+
+/* Fill in the groups of fields dst did not receive from src */
+void
+FrameMerger::mergeFields(SondeFullData *dst, const SondeFullData *src)
+{
+	const int missing = src->fields & ~dst->fields;
+
+	if (missing & HAS_POS) {
+		dst->lat = src->lat;
+		dst->lon = src->lon;
+		dst->alt = src->alt;
+	}
+	if (missing & HAS_SPEED) {
+		dst->spd = src->spd;
+		dst->hdg = src->hdg;
+		dst->climb = src->climb;
+	}
+	if (missing & HAS_TIME) dst->time = src->time;
+	if (missing & HAS_PTU) {
+		dst->temp = src->temp;
+		dst->rh = src->rh;
+		dst->dewpt = src->dewpt;
+		dst->pressure = src->pressure;
+		dst->calibrated = src->calibrated;
+		dst->calib_percent = src->calib_percent;
+	}
+	if (missing & HAS_SHUTDOWN) dst->burstkill = src->burstkill;
+	if (missing & HAS_AUX) dst->aux = src->aux;
+	dst->fields |= src->fields;
+	dst->changed |= src->changed & missing;
+}
+/* }}} */
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "decode/common.hpp"
+#include "metrics.hpp"
+
+namespace radiosonde {
+	/**
+	 * Combines the frames reported by several decoders (e.g. one SDR++ instance
+	 * per antenna) into a single deduplicated stream.
+	 *
+	 * Fragments are indexed by (serial, frame number), and held for a short
+	 * reorder window. Fields that one source did not receive (see
+	 * SondeFullData::fields) are filled in from the others, then the merged
+	 * frame is emitted exactly once. Fragments for frames that were already
+	 * emitted are dropped.
+	 *
+	 * Each sonde is assigned to the first source that reported it, and its
+	 * merged frames are handed to that source's callback, so that every sonde
+	 * ends up in the output files of exactly one source.
+	 */
+	class FrameMerger {
+	public:
+		FrameMerger();
+		~FrameMerger();
+
+		/**
+		 * Register a source. The merger thread runs while there is at least one.
+		 *
+		 * @param emit function to call, from the merger thread, with the merged
+		 *        frames of the sondes assigned to this source
+		 * @param ctx opaque pointer passed to the callback function
+		 * @return source ID
+		 */
+		int addSource(void (*emit)(const SondeFullData *data, void *ctx), void *ctx);
+
+		/**
+		 * Unregister a source. Its sondes are reassigned to the next source
+		 * that reports them. Once this returns, its callback is not called again.
+		 *
+		 * @param id source ID, as returned by addSource()
+		 */
+		void removeSource(int id);
+
+		/**
+		 * Submit a fragment. Fragments without a serial number are ignored.
+		 * Never calls the emit callbacks.
+		 *
+		 * @param data decoded data
+		 * @param source ID of the source submitting the fragment
+		 */
+		void push(const SondeFullData &data, int source);
+
+		/**
+		 * Set the reorder window.
+		 *
+		 * @param window time fragments are held for before being emitted, in milliseconds
+		 */
+		void setWindow(int window);
+
+		uint64_t merged() const { return m_merged.get(); }          /* Fragments merged into a pending frame */
+		uint64_t duplicates() const { return m_duplicates.get(); }  /* Fragments for frames already emitted */
+
+	private:
+		struct Key {
+			std::string serial;
+			int64_t frame;
+
+			bool operator==(const Key &other) const { return frame == other.frame && serial == other.serial; }
+		};
+		struct KeyHash {
+			size_t operator()(const Key &key) const { return std::hash<std::string>()(key.serial) ^ std::hash<int64_t>()(key.frame) * 31; }
+		};
+		struct Pending {
+			SondeFullData data;
+			std::chrono::steady_clock::time_point deadline;
+		};
+		struct Sonde {
+			Sonde() : owner(-1), lastEmitted(0), emitted(false) {}
+
+			int owner;
+			int64_t lastEmitted;
+			bool emitted;
+			std::chrono::steady_clock::time_point lastSeen;
+		};
+		struct Source {
+			void (*emit)(const SondeFullData *data, void *ctx);
+			void *ctx;
+		};
+
+		void workerLoop();
+		void expire(std::chrono::steady_clock::time_point now, bool all, std::vector<std::pair<int, SondeFullData>> &ready);
+		void emit(const std::vector<std::pair<int, SondeFullData>> &ready);
+		static void mergeFields(SondeFullData *dst, const SondeFullData *src);
+
+		std::mutex m_mtx;               /* Protects the pending frames and the sondes */
+		std::unordered_map<Key, Pending, KeyHash> m_pending;
+		std::unordered_map<std::string, Sonde> m_sondes;
+
+		std::mutex m_sourceMtx;         /* Held while calling the emit callbacks */
+		std::map<int, Source> m_sources;
+		int m_nextId;
+
+		std::thread m_thread;
+		std::condition_variable m_cv;
+		bool m_running;
+		int m_window;
+		Counter m_merged, m_duplicates;
+	};
+}
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include "metrics.hpp"
+
+using namespace radiosonde;
+
+void
+MetricSet::add(const char *name, const char *type, const char *help, const std::string &labels, double value)
+{
+	char buf[64];
+	Family *family = NULL;
+
+	for (auto &f : m_families) {
+		if (f.name == name) {
+			family = &f;
+			break;
+		}
+	}
+	if (!family) {
+		m_families.push_back(Family());
+		family = &m_families.back();
+		family->name = name;
+		family->type = type;
+		family->help = help;
+	}
+
+	snprintf(buf, sizeof(buf), " %.17g", value);
+	family->samples.push_back(family->name + (labels.empty() ? "" : "{" + labels + "}") + buf);
+}
+
+std::string
+MetricSet::label(const std::vector<std::pair<const char*, std::string>> &labels)
+{
+	std::string out;
+
+	for (auto &label : labels) {
+		if (!out.empty()) out += ",";
+		out += label.first;
+		out += "=\"";
+		for (char c : label.second) {
+			switch (c) {
+				case '\\': out += "\\\\"; break;
+				case '"': out += "\\\""; break;
+				case '\n': out += "\\n"; break;
+				default: out += c; break;
+			}
+		}
+		out += "\"";
+	}
+	return out;
+}
+
+std::string
+MetricSet::format() const
+{
+	std::string out;
+
+	for (auto &family : m_families) {
+		out += "# HELP " + family.name + " " + family.help + "\n";
+		out += "# TYPE " + family.name + " " + family.type + "\n";
+		for (auto &sample : family.samples) out += sample + "\n";
+	}
+	return out;
+}
+
+bool
+MetricSet::write(const char *fname) const
+{
+	const std::string tmpName = std::string(fname) + ".tmp";
+	const std::string text = format();
+	FILE *fd;
+	bool ok;
+
+	if (!(fd = fopen(tmpName.c_str(), "wb"))) return false;
+	ok = fwrite(text.data(), 1, text.size(), fd) == text.size();
+	ok &= !fclose(fd);
+
+#ifdef _WIN32
+	/* rename() does not overwrite existing files on Windows */
+	if (ok) remove(fname);
+#endif
+	if (!ok || rename(tmpName.c_str(), fname)) {
+		remove(tmpName.c_str());
+		return false;
+	}
+	return true;
+}
+
+MetricsExporter::MetricsExporter()
+{
+	m_interval = 0;
+	m_collect = NULL;
+	m_ctx = NULL;
+	m_running = false;
+}
+
+void
+MetricsExporter::init(const char *fname, int interval, void (*collect)(MetricSet *set, void *ctx), void *ctx)
+{
+	if (m_running) deinit();
+
+	m_fname = fname;
+	m_interval = interval > 0 ? interval : 1;
+	m_collect = collect;
+	m_ctx = ctx;
+
+	m_running = true;
+	m_thread = std::thread(&MetricsExporter::workerLoop, this);
+}
+
+void
+MetricsExporter::deinit()
+{
+	if (!m_running) return;
+
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_running = false;
+	}
+	m_cv.notify_one();
+	m_thread.join();
+}
+
+/* Private methods {{{ */
+void
+MetricsExporter::workerLoop()
+{
+	std::unique_lock<std::mutex> lck(m_mtx);
+
+	while (m_running) {
+		lck.unlock();
+		m_set.clear();
+		m_collect(&m_set, m_ctx);
+		m_set.write(m_fname.c_str());
+		lck.lock();
+
+		m_cv.wait_for(lck, std::chrono::milliseconds(m_interval), [this]{ return !m_running; });
+	}
+}
+/* }}} */
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace radiosonde {
+	/**
+	 * Monotonic counter, updated by a single thread and read from any other.
+	 * Updates are plain relaxed loads and stores, so that they cost the same as
+	 * incrementing a regular integer.
+	 */
+	class Counter {
+	public:
+		Counter() { m_value = 0; };
+
+		void add(uint64_t value) { m_value.store(m_value.load(std::memory_order_relaxed) + value, std::memory_order_relaxed); };
+		uint64_t get() const { return m_value.load(std::memory_order_relaxed); };
+
+	private:
+		std::atomic<uint64_t> m_value;
+	};
+
+	/**
+	 * Monotonic timestamp, in nanoseconds
+	 */
+	static inline uint64_t nowNs() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	/**
+	 * Counters for a block that consumes a stream of samples
+	 */
+	struct BlockMetrics {
+		struct Snapshot {
+			uint64_t samples, blocks, reads, busyNs, waitNs, latencyNs, frames, badFrames;
+		};
+
+		Counter samples;        /* Input samples processed */
+		Counter blocks;         /* Input buffers (or batches of them) processed */
+		Counter reads;          /* Input buffers read from a stream */
+		Counter busyNs;         /* Time spent processing the input */
+		Counter waitNs;         /* Time spent waiting for input to be available */
+		Counter latencyNs;      /* Time the oldest sample of each batch waited for it to fill */
+		Counter frames;         /* Frames reported */
+		Counter badFrames;      /* Frames that were parsed, but did not contain any valid data */
+
+		void snapshot(Snapshot *out) const {
+			out->samples = samples.get();
+			out->blocks = blocks.get();
+			out->reads = reads.get();
+			out->busyNs = busyNs.get();
+			out->waitNs = waitNs.get();
+			out->latencyNs = latencyNs.get();
+			out->frames = frames.get();
+			out->badFrames = badFrames.get();
+		};
+	};
+
+	/**
+	 * Set of metrics in the Prometheus text exposition format. Samples can be
+	 * added in any order, they are grouped by metric name when formatted.
+	 */
+	class MetricSet {
+	public:
+		void clear() { m_families.clear(); };
+
+		/**
+		 * Add a sample to the set.
+		 *
+		 * @param name metric name (e.g. radiosonde_decoder_samples_total)
+		 * @param type metric type ("counter" or "gauge")
+		 * @param help description of the metric
+		 * @param labels label set, formatted with label(), or an empty string
+		 * @param value value of the sample
+		 */
+		void add(const char *name, const char *type, const char *help, const std::string &labels, double value);
+
+		/**
+		 * Format a label set.
+		 *
+		 * @param labels (name, value) pairs. Values are escaped as needed
+		 * @return label set, without the enclosing braces
+		 */
+		static std::string label(const std::vector<std::pair<const char*, std::string>> &labels);
+
+		std::string format() const;
+
+		/**
+		 * Atomically replace a file with the contents of the set, so that
+		 * scrapers never see a partial file.
+		 *
+		 * @param fname path to the file
+		 * @return true on success, false otherwise
+		 */
+		bool write(const char *fname) const;
+
+	private:
+		struct Family {
+			std::string name, type, help;
+			std::vector<std::string> samples;
+		};
+		std::vector<Family> m_families;
+	};
+
+	/**
+	 * Periodically collects a set of metrics and writes it to file, from a
+	 * thread of its own, so that the file keeps being updated even when
+	 * nothing else is happening.
+	 */
+	class MetricsExporter {
+	public:
+		MetricsExporter();
+		~MetricsExporter() { deinit(); };
+
+		/**
+		 * Start the exporter thread.
+		 *
+		 * @param fname path to the file to write
+		 * @param interval time between updates, in milliseconds
+		 * @param collect function to call to fill in the metrics
+		 * @param ctx opaque pointer passed to the callback function
+		 */
+		void init(const char *fname, int interval, void (*collect)(MetricSet *set, void *ctx), void *ctx);
+		void deinit();
+
+		bool isRunning() const { return m_running; };
+
+	private:
+		void workerLoop();
+
+		std::string m_fname;
+		int m_interval;
+		void (*m_collect)(MetricSet *set, void *ctx);
+		void *m_ctx;
+		MetricSet m_set;
+
+		std::thread m_thread;
+		std::mutex m_mtx;
+		std::condition_variable m_cv;
+		bool m_running;
+	};
+}
@@ -0,0 +1,338 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+#include "flightlog.hpp"
+#include "netwriter.hpp"
+
+#define CLIENT_BUFFER_SIZE 65536    /* Pending bytes after which a TCP client is considered stuck */
+#define LISTEN_BACKLOG 8
+
+#ifdef _WIN32
+#define close_socket closesocket
+#define WOULD_BLOCK (WSAGetLastError() == WSAEWOULDBLOCK)
+#define SEND_FLAGS 0
+#else
+#define close_socket close
+#define WOULD_BLOCK (errno == EAGAIN || errno == EWOULDBLOCK)
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL     /* Report closed connections as errors instead of SIGPIPE */
+#else
+#define SEND_FLAGS 0
+#endif
+#endif
+
+static bool resolve(const char *address, bool passive, struct sockaddr_storage *addr, socklen_t *len);
+static bool set_nonblocking(intptr_t fd);
+static void put_string(std::string &out, const char *key, const char *value);
+static void put_number(std::string &out, const char *key, double value, int decimals);
+
+NetWriter::NetWriter()
+{
+	m_fd = -1;
+	m_transport = TRANSPORT_UDP;
+	m_format = FORMAT_JSON;
+	m_count = 0;
+	m_sent = m_dropped = 0;
+}
+
+bool
+NetWriter::init(const char *address, int transport, int format)
+{
+	struct sockaddr_storage addr;
+	socklen_t len = 0;
+	const int one = 1;
+
+	if (m_fd >= 0) deinit();
+
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData)) return false;
+#endif
+
+	m_transport = transport;
+	m_format = format;
+	m_count = 0;
+	m_sent = m_dropped = 0;
+
+	if (!resolve(address, transport == TRANSPORT_TCP, &addr, &len)) goto fail;
+	if ((m_fd = socket(addr.ss_family, transport == TRANSPORT_TCP ? SOCK_STREAM : SOCK_DGRAM, 0)) < 0) goto fail;
+	if (!set_nonblocking(m_fd)) goto fail;
+
+	if (transport == TRANSPORT_TCP) {
+		setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+		if (bind(m_fd, (struct sockaddr*)&addr, len)) goto fail;
+		if (listen(m_fd, LISTEN_BACKLOG)) goto fail;
+	} else {
+		/* Allow sending to broadcast addresses. Multicast needs no special
+		 * setup, the default TTL of 1 keeps it on the local network */
+		setsockopt(m_fd, SOL_SOCKET, SO_BROADCAST, (const char*)&one, sizeof(one));
+		m_addr.assign((uint8_t*)&addr, (uint8_t*)&addr + len);
+	}
+	return true;
+
+fail:
+	if (m_fd >= 0) {
+		deinit();
+	} else {
+#ifdef _WIN32
+		WSACleanup();
+#endif
+	}
+	return false;
+}
+
+void
+NetWriter::deinit()
+{
+	if (m_fd < 0) return;
+
+	for (auto &client : m_clients) close_socket(client.fd);
+	m_clients.clear();
+	close_socket(m_fd);
+	m_fd = -1;
+	m_addr.clear();
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+void
+NetWriter::addPoint(const SondeFullData *data)
+{
+	if (m_fd < 0) return;
+
+	/* Message buffers are reused from one batch to the next */
+	if (m_count == (int)m_messages.size()) m_messages.emplace_back();
+	format(data, m_messages[m_count++]);
+}
+
+void
+NetWriter::flush()
+{
+	if (m_fd < 0) return;
+
+	if (m_transport == TRANSPORT_TCP) {
+		acceptClients();
+
+		/* Coalesce the whole batch into a single send per client */
+		for (auto it = m_clients.begin(); it != m_clients.end(); ) {
+			for (int i=0; i<m_count; i++) it->pending += m_messages[i];
+			if (!sendPending(&*it)) {
+				close_socket(it->fd);
+				it = m_clients.erase(it);
+			} else {
+				it++;
+			}
+		}
+		m_sent += m_count;
+	} else {
+		for (int i=0; i<m_count; i++) {
+			const std::string &msg = m_messages[i];
+			if (sendto(m_fd, msg.data(), msg.size(), SEND_FLAGS, (const struct sockaddr*)m_addr.data(), m_addr.size()) < 0) {
+				m_dropped++;
+			} else {
+				m_sent++;
+			}
+		}
+	}
+
+	m_count = 0;
+}
+
+/* Private methods {{{ */
+void
+NetWriter::acceptClients()
+{
+	Client client;
+	intptr_t fd;
+
+	while ((fd = accept(m_fd, NULL, NULL)) >= 0) {
+		if (!set_nonblocking(fd)) {
+			close_socket(fd);
+			continue;
+		}
+		client.fd = fd;
+		m_clients.push_back(client);
+	}
+}
+
+/**
+ * Send as much of a client's pending data as the kernel accepts.
+ *
+ * @return false if the client should be disconnected
+ */
+bool
+NetWriter::sendPending(Client *client)
+{
+	long count;
+
+	while (!client->pending.empty()) {
+		count = send(client->fd, client->pending.data(), client->pending.size(), SEND_FLAGS);
+		if (count < 0) {
+			if (!WOULD_BLOCK) return false;
+			break;
+		}
+		client->pending.erase(0, count);
+	}
+
+	/* Slow client: give up on it rather than buffering forever */
+	if (client->pending.size() > CLIENT_BUFFER_SIZE) {
+		m_dropped++;
+		return false;
+	}
+	return true;
+}
+
+void
+NetWriter::format(const SondeFullData *data, std::string &out)
+{
+	uint8_t header[NETWRITER_HEADER_SIZE] = {0};
+	uint8_t record[FLIGHTLOG_RECORD_SIZE];
+	const uint16_t version = FLIGHTLOG_VERSION;
+	const uint16_t size = sizeof(header) + sizeof(record);
+	char timestr[32];
+	struct tm *tm;
+
+	out.clear();
+
+	if (m_format == FORMAT_BINARY) {
+		memcpy(header, NETWRITER_MAGIC, 4);
+		header[4] = version;
+		header[5] = version >> 8;
+		header[6] = size;
+		header[7] = size >> 8;
+		memcpy(&header[8], data->serial, strnlen(data->serial, SERIAL_MAXLEN - 1));
+		encodeFlightLogFrame(record, data, FLIGHTLOG_NO_SERIAL);
+
+		out.append((const char*)header, sizeof(header));
+		out.append((const char*)record, sizeof(record));
+		return;
+	}
+
+	tm = gmtime(&data->time);
+
+	out += "{";
+	put_string(out, "type", "PAYLOAD_SUMMARY");
+	put_string(out, "callsign", data->serial);
+	put_number(out, "latitude", data->lat, 5);
+	put_number(out, "longitude", data->lon, 5);
+	put_number(out, "altitude", data->alt, 1);
+	put_number(out, "speed", data->spd * 3.6, 1);     /* km/h */
+	put_number(out, "heading", data->hdg, 1);
+	put_number(out, "vel_v", data->climb, 1);
+	strftime(timestr, sizeof(timestr), "%H:%M:%S", tm);
+	put_string(out, "time", timestr);
+	strftime(timestr, sizeof(timestr), "%Y-%m-%dT%H:%M:%SZ", tm);
+	put_string(out, "datetime", timestr);
+	put_number(out, "frame", data->seq, 0);
+	put_number(out, "temp", data->temp, 1);
+	put_number(out, "humidity", data->rh, 1);
+	put_number(out, "dewpoint", data->dewpt, 1);
+	put_number(out, "pressure", data->pressure, 2);
+	put_number(out, "calib_percent", data->calib_percent, 0);
+	if (data->burstkill > 0) put_number(out, "burst_timer", data->burstkill, 0);
+	if (data->aux.type == AUX_OZONE) put_number(out, "o3_mpa", data->aux.ozone.o3_mpa, 2);
+	put_string(out, "comment", data->calibrated ? "Radiosonde" : "Radiosonde (uncalibrated)");
+	out.back() = '}';
+	out += "\n";
+}
+/* }}} */
+
+/* Static functions {{{ */
+static bool
+resolve(const char *address, bool passive, struct sockaddr_storage *addr, socklen_t *len)
+{
+	struct addrinfo hints, *res;
+	const char *sep = strrchr(address, ':');
+	std::string host, port;
+	bool ok;
+
+	/* [host:]port, the host is mandatory for outgoing sockets */
+	if (sep) {
+		host.assign(address, sep - address);
+		port = sep + 1;
+	} else {
+		port = address;
+	}
+	if (host.size() >= 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+	if (port.empty() || (host.empty() && !passive)) return false;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = passive ? SOCK_STREAM : SOCK_DGRAM;
+	hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+	if (getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &res)) return false;
+	ok = res->ai_addrlen <= sizeof(*addr);
+	if (ok) {
+		memcpy(addr, res->ai_addr, res->ai_addrlen);
+		*len = res->ai_addrlen;
+	}
+	freeaddrinfo(res);
+	return ok;
+}
+
+static bool
+set_nonblocking(intptr_t fd)
+{
+#ifdef _WIN32
+	u_long mode = 1;
+	return !ioctlsocket(fd, FIONBIO, &mode);
+#else
+	const int flags = fcntl(fd, F_GETFL, 0);
+	return flags >= 0 && !fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+static void
+put_string(std::string &out, const char *key, const char *value)
+{
+	char buf[8];
+
+	out += "\"";
+	out += key;
+	out += "\":\"";
+	for (; *value; value++) {
+		switch (*value) {
+			case '"': out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			default:
+				if ((unsigned char)*value < 0x20) {
+					snprintf(buf, sizeof(buf), "\\u%04x", *value);
+					out += buf;
+				} else {
+					out += *value;
+				}
+				break;
+		}
+	}
+	out += "\",";
+}
+
+static void
+put_number(std::string &out, const char *key, double value, int decimals)
+{
+	char buf[64];
+
+	/* JSON has no representation for NaN/infinity */
+	if (isfinite(value)) {
+		snprintf(buf, sizeof(buf), "\"%s\":%.*f,", key, decimals, value);
+	} else {
+		snprintf(buf, sizeof(buf), "\"%s\":null,", key);
+	}
+	out += buf;
+}
+/* }}} */
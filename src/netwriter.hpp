@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "decode/common.hpp"
+
+#define NETWRITER_MAGIC "SNDF"
+#define NETWRITER_HEADER_SIZE 40    /* Magic, u16 version, u16 message size, serial */
+
+/**
+ * Network sink, the push counterpart to the file writers. Every frame is
+ * published either as a JSON object, one per line/datagram, or as a binary
+ * message:
+ *
+ * JSON:    a Horus UDP "PAYLOAD_SUMMARY" packet (as consumed by chasemapper
+ *          and OziMux), with a few extra PTU fields
+ * Binary:  magic "SNDF", u16 version, u16 message size, char serial[SERIAL_MAXLEN],
+ *          followed by a flight log frame record (see flightlog.hpp)
+ *
+ * Frames can be sent as UDP datagrams (unicast, broadcast or multicast) or
+ * streamed to any number of TCP clients connecting to a listening socket.
+ * All sockets are non-blocking: datagrams that cannot be sent right away are
+ * dropped, and TCP clients that do not keep up are disconnected, so that the
+ * caller is never stalled.
+ */
+class NetWriter {
+public:
+	enum Transport {
+		TRANSPORT_UDP = 0,      /* Send datagrams to host:port */
+		TRANSPORT_TCP = 1,      /* Listen on [host:]port, stream to all clients */
+	};
+	enum Format {
+		FORMAT_JSON = 0,
+		FORMAT_BINARY = 1,
+	};
+
+	NetWriter();
+	~NetWriter() { deinit(); };
+
+	/**
+	 * Open the socket.
+	 *
+	 * @param address host:port to send to (UDP) or [host:]port to listen on (TCP)
+	 * @param transport one of Transport
+	 * @param format one of Format
+	 * @return true on success, false otherwise
+	 */
+	bool init(const char *address, int transport, int format);
+	void deinit();
+
+	/**
+	 * Queue a frame to be sent.
+	 *
+	 * @param data frame to send
+	 */
+	void addPoint(const SondeFullData *data);
+
+	/**
+	 * Send all the queued frames, and accept new TCP clients
+	 */
+	void flush();
+
+	int clients() const { return m_clients.size(); }
+	uint64_t sent() const { return m_sent; }
+	uint64_t dropped() const { return m_dropped; }
+
+private:
+	struct Client {
+		intptr_t fd;
+		std::string pending;    /* Data the kernel did not accept yet */
+	};
+
+	void acceptClients();
+	bool sendPending(Client *client);
+	void format(const SondeFullData *data, std::string &out);
+
+	intptr_t m_fd;
+	int m_transport, m_format;
+	std::vector<uint8_t> m_addr;        /* Destination, for UDP */
+	std::vector<Client> m_clients;
+	std::vector<std::string> m_messages;
+	int m_count;
+	uint64_t m_sent, m_dropped;
+};
@@ -1,35 +1,61 @@
+#include <string.h>
 #include "ptu.hpp"
 
+#define PTU_HEADER "Epoch,Temperature,Relative humidity,Dew point,Pressure,Latitude,Longitude,Altitude,Speed,Heading,Climb,XDATA,Ozone\n"
+
 bool
-PTUWriter::init(const char *fname)
+PTUWriter::init(const char *fname, const radiosonde::SegmentPolicy &policy)
 {
-	if (m_fd) deinit();
-
-	m_fd = fopen(fname, "wb");
-	if(!m_fd) return false;
+	char header[sizeof(PTU_HEADER)];
+	size_t len;
+	FILE *fd;
 
-	fprintf(m_fd, "Epoch,Temperature,Relative humidity,Dew point,Pressure,Latitude,Longitude,Altitude,Speed,Heading,Climb,XDATA\n");
+	/* Only append to a log with the same columns: rows from an older version
+	 * (e.g. without the Ozone column) are kept aside instead */
+	if (!policy.segmented() && (fd = fopen(fname, "rb"))) {
+		len = fread(header, 1, sizeof(PTU_HEADER)-1, fd);
+		fclose(fd);
+		if (len > 0 && (len != sizeof(PTU_HEADER)-1 || memcmp(header, PTU_HEADER, len))) {
+			if (!radiosonde::moveAside(fname)) return false;
+		}
+	}
 
-	return true;
+	return m_file.open(fname, policy, PTU_HEADER, sizeof(PTU_HEADER)-1);
 }
 
 void
 PTUWriter::deinit()
 {
-	if (!m_fd) return;
-	fclose(m_fd);
-	m_fd = NULL;
+	m_file.close();
 }
 
 void
-PTUWriter::addPoint(SondeFullData *data)
+PTUWriter::addPoint(const SondeFullData *data)
 {
-	if (!m_fd) return;
-	fprintf(m_fd, "%ld,%.1f,%.1f,%.1f,%.1f,%.6f,%.6f,%.1f,%.1f,%.1f,%.1f,%s\n",
+	char aux[64];
+	char ozone[16] = "";
+	int len;
+
+	if (!m_file.isOpen()) return;
+	if (!(data->changed & (HAS_PTU | HAS_POS | HAS_AUX))) return;
+
+	/* Freeform column for humans, plus one column per instrument value */
+	formatAuxData(&data->aux, aux, sizeof(aux));
+	if (data->aux.type == AUX_OZONE) snprintf(ozone, sizeof(ozone), "%.2f", data->aux.ozone.o3_mpa);
+
+	len = snprintf(m_buf, sizeof(m_buf), "%ld,%.1f,%.1f,%.1f,%.1f,%.6f,%.6f,%.1f,%.1f,%.1f,%.1f,%s,%s\n",
 			data->time,
 			data->temp, data->rh, data->dewpt, data->pressure,
 			data->lat, data->lon, data->alt,
 			data->spd, data->hdg, data->climb,
-			data->auxData.c_str());
-	fflush(m_fd);
+			aux, ozone);
+	if (len >= (int)sizeof(m_buf)) return;
+	if (m_file.select(data->time, data->serial) < 0) return;
+	m_file.write(m_buf, len);
+}
+
+void
+PTUWriter::flush()
+{
+	m_file.flush();
 }
@@ -3,24 +3,42 @@
 #include <stdio.h>
 #include <time.h>
 #include "decode/common.hpp"
+#include "segment.hpp"
 
 /**
- * Wrapper around a CSV file, containing PTU data as well as time and location data
+ * Wrapper around a CSV file, containing PTU data as well as time and location
+ * data. Rows are appended to the existing file, or split into segments (see
+ * radiosonde::SegmentedFile). An existing file with different columns is
+ * renamed to <fname>.old first.
  */
 class PTUWriter {
 public:
-	PTUWriter() { m_fd = NULL; };
 	~PTUWriter() { deinit(); };
 
-	bool init(const char *fname);
+	/**
+	 * Open the CSV file.
+	 *
+	 * @param fname path to the file
+	 * @param policy how to split the log into segments
+	 * @return true on success, false otherwise
+	 */
+	bool init(const char *fname, const radiosonde::SegmentPolicy &policy = radiosonde::SegmentPolicy());
 	void deinit();
 
 	/**
-	 * Log a new point to file.
+	 * Log a new point to file. Frames that carry the same PTU, position and
+	 * auxiliary data as the previous one (see SondeFullData::changed) are
+	 * skipped.
 	 *
 	 * @param data data to log
 	 */
-	void addPoint(SondeFullData *data);
+	void addPoint(const SondeFullData *data);
+
+	/**
+	 * Commit buffered points to disk
+	 */
+	void flush();
 private:
-	FILE *m_fd;
+	radiosonde::SegmentedFile m_file;
+	char m_buf[512];
 };
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace radiosonde {
+	/**
+	 * Bounded lock-free queue, safe for multiple producers and a single consumer.
+	 * Producers never block: when the queue is full, push() fails immediately.
+	 */
+	template<class T>
+	class BoundedQueue {
+	public:
+		BoundedQueue() : m_cells(NULL), m_mask(0), m_head(0), m_tail(0) {}
+		~BoundedQueue() { delete[] m_cells; }
+
+		/**
+		 * Allocate space for the queue. Not thread-safe.
+		 *
+		 * @param capacity minimum number of elements the queue can hold, rounded
+		 *        up to the next power of two
+		 */
+		void init(size_t capacity) {
+			size_t size = 2;
+
+			while (size < capacity) size *= 2;
+
+			delete[] m_cells;
+			m_cells = new Cell[size];
+			m_mask = size - 1;
+			for (size_t i=0; i<size; i++) m_cells[i].seq.store(i, std::memory_order_relaxed);
+			m_head.store(0, std::memory_order_relaxed);
+			m_tail.store(0, std::memory_order_relaxed);
+		}
+
+		/**
+		 * Append an element to the queue. Can be called from any thread.
+		 *
+		 * @param value element to append
+		 * @return true on success, false if the queue was full
+		 */
+		bool push(const T &value) {
+			size_t pos = m_head.load(std::memory_order_relaxed);
+			Cell *cell;
+
+			if (!m_cells) return false;
+			for (;;) {
+				cell = &m_cells[pos & m_mask];
+				const intptr_t diff = (intptr_t)cell->seq.load(std::memory_order_acquire) - (intptr_t)pos;
+
+				if (diff == 0) {
+					if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+				} else if (diff < 0) {
+					return false;
+				} else {
+					pos = m_head.load(std::memory_order_relaxed);
+				}
+			}
+
+			cell->value = value;
+			cell->seq.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		/**
+		 * Remove the oldest element from the queue. Must only be called from
+		 * the consumer thread.
+		 *
+		 * @param value where to store the element
+		 * @return true on success, false if the queue was empty
+		 */
+		bool pop(T &value) {
+			const size_t pos = m_tail.load(std::memory_order_relaxed);
+			Cell *cell;
+
+			if (!m_cells) return false;
+			cell = &m_cells[pos & m_mask];
+			if (cell->seq.load(std::memory_order_acquire) != pos + 1) return false;
+
+			value = cell->value;
+			cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+			m_tail.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		/**
+		 * Number of elements in the queue. Only an estimate while other threads
+		 * are pushing or popping.
+		 */
+		size_t size() const {
+			const size_t tail = m_tail.load(std::memory_order_acquire);
+			const size_t head = m_head.load(std::memory_order_acquire);
+			return head > tail ? head - tail : 0;
+		}
+
+		size_t capacity() const { return m_cells ? m_mask + 1 : 0; }
+
+	private:
+		struct Cell {
+			std::atomic<size_t> seq;
+			T value;
+		};
+
+		Cell *m_cells;
+		size_t m_mask;
+		alignas(64) std::atomic<size_t> m_head;
+		alignas(64) std::atomic<size_t> m_tail;
+	};
+}
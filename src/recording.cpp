@@ -0,0 +1,175 @@
+#include <string.h>
+#include "recording.hpp"
+
+using namespace radiosonde;
+
+/* Little-endian deserialization helpers {{{ */
+static inline uint16_t
+get_u16(const uint8_t *buf)
+{
+	return buf[0] | buf[1] << 8;
+}
+
+static inline uint32_t
+get_u32(const uint8_t *buf)
+{
+	uint32_t val = 0;
+	for (int i=0; i<4; i++) val |= (uint32_t)buf[i] << (8 * i);
+	return val;
+}
+/* }}} */
+
+Recording::Recording()
+{
+	m_fd = NULL;
+	m_stdin = false;
+	m_format = SAMPLE_F32;
+	m_samplerate = 0;
+	m_iq = false;
+	m_dataLeft = -1;
+	m_raw = NULL;
+	m_rawSize = 0;
+}
+
+bool
+Recording::openWAV(const char *fname)
+{
+	uint8_t header[12], chunk[8], fmt[40];
+	uint32_t chunkSize;
+	int audioFormat = -1, channels = 0, bits = 0;
+
+	close();
+	if (!(m_fd = fopen(fname, "rb"))) return false;
+
+	if (fread(header, sizeof(header), 1, m_fd) != 1
+	 || memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4)) {
+		close();
+		return false;
+	}
+
+	/* Walk the chunks until the samples are found */
+	for (;;) {
+		if (fread(chunk, sizeof(chunk), 1, m_fd) != 1) {
+			close();
+			return false;
+		}
+		chunkSize = get_u32(chunk + 4);
+
+		if (!memcmp(chunk, "fmt ", 4)) {
+			const size_t len = chunkSize < sizeof(fmt) ? chunkSize : sizeof(fmt);
+			if (len < 16 || fread(fmt, len, 1, m_fd) != 1) {
+				close();
+				return false;
+			}
+			audioFormat = get_u16(fmt);
+			channels = get_u16(fmt + 2);
+			m_samplerate = get_u32(fmt + 4);
+			bits = get_u16(fmt + 14);
+
+			/* WAVE_FORMAT_EXTENSIBLE: the actual format is in the subformat GUID */
+			if (audioFormat == 0xFFFE && len >= 26) audioFormat = get_u16(fmt + 24);
+
+			fseek(m_fd, chunkSize - len + (chunkSize & 1), SEEK_CUR);
+		} else if (!memcmp(chunk, "data", 4)) {
+			/* Files written while streaming may not have a valid size */
+			m_dataLeft = (chunkSize == 0 || chunkSize == 0xFFFFFFFF) ? -1 : chunkSize;
+			break;
+		} else {
+			fseek(m_fd, chunkSize + (chunkSize & 1), SEEK_CUR);
+		}
+	}
+
+	if (audioFormat == 1 && bits == 8) {
+		m_format = SAMPLE_U8;
+	} else if (audioFormat == 1 && bits == 16) {
+		m_format = SAMPLE_S16;
+	} else if (audioFormat == 3 && bits == 32) {
+		m_format = SAMPLE_F32;
+	} else {
+		close();
+		return false;
+	}
+
+	if ((channels != 1 && channels != 2) || m_samplerate <= 0) {
+		close();
+		return false;
+	}
+	m_iq = channels == 2;
+
+	return true;
+}
+
+bool
+Recording::openRaw(const char *fname, SampleFormat format, double samplerate, bool iq)
+{
+	close();
+	if (samplerate <= 0) return false;
+	if (!strcmp(fname, "-")) {
+		m_fd = stdin;
+		m_stdin = true;
+	} else if (!(m_fd = fopen(fname, "rb"))) {
+		return false;
+	}
+
+	m_format = format;
+	m_samplerate = samplerate;
+	m_iq = iq;
+	m_dataLeft = -1;
+	return true;
+}
+
+void
+Recording::close()
+{
+	if (m_fd && !m_stdin) fclose(m_fd);
+	m_fd = NULL;
+	m_stdin = false;
+
+	delete[] m_raw;
+	m_raw = NULL;
+	m_rawSize = 0;
+}
+
+int
+Recording::read(float *out, int maxCount)
+{
+	const int channels = m_iq ? 2 : 1;
+	const size_t sampleSize = (m_format == SAMPLE_U8 ? 1 : m_format == SAMPLE_S16 ? 2 : 4) * channels;
+	size_t count = maxCount > 0 ? maxCount : 0;
+
+	if (!m_fd) return 0;
+	if (m_dataLeft >= 0 && (size_t)m_dataLeft / sampleSize < count) count = m_dataLeft / sampleSize;
+	if (!count) return 0;
+
+	if (count * sampleSize > m_rawSize) {
+		delete[] m_raw;
+		m_rawSize = count * sampleSize;
+		m_raw = new uint8_t[m_rawSize];
+	}
+
+	count = fread(m_raw, sampleSize, count, m_fd);
+	if (m_dataLeft >= 0) m_dataLeft -= count * sampleSize;
+
+	/* Convert to floats in [-1, 1). IQ pairs are stored interleaved, with the
+	 * same layout as dsp::complex_t */
+	switch (m_format) {
+		case SAMPLE_U8:
+			for (size_t i=0; i<count * channels; i++) {
+				out[i] = (m_raw[i] - 127.5f) / 128.0f;
+			}
+			break;
+		case SAMPLE_S16:
+			for (size_t i=0; i<count * channels; i++) {
+				out[i] = (int16_t)get_u16(m_raw + 2*i) / 32768.0f;
+			}
+			break;
+		case SAMPLE_F32:
+			for (size_t i=0; i<count * channels; i++) {
+				const uint32_t bits = get_u32(m_raw + 4*i);
+				memcpy(out + i, &bits, sizeof(bits));
+			}
+			break;
+	}
+
+	return count;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+namespace radiosonde {
+	/**
+	 * Sample source backed by a file: either a WAV recording, or a headerless
+	 * stream of samples, possibly read from standard input. Samples are
+	 * converted to floats in [-1, 1), with IQ pairs interleaved in the same
+	 * layout as dsp::complex_t.
+	 */
+	class Recording {
+	public:
+		enum SampleFormat {
+			SAMPLE_U8,          /* Unsigned 8-bit, offset binary (rtl_sdr) */
+			SAMPLE_S16,         /* Signed 16-bit, little endian */
+			SAMPLE_F32,         /* 32-bit float, little endian */
+		};
+
+		Recording();
+		~Recording() { close(); };
+
+		/**
+		 * Open a WAV recording. Mono files are treated as FM-demodulated audio,
+		 * stereo files as IQ.
+		 *
+		 * @param fname path to the file
+		 * @return true on success, false otherwise
+		 */
+		bool openWAV(const char *fname);
+
+		/**
+		 * Open a headerless recording.
+		 *
+		 * @param fname path to the file, or "-" for standard input
+		 * @param format format of each sample
+		 * @param samplerate samplerate of the recording, in Hz
+		 * @param iq true if the file contains interleaved IQ pairs, false if it
+		 *        contains FM-demodulated audio
+		 * @return true on success, false otherwise
+		 */
+		bool openRaw(const char *fname, SampleFormat format, double samplerate, bool iq);
+		void close();
+
+		/**
+		 * Read the next block of samples, blocking if the input is a pipe.
+		 *
+		 * @param out output buffer, with room for 2*maxCount floats for IQ recordings
+		 * @param maxCount maximum number of samples (IQ pairs for IQ recordings) to read
+		 * @return number of samples read, 0 at the end of the recording
+		 */
+		int read(float *out, int maxCount);
+
+		bool isOpen() const { return m_fd != NULL; };
+		double samplerate() const { return m_samplerate; };
+		bool isIQ() const { return m_iq; };
+
+	private:
+		FILE *m_fd;
+		bool m_stdin;
+		SampleFormat m_format;
+		double m_samplerate;
+		bool m_iq;
+		long m_dataLeft;        /* Bytes left in the WAV data chunk, or -1 to read until EOF */
+
+		uint8_t *m_raw;
+		size_t m_rawSize;
+	};
+}
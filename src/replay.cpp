@@ -0,0 +1,179 @@
+#include <chrono>
+#include <math.h>
+#include <string.h>
+#include <dsp/buffer.h>
+#include "replay.hpp"
+
+#define REPLAY_BLOCK_SIZE 16384     /* Samples read from the file at once */
+#define REPLAY_NOISE_SEED 1         /* Seed of the noise generator */
+
+using namespace radiosonde;
+
+Replay::Replay()
+{
+	m_recording = NULL;
+	m_decoder = NULL;
+	m_callback = NULL;
+	m_ctx = NULL;
+	m_frames = 0;
+	m_resampleIQ = m_resampleAudio = false;
+	m_snr = NAN;
+	m_iqBuf = m_channelBuf = NULL;
+	m_audioBuf = m_decoderBuf = NULL;
+}
+
+bool
+Replay::init(Recording *recording, DecoderBase *decoder, float bandwidth, int taps, double outSamplerate,
+             void (*callback)(SondeFullData *data, void *ctx), void *ctx)
+{
+	const double samplerate = recording->samplerate();
+	const bool iq = recording->isIQ();
+	const double audioSamplerate = iq ? bandwidth : samplerate;
+	double channelSamplerate, decoderSamplerate;
+	int channelBufSize, audioBufSize, decoderBufSize;
+
+	if (!recording->isOpen() || m_decoder) return false;
+
+	m_recording = recording;
+	m_decoder = decoder;
+	m_callback = callback;
+	m_ctx = ctx;
+
+	/* IQ is brought down to the channel bandwidth before demodulation, audio
+	 * is only resampled if a specific decoder samplerate was requested */
+	m_resampleIQ = iq && fabs(samplerate - bandwidth) >= 1;
+	m_resampleAudio = outSamplerate > 0 && fabs(audioSamplerate - outSamplerate) >= 1;
+	channelSamplerate = iq ? bandwidth : samplerate;
+	decoderSamplerate = m_resampleAudio ? outSamplerate : audioSamplerate;
+
+	/* Size each buffer for the largest block the previous stage can output */
+	channelBufSize = REPLAY_BLOCK_SIZE * fmax(1.0, channelSamplerate / samplerate) + 1;
+	audioBufSize = fmax(REPLAY_BLOCK_SIZE, channelBufSize);
+	decoderBufSize = audioBufSize * fmax(1.0, decoderSamplerate / audioSamplerate) + 1;
+
+	m_iqBuf = dsp::buffer::alloc<dsp::complex_t>(REPLAY_BLOCK_SIZE);
+	m_channelBuf = dsp::buffer::alloc<dsp::complex_t>(channelBufSize);
+	m_audioBuf = dsp::buffer::alloc<float>(audioBufSize);
+	m_decoderBuf = dsp::buffer::alloc<float>(decoderBufSize);
+
+	if (m_resampleIQ) m_channelResampler.init(NULL, samplerate, bandwidth);
+	if (iq) m_fmDemod.init(NULL, bandwidth, bandwidth/2.0f);
+	if (m_resampleAudio) m_audioResampler.init(NULL, audioSamplerate, decoderSamplerate, taps);
+	m_decoder->init(NULL, decoderSamplerate, dataHandler, this);
+
+	return true;
+}
+
+void
+Replay::deinit()
+{
+	if (m_decoder) {
+		m_decoder->deinit();
+		m_decoder = NULL;
+	}
+
+	if (m_iqBuf) dsp::buffer::free(m_iqBuf);
+	if (m_channelBuf) dsp::buffer::free(m_channelBuf);
+	if (m_audioBuf) dsp::buffer::free(m_audioBuf);
+	if (m_decoderBuf) dsp::buffer::free(m_decoderBuf);
+	m_iqBuf = m_channelBuf = NULL;
+	m_audioBuf = m_decoderBuf = NULL;
+	m_recording = NULL;
+}
+
+void
+Replay::setNoise(float snr)
+{
+	m_snr = snr;
+}
+
+Replay::Stats
+Replay::run()
+{
+	const auto start = std::chrono::steady_clock::now();
+	Stats stats;
+	dsp::complex_t *baseband;
+	float *audio;
+	int count;
+
+	memset(&stats, 0, sizeof(stats));
+	if (!m_decoder) return stats;
+
+	m_frames = 0;
+	m_power = 0;
+	m_powerCount = 0;
+	m_noiseState = REPLAY_NOISE_SEED;
+	for (;;) {
+		count = m_recording->read(m_recording->isIQ() ? (float*)m_iqBuf : m_audioBuf, REPLAY_BLOCK_SIZE);
+		if (count <= 0) break;
+		stats.samples += count;
+
+		if (m_recording->isIQ()) {
+			baseband = m_iqBuf;
+			if (m_resampleIQ) {
+				count = m_channelResampler.process(count, baseband, m_channelBuf);
+				baseband = m_channelBuf;
+			}
+			addNoise((float*)baseband, 2 * count);
+			count = m_fmDemod.process(count, baseband, m_audioBuf);
+		} else {
+			addNoise(m_audioBuf, count);
+		}
+
+		audio = m_audioBuf;
+		if (m_resampleAudio) {
+			count = m_audioResampler.process(count, audio, m_decoderBuf);
+			audio = m_decoderBuf;
+		}
+
+		m_decoder->process(audio, count);
+	}
+
+	stats.duration = stats.samples / m_recording->samplerate();
+	stats.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stats.frames = m_frames;
+	return stats;
+}
+
+/* Private methods {{{ */
+void
+Replay::addNoise(float *samples, int count)
+{
+	double sum = 0;
+	float sigma;
+
+	if (isnan(m_snr) || count <= 0) return;
+
+	/* Power per real component, so that IQ and audio are handled alike */
+	for (int i=0; i<count; i++) sum += samples[i] * samples[i];
+	m_power += sum;
+	m_powerCount += count;
+
+	sigma = sqrt(m_power / m_powerCount / pow(10, m_snr / 10));
+	for (int i=0; i<count; i++) samples[i] += sigma * gaussian();
+}
+
+/* Box-Muller on a linear congruential generator: same sequence on every platform */
+float
+Replay::gaussian()
+{
+	double u1, u2;
+
+	m_noiseState = m_noiseState * 1664525 + 1013904223;
+	u1 = ((m_noiseState >> 8) + 1) / (double)(1 << 24);
+	m_noiseState = m_noiseState * 1664525 + 1013904223;
+	u2 = (m_noiseState >> 8) / (double)(1 << 24);
+
+	return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+void
+Replay::dataHandler(SondeFullData *data, void *ctx)
+{
+	Replay *_this = (Replay*)ctx;
+
+	_this->m_frames++;
+	if (_this->m_callback) _this->m_callback(data, _this->m_ctx);
+}
+/* }}} */
+
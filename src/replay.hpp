@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+#include <dsp/types.h>
+#include <dsp/multirate/rational_resampler.h>
+#include "decode/decoder.hpp"
+#include "frontend.hpp"
+#include "recording.hpp"
+
+namespace radiosonde {
+	/**
+	 * Offline source for the decoders. Reads samples from a recording, and
+	 * pushes them through the same chain used for live reception as fast as
+	 * possible: IQ recordings are resampled to the channel bandwidth and FM
+	 * demodulated, audio recordings are already FM demodulated. The audio is
+	 * then brought to the decoder samplerate with the same FixedResampler and
+	 * taps the plugin uses for the sonde type.
+	 *
+	 * All blocks are driven through their process() method from the calling
+	 * thread, so no DSP threads are started, and the decoder callback is
+	 * invoked synchronously from run().
+	 */
+	class Replay {
+	public:
+		struct Stats {
+			uint64_t samples;   /* Input samples processed (IQ pairs for IQ recordings) */
+			double duration;    /* Length of the recording processed so far, in seconds */
+			double elapsed;     /* Wall clock time spent processing, in seconds */
+			int frames;         /* Number of times the decoder reported new data */
+		};
+
+		Replay();
+		~Replay() { deinit(); };
+
+		/**
+		 * Set up the processing chain for a decoder.
+		 *
+		 * @param recording open recording to read samples from
+		 * @param decoder decoder to feed. Initialized by the replay, and owned by
+		 *        the caller
+		 * @param bandwidth channel bandwidth for the sonde type, in Hz
+		 * @param taps taps per phase of the audio resampler for the sonde type,
+		 *        as used by the plugin (see SondeType::resamplerTaps)
+		 * @param outSamplerate samplerate to resample the demodulated audio to,
+		 *        or 0 to run the decoder at the channel bandwidth
+		 * @param callback function to call whenever new data is decoded
+		 * @param ctx context to pass to the callback
+		 * @return true on success, false otherwise
+		 */
+		bool init(Recording *recording, DecoderBase *decoder, float bandwidth, int taps, double outSamplerate,
+		          void (*callback)(SondeFullData *data, void *ctx), void *ctx);
+		void deinit();
+
+		/**
+		 * Add white Gaussian noise to the input, to measure how decoding holds
+		 * up as the signal gets weaker. IQ recordings get it at the channel
+		 * bandwidth, before demodulation; audio recordings get it after.
+		 * The signal power is taken as the average power of the recording up
+		 * to that point. The noise generator is seeded by run(), so that every
+		 * run adds the same noise.
+		 *
+		 * @param snr signal-to-noise ratio, in dB, or NAN for no noise
+		 */
+		void setNoise(float snr);
+
+		/**
+		 * Process the whole recording.
+		 *
+		 * @return statistics about the run
+		 */
+		Stats run();
+
+	private:
+		Recording *m_recording;
+		DecoderBase *m_decoder;
+		void (*m_callback)(SondeFullData *data, void *ctx);
+		void *m_ctx;
+		int m_frames;
+		bool m_resampleIQ, m_resampleAudio;
+		float m_snr;
+		double m_power;
+		uint64_t m_powerCount;
+		uint32_t m_noiseState;
+
+		dsp::multirate::RationalResampler<dsp::complex_t> m_channelResampler;
+		FMDiscriminator m_fmDemod;
+		FixedResampler m_audioResampler;
+
+		dsp::complex_t *m_iqBuf, *m_channelBuf;
+		float *m_audioBuf, *m_decoderBuf;
+
+		void addNoise(float *samples, int count);
+		float gaussian();
+		static void dataHandler(SondeFullData *data, void *ctx);
+	};
+}
@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include "scanner.hpp"
+
+using namespace radiosonde;
+
+EnergyScanner::EnergyScanner()
+{
+	m_fftSize = m_frames = 0;
+	m_samplerate = 0;
+	m_window = m_power = m_sorted = NULL;
+	m_fftIn = m_fftOut = NULL;
+	m_plan = NULL;
+}
+
+bool
+EnergyScanner::init(int fftSize, double samplerate)
+{
+	if (m_window) deinit();
+	if (fftSize < 2) return false;
+
+	m_fftSize = fftSize;
+	m_samplerate = samplerate;
+
+	/* Hann window, so that strong signals do not leak into the whole band */
+	m_window = new float[fftSize];
+	for (int i=0; i<fftSize; i++) {
+		m_window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / (fftSize - 1));
+	}
+
+	m_power = new float[fftSize];
+	m_sorted = new float[fftSize];
+	m_fftIn = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * fftSize);
+	m_fftOut = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * fftSize);
+	m_plan = fftwf_plan_dft_1d(fftSize, m_fftIn, m_fftOut, FFTW_FORWARD, FFTW_ESTIMATE);
+
+	reset();
+	return true;
+}
+
+void
+EnergyScanner::deinit()
+{
+	if (!m_window) return;
+
+	fftwf_destroy_plan(m_plan);
+	fftwf_free(m_fftIn);
+	fftwf_free(m_fftOut);
+	delete[] m_window;
+	delete[] m_power;
+	delete[] m_sorted;
+
+	m_window = m_power = m_sorted = NULL;
+	m_fftIn = m_fftOut = NULL;
+	m_plan = NULL;
+	m_fftSize = 0;
+}
+
+void
+EnergyScanner::reset()
+{
+	if (!m_window) return;
+	memset(m_power, 0, sizeof(*m_power) * m_fftSize);
+	m_frames = 0;
+}
+
+void
+EnergyScanner::process(const dsp::complex_t *in, int count)
+{
+	if (!m_window || count < m_fftSize) return;
+
+	for (int i=0; i<m_fftSize; i++) {
+		m_fftIn[i][0] = in[i].re * m_window[i];
+		m_fftIn[i][1] = in[i].im * m_window[i];
+	}
+
+	fftwf_execute(m_plan);
+
+	/* Store the spectrum with DC in the middle, so that signals crossing the
+	 * center frequency are contiguous */
+	for (int i=0; i<m_fftSize; i++) {
+		const int k = (i + m_fftSize / 2) % m_fftSize;
+		m_power[i] += m_fftOut[k][0] * m_fftOut[k][0] + m_fftOut[k][1] * m_fftOut[k][1];
+	}
+	m_frames++;
+}
+
+void
+EnergyScanner::detect(float threshold, float minWidth, float maxWidth, std::vector<Detection> &detections)
+{
+	const double binWidth = m_samplerate / m_fftSize;
+	double floor, level, sum, weighted;
+	float peak;
+	int start;
+
+	detections.clear();
+	if (!m_window || !m_frames) return;
+
+	/* Most of the band is empty, so the median is a good estimate of the noise floor */
+	memcpy(m_sorted, m_power, sizeof(*m_power) * m_fftSize);
+	std::nth_element(m_sorted, m_sorted + m_fftSize / 2, m_sorted + m_fftSize);
+	floor = m_sorted[m_fftSize / 2];
+	if (floor <= 0) {
+		reset();
+		return;
+	}
+	level = floor * pow(10, threshold / 10);
+
+	start = -1;
+	sum = weighted = peak = 0;
+	for (int i=0; i<=m_fftSize; i++) {
+		if (i < m_fftSize && m_power[i] > level) {
+			if (start < 0) {
+				start = i;
+				sum = weighted = peak = 0;
+			}
+			sum += m_power[i];
+			weighted += m_power[i] * i;
+			peak = std::max(peak, m_power[i]);
+			continue;
+		}
+		if (start < 0) continue;
+
+		/* End of a region above the threshold */
+		const float width = (i - start) * binWidth;
+		if (width >= minWidth && width <= maxWidth) {
+			Detection detection;
+			detection.offset = (weighted / sum - m_fftSize / 2) * binWidth;
+			detection.width = width;
+			detection.snr = 10 * log10(peak / floor);
+			detections.push_back(detection);
+		}
+		start = -1;
+	}
+
+	reset();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <dsp/types.h>
+#include <fftw3.h>
+#include <vector>
+
+namespace radiosonde {
+	/**
+	 * Power spectrum energy detector. Averages the power spectrum of a wideband
+	 * IQ stream over time, and reports the regions of the spectrum that stand
+	 * out from the noise floor.
+	 *
+	 * Only one FFT frame is taken out of each block of samples passed to
+	 * process(), so the cost is independent of the input samplerate.
+	 */
+	class EnergyScanner {
+	public:
+		struct Detection {
+			double offset;      /* Center of the signal, relative to the center of the input, in Hz */
+			float width;        /* Occupied bandwidth above the threshold, in Hz */
+			float snr;          /* Peak power above the noise floor, in dB */
+		};
+
+		EnergyScanner();
+		~EnergyScanner() { deinit(); };
+
+		/**
+		 * Set up the scanner.
+		 *
+		 * @param fftSize number of FFT bins
+		 * @param samplerate input samplerate, in Hz
+		 * @return true on success, false otherwise
+		 */
+		bool init(int fftSize, double samplerate);
+		void deinit();
+
+		/**
+		 * Discard the power accumulated so far
+		 */
+		void reset();
+
+		/**
+		 * Accumulate the power spectrum of a block of samples.
+		 *
+		 * @param in input samples
+		 * @param count number of input samples
+		 */
+		void process(const dsp::complex_t *in, int count);
+
+		/**
+		 * Look for signals in the averaged spectrum, then start a new average.
+		 *
+		 * @param threshold minimum power above the noise floor, in dB
+		 * @param minWidth narrowest signal to report, in Hz
+		 * @param maxWidth widest signal to report, in Hz
+		 * @param detections vector to fill with one entry per signal found
+		 */
+		void detect(float threshold, float minWidth, float maxWidth, std::vector<Detection> &detections);
+
+	private:
+		int m_fftSize;
+		double m_samplerate;
+		float *m_window;
+		float *m_power, *m_sorted;
+		int m_frames;
+
+		fftwf_complex *m_fftIn, *m_fftOut;
+		fftwf_plan m_plan;
+	};
+}
@@ -0,0 +1,72 @@
+#include <stdlib.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "sched.hpp"
+
+#define MAX_CPU 1023        /* Highest core index accepted in a list */
+
+bool
+radiosonde::applyThreadSchedule(std::thread &thread, const ThreadSchedule &schedule)
+{
+#ifdef __linux__
+	const pthread_t handle = thread.native_handle();
+	const int policy = schedule.priority > 0 ? SCHED_FIFO : SCHED_OTHER;
+	struct sched_param param;
+	cpu_set_t set;
+	bool ok = true;
+
+	/* Pinning to a core that does not exist fails, leaving the thread where it was */
+	CPU_ZERO(&set);
+	if (schedule.cpu >= 0) {
+		if (schedule.cpu < CPU_SETSIZE) CPU_SET(schedule.cpu, &set);
+	} else {
+		for (unsigned i=0; i<std::thread::hardware_concurrency() && i<CPU_SETSIZE; i++) CPU_SET(i, &set);
+	}
+	ok &= !pthread_setaffinity_np(handle, sizeof(set), &set);
+
+	param.sched_priority = 0;
+	if (policy == SCHED_FIFO) {
+		param.sched_priority = schedule.priority;
+		if (param.sched_priority > sched_get_priority_max(policy)) param.sched_priority = sched_get_priority_max(policy);
+		if (param.sched_priority < sched_get_priority_min(policy)) param.sched_priority = sched_get_priority_min(policy);
+	}
+	ok &= !pthread_setschedparam(handle, policy, &param);
+
+	return ok;
+#else
+	(void)thread;
+	return schedule.isDefault();
+#endif
+}
+
+bool
+radiosonde::parseCpuList(const char *str, std::vector<int> &cpus)
+{
+	char *end;
+	long first, last;
+
+	cpus.clear();
+	while (*str == ' ') str++;
+	if (!*str) return true;
+
+	for (;;) {
+		first = last = strtol(str, &end, 10);
+		if (end == str || first < 0 || first > MAX_CPU) return false;
+		str = end;
+
+		if (*str == '-') {
+			str++;
+			last = strtol(str, &end, 10);
+			if (end == str || last < first || last > MAX_CPU) return false;
+			str = end;
+		}
+		for (long cpu=first; cpu<=last; cpu++) cpus.push_back(cpu);
+
+		while (*str == ' ') str++;
+		if (!*str) return true;
+		if (*str++ != ',') return false;
+		while (*str == ' ') str++;
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <dsp/block.h>
+
+namespace radiosonde {
+	/* Where and how a DSP thread runs */
+	struct ThreadSchedule {
+		int cpu;        /* Core to pin the thread to, -1 to let the OS decide */
+		int priority;   /* SCHED_FIFO priority (1-99), 0 for the default policy */
+
+		ThreadSchedule(int cpu = -1, int priority = 0) : cpu(cpu), priority(priority) {}
+		bool isDefault() const { return cpu < 0 && priority <= 0; }
+	};
+
+	/**
+	 * Pin a thread to a core and set its scheduling policy. A default schedule
+	 * lets the thread run on any core with the default policy again.
+	 *
+	 * @param thread thread to update, must be running
+	 * @param schedule settings to apply
+	 * @return true on success, false if the platform does not support it or
+	 *         the process lacks the privileges (e.g. CAP_SYS_NICE for SCHED_FIFO)
+	 */
+	bool applyThreadSchedule(std::thread &thread, const ThreadSchedule &schedule);
+
+	/**
+	 * Parse a list of cores, in the same format as taskset and the kernel
+	 * (e.g. "4-7" or "2,3,6-7").
+	 *
+	 * @param str list to parse, an empty string for no cores
+	 * @param cpus parsed core indices, in order
+	 * @return true on success, false if the list is malformed
+	 */
+	bool parseCpuList(const char *str, std::vector<int> &cpus);
+
+	/**
+	 * dsp::block whose worker thread is pinned and prioritized according to a
+	 * ThreadSchedule every time it is (re)started.
+	 */
+	template<class B>
+	class ScheduledBlock : public B {
+		public:
+			/**
+			 * Change the schedule of the worker thread. Applied immediately if
+			 * the block is running, otherwise the next time it is started.
+			 *
+			 * @param schedule settings to apply
+			 * @return false if the block is running and the settings could not be applied
+			 */
+			bool setSchedule(const ThreadSchedule &schedule) {
+				std::lock_guard<std::recursive_mutex> lck(this->ctrlMtx);
+				const bool changed = schedule.cpu != m_schedule.cpu || schedule.priority != m_schedule.priority;
+
+				m_schedule = schedule;
+				if (changed && this->workerThread.joinable()) m_scheduled = applyThreadSchedule(this->workerThread, m_schedule);
+				return m_scheduled;
+			}
+
+			/**
+			 * Whether the schedule was applied successfully the last time the
+			 * worker thread was started or updated
+			 */
+			bool scheduled() const { return m_scheduled; }
+
+		protected:
+			void doStart() override {
+				B::doStart();
+				if (!m_schedule.isDefault()) m_scheduled = applyThreadSchedule(this->workerThread, m_schedule);
+			}
+
+		private:
+			ThreadSchedule m_schedule;
+			bool m_scheduled = true;
+	};
+}
@@ -0,0 +1,278 @@
+#include <ctype.h>
+#include <string.h>
+#ifdef RADIOSONDE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "segment.hpp"
+
+#define SEGMENT_TIME_FORMAT "%Y%m%d-%H%M%S"
+#define INDEX_SUFFIX ".idx"
+#define ASIDE_SUFFIX ".old"
+
+using namespace radiosonde;
+
+SegmentedFile::SegmentedFile()
+{
+	m_open = false;
+	m_current = -1;
+	m_nextId = 0;
+	m_clock = 0;
+	m_closeHandler = NULL;
+	m_closeCtx = NULL;
+}
+
+bool
+SegmentedFile::open(const char *fname, const SegmentPolicy &policy, const void *header, size_t headerLen)
+{
+	const char *sep, *dot;
+
+	if (m_open) close();
+
+	m_fname = fname;
+	m_policy = policy;
+	m_policy.compress &= compressionSupported();
+	m_header.assign((const uint8_t*)header, (const uint8_t*)header + headerLen);
+	m_nextId = 0;
+	m_clock = 0;
+
+	/* Segments are named after the log: dir/name_<time>.ext */
+	sep = strrchr(fname, '/');
+	if (strrchr(fname, '\\') > sep) sep = strrchr(fname, '\\');
+	dot = strrchr(sep ? sep : fname, '.');
+	if (dot && dot > (sep ? sep + 1 : fname)) {
+		m_stem.assign(fname, dot - fname);
+		m_ext = dot;
+	} else {
+		m_stem = fname;
+		m_ext.clear();
+	}
+
+	/* The unsegmented file is opened right away, as it always was */
+	m_open = true;
+	if (!m_policy.segmented() && !openSegment("")) {
+		m_open = false;
+		return false;
+	}
+	m_current = -1;
+	return true;
+}
+
+void
+SegmentedFile::close()
+{
+	if (!m_open) return;
+	while (!m_segments.empty()) closeSegment(m_segments.size() - 1);
+	m_current = -1;
+	m_open = false;
+}
+
+int64_t
+SegmentedFile::select(time_t time, const char *serial)
+{
+	const char *key = m_policy.perSerial ? serial : "";
+	int idx = -1;
+
+	if (!m_open) return -1;
+
+	for (size_t i=0; i<m_segments.size(); i++) {
+		if (m_segments[i].serial == key) idx = i;
+	}
+
+	/* Full, or from another day */
+	if (idx >= 0) {
+		const Segment &segment = m_segments[idx];
+		const bool full = m_policy.maxSize > 0 && segment.size >= (uint64_t)m_policy.maxSize << 20;
+		const bool expired = m_policy.daily && time > 0 && segment.first > 0 && time / 86400 != segment.first / 86400;
+
+		if (full || expired) {
+			closeSegment(idx);
+			idx = -1;
+		}
+	}
+
+	if (idx < 0) {
+		if (m_segments.size() >= SEGMENT_MAX_OPEN) {
+			size_t lru = 0;
+			for (size_t i=1; i<m_segments.size(); i++) {
+				if (m_segments[i].used < m_segments[lru].used) lru = i;
+			}
+			closeSegment(lru);
+		}
+		if (!openSegment(key)) {
+			m_current = -1;
+			return -1;
+		}
+		idx = m_segments.size() - 1;
+	}
+
+	Segment &segment = m_segments[idx];
+	segment.frames++;
+	segment.used = ++m_clock;
+	if (time > 0) {
+		if (!segment.first) segment.first = time;
+		segment.last = time;
+	}
+	m_current = idx;
+	return segment.id;
+}
+
+void
+SegmentedFile::write(const void *data, size_t len)
+{
+	if (m_current < 0) return;
+
+	Segment &segment = m_segments[m_current];
+#ifdef RADIOSONDE_HAVE_ZLIB
+	if (segment.gz) {
+		gzwrite((gzFile)segment.gz, data, len);
+	} else
+#endif
+	{
+		fwrite(data, 1, len, segment.fd);
+	}
+	segment.size += len;
+}
+
+void
+SegmentedFile::flush()
+{
+	for (auto &segment : m_segments) {
+#ifdef RADIOSONDE_HAVE_ZLIB
+		/* Sync flush: everything so far can be decompressed, at the cost of
+		 * a few bytes of padding */
+		if (segment.gz) {
+			gzflush((gzFile)segment.gz, Z_SYNC_FLUSH);
+			continue;
+		}
+#endif
+		fflush(segment.fd);
+	}
+}
+
+void
+SegmentedFile::setCloseHandler(void (*handler)(int64_t id, void *ctx), void *ctx)
+{
+	m_closeHandler = handler;
+	m_closeCtx = ctx;
+}
+
+bool
+SegmentedFile::compressionSupported()
+{
+#ifdef RADIOSONDE_HAVE_ZLIB
+	return true;
+#else
+	return false;
+#endif
+}
+
+/* Private methods {{{ */
+bool
+SegmentedFile::openSegment(const char *serial)
+{
+	Segment segment;
+
+	segment.id = m_nextId;
+	segment.serial = serial;
+	segment.path = m_policy.segmented() ? segmentPath(serial) : m_fname;
+	segment.fd = NULL;
+	segment.gz = NULL;
+	segment.size = 0;
+	segment.frames = 0;
+	segment.first = segment.last = 0;
+	segment.used = m_clock;
+
+#ifdef RADIOSONDE_HAVE_ZLIB
+	if (m_policy.compress) {
+		if (!(segment.gz = gzopen(segment.path.c_str(), "ab"))) return false;
+	} else
+#endif
+	{
+		if (!(segment.fd = fopen(segment.path.c_str(), "ab"))) return false;
+		fseek(segment.fd, 0, SEEK_END);
+		segment.size = ftell(segment.fd);
+	}
+
+	m_nextId++;
+	m_segments.push_back(segment);
+	m_current = m_segments.size() - 1;
+	if (!segment.size && !m_header.empty()) write(m_header.data(), m_header.size());
+	return true;
+}
+
+void
+SegmentedFile::closeSegment(size_t idx)
+{
+	Segment &segment = m_segments[idx];
+
+#ifdef RADIOSONDE_HAVE_ZLIB
+	if (segment.gz) gzclose((gzFile)segment.gz);
+#endif
+	if (segment.fd) fclose(segment.fd);
+	if (m_policy.segmented() && segment.frames) writeIndex(segment);
+	if (m_closeHandler) m_closeHandler(segment.id, m_closeCtx);
+
+	m_segments.erase(m_segments.begin() + idx);
+	if (m_current == (int)idx) m_current = -1;
+	else if (m_current > (int)idx) m_current--;
+}
+
+void
+SegmentedFile::writeIndex(const Segment &segment)
+{
+	const std::string indexPath = m_fname + INDEX_SUFFIX;
+	const char *name = segment.path.c_str();
+	FILE *fd;
+
+	/* Segments live next to the index, only their name is listed */
+	for (const char *ptr = name; *ptr; ptr++) {
+		if (*ptr == '/' || *ptr == '\\') name = ptr + 1;
+	}
+
+	if (!(fd = fopen(indexPath.c_str(), "ab"))) return;
+	fprintf(fd, "%lld\t%lld\t%ld\t%llu\t%s\t%s\n",
+	        (long long)segment.first, (long long)segment.last, segment.frames,
+	        (unsigned long long)segment.size, segment.serial.c_str(), name);
+	fclose(fd);
+}
+
+/**
+ * Name for a new segment, made unique with a counter if a segment was already
+ * opened within the same second
+ */
+std::string
+SegmentedFile::segmentPath(const char *serial) const
+{
+	const time_t now = time(NULL);
+	char timestr[sizeof("YYYYmmdd-HHMMSS")];
+	std::string base, path;
+	FILE *fd;
+
+	strftime(timestr, sizeof(timestr), SEGMENT_TIME_FORMAT, gmtime(&now));
+	base = m_stem + "_" + timestr;
+	if (serial[0]) {
+		base += "_";
+		for (const char *ptr = serial; *ptr; ptr++) base += isalnum((unsigned char)*ptr) || *ptr == '-' ? *ptr : '_';
+	}
+
+	path = base + m_ext + (m_policy.compress ? ".gz" : "");
+	for (int i=1; (fd = fopen(path.c_str(), "rb")); i++) {
+		fclose(fd);
+		path = base + "-" + std::to_string(i) + m_ext + (m_policy.compress ? ".gz" : "");
+	}
+	return path;
+}
+/* }}} */
+
+bool
+radiosonde::moveAside(const char *fname)
+{
+	std::string path = std::string(fname) + ASIDE_SUFFIX;
+	FILE *fd;
+
+	for (int i=1; (fd = fopen(path.c_str(), "rb")); i++) {
+		fclose(fd);
+		path = std::string(fname) + ASIDE_SUFFIX "-" + std::to_string(i);
+	}
+	return !rename(fname, path.c_str());
+}
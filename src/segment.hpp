@@ -0,0 +1,131 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#define SEGMENT_MAX_OPEN 16     /* Segments open at once when splitting per sonde, the least recently used one is closed first */
+
+namespace radiosonde {
+	/* How a log is split into files */
+	struct SegmentPolicy {
+		int maxSize;        /* Uncompressed size of a segment, in MB, 0 for no limit */
+		bool daily;         /* Start a new segment when the UTC date of the frames changes */
+		bool perSerial;     /* Give every sonde segments of its own */
+		bool compress;      /* gzip the segments, if built with zlib */
+
+		SegmentPolicy(int maxSize = 0, bool daily = false, bool perSerial = false, bool compress = false)
+			: maxSize(maxSize), daily(daily), perSerial(perSerial), compress(compress) {}
+		bool segmented() const { return maxSize > 0 || daily || perSerial || compress; }
+	};
+
+	/**
+	 * Append-only log, optionally split into segments. Files are never
+	 * truncated, so that restarting does not lose what was logged before.
+	 *
+	 * Without segmentation, everything goes to the file itself, and the header
+	 * is only written if the file is empty. Otherwise each segment is a new
+	 * file next to it, named <stem>_<YYYYmmdd-HHMMSS>[_<serial>]<ext>[.gz]
+	 * after the UTC time it was opened at, starting with the header. Closed
+	 * segments are listed in <file>.idx, one per line, tab-separated: first
+	 * and last frame time (UTC epoch), frame count, uncompressed size, serial
+	 * number and file name.
+	 */
+	class SegmentedFile {
+	public:
+		SegmentedFile();
+		~SegmentedFile() { close(); };
+
+		/**
+		 * Open the log. Segments are only created when the first frame that
+		 * goes to them is selected.
+		 *
+		 * @param fname path to the log, or the pattern for the segment names
+		 * @param policy how to split the log
+		 * @param header data to write at the start of a new file
+		 * @param headerLen length of the header, in bytes
+		 * @return true on success, false otherwise
+		 */
+		bool open(const char *fname, const SegmentPolicy &policy, const void *header, size_t headerLen);
+		void close();
+		bool isOpen() const { return m_open; };
+
+		/**
+		 * Pick the segment the next frame goes to, opening a new one if the
+		 * current one is full, is from another day or belongs to another sonde.
+		 * Must be called before writing each frame.
+		 *
+		 * @param time UTC time of the frame, 0 if unknown
+		 * @param serial serial number of the sonde, possibly empty
+		 * @return ID of the segment, -1 if it could not be opened. IDs are
+		 *         never reused: when the ID changes, anything a reader needs
+		 *         from earlier in the segment (e.g. a dictionary) has to be
+		 *         written again. The unsegmented file is segment 0
+		 */
+		int64_t select(time_t time, const char *serial);
+
+		/**
+		 * Append data to the selected segment
+		 */
+		void write(const void *data, size_t len);
+
+		/**
+		 * Commit buffered data to disk, for all the open segments
+		 */
+		void flush();
+
+		/**
+		 * Set a function to call whenever a segment is closed, so that state
+		 * kept per segment ID can be released
+		 *
+		 * @param handler function to call with the ID of the closed segment
+		 * @param ctx context to pass to the handler
+		 */
+		void setCloseHandler(void (*handler)(int64_t id, void *ctx), void *ctx);
+
+		/**
+		 * Whether SegmentPolicy::compress has any effect in this build
+		 */
+		static bool compressionSupported();
+
+	private:
+		struct Segment {
+			int64_t id;
+			std::string serial, path;
+			FILE *fd;
+			void *gz;           /* gzFile, when compressed */
+			uint64_t size;      /* Bytes written, before compression */
+			long frames;
+			time_t first, last; /* Time of the first and last frame with a valid time */
+			uint64_t used;      /* Last time it was selected, in select() calls */
+		};
+
+		bool openSegment(const char *serial);
+		void closeSegment(size_t idx);
+		void writeIndex(const Segment &segment);
+		std::string segmentPath(const char *serial) const;
+
+		bool m_open;
+		std::string m_fname, m_stem, m_ext;
+		SegmentPolicy m_policy;
+		std::vector<uint8_t> m_header;
+		std::vector<Segment> m_segments;
+		int m_current;          /* Index of the selected segment, -1 if none */
+		int64_t m_nextId;
+		uint64_t m_clock;
+		void (*m_closeHandler)(int64_t id, void *ctx);
+		void *m_closeCtx;
+	};
+
+	/**
+	 * Rename a log that can't be appended to, to the first free name among
+	 * <fname>.old, <fname>.old-1, ...
+	 *
+	 * @param fname path to the log
+	 * @return true if the file was renamed, false otherwise
+	 */
+	bool moveAside(const char *fname);
+}
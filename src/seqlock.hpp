@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <string.h>
+#include <type_traits>
+
+namespace radiosonde {
+	/**
+	 * Sequence lock around a trivially copyable value. A single writer can
+	 * update the value at any time without blocking or allocating, and readers
+	 * retry until they get a copy that was not being written to at the same
+	 * time, so that they never observe a half-updated value.
+	 */
+	template<class T>
+	class Seqlock {
+		static_assert(std::is_trivially_copyable<T>::value, "Seqlock requires a trivially copyable type");
+
+	public:
+		Seqlock() : m_seq(0) {}
+
+		/**
+		 * Replace the current value. Must not be called by more than one
+		 * thread at a time.
+		 *
+		 * @param value new value
+		 */
+		void store(const T &value) {
+			const unsigned seq = m_seq.load(std::memory_order_relaxed);
+
+			m_seq.store(seq + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			memcpy((void*)&m_value, (const void*)&value, sizeof(T));
+			m_seq.store(seq + 2, std::memory_order_release);
+		}
+
+		/**
+		 * Get a consistent copy of the current value.
+		 *
+		 * @param value where to store the copy
+		 */
+		void load(T &value) const {
+			unsigned before, after;
+
+			do {
+				before = m_seq.load(std::memory_order_acquire);
+				memcpy((void*)&value, (const void*)&m_value, sizeof(T));
+				std::atomic_thread_fence(std::memory_order_acquire);
+				after = m_seq.load(std::memory_order_relaxed);
+			} while (before != after || (before & 1));
+		}
+
+	private:
+		std::atomic<unsigned> m_seq;
+		T m_value;
+	};
+}
@@ -0,0 +1,38 @@
+#include <string.h>
+#include "sondetypes.hpp"
+
+using namespace radiosonde;
+
+const SondeType radiosonde::sondeTypes[] = {
+	{"rs41", "RS41", 1e4, createDecoder<Decoder<RS41Decoder, rs41_decoder_init, rs41_decoder_deinit, rs41_decode>>, 24},
+	{"dfm09", "DFM06/09", 1.5e4, createDecoder<Decoder<DFM09Decoder, dfm09_decoder_init, dfm09_decoder_deinit, dfm09_decode>>, 16},
+	{"ims100", "iMS100/RS-11G", 2e4, createDecoder<Decoder<IMS100Decoder, ims100_decoder_init, ims100_decoder_deinit, ims100_decode>>, 16},
+	{"m10", "M10/M20", 5e4, createDecoder<Decoder<M10Decoder, m10_decoder_init, m10_decoder_deinit, m10_decode>>, 16},
+	{"imet4", "iMet-4", 2e4, createDecoder<Decoder<IMET4Decoder, imet4_decoder_init, imet4_decoder_deinit, imet4_decode>>, 16},
+	{"c50", "SRS-C50", 2e4, createDecoder<Decoder<C50Decoder, c50_decoder_init, c50_decoder_deinit, c50_decode>>, 16},
+	{"mrzn1", "MRZ-N1", 2e4, createDecoder<Decoder<MRZN1Decoder, mrzn1_decoder_init, mrzn1_decoder_deinit, mrzn1_decode>>, 16},
+};
+const int radiosonde::sondeTypeCount = LEN(sondeTypes);
+static_assert(LEN(sondeTypes) == SONDE_TYPES_COUNT, "SONDE_TYPES_COUNT does not match sondeTypes");
+
+const SondeType*
+radiosonde::findSondeType(const char *id)
+{
+	for (int i=0; i<sondeTypeCount; i++) {
+		if (!strcmp(sondeTypes[i].id, id)) return &sondeTypes[i];
+	}
+	return NULL;
+}
+
+const SondeType*
+radiosonde::guessSondeType(float width)
+{
+	const SondeType *best = NULL, *widest = &sondeTypes[0];
+
+	for (int i=0; i<sondeTypeCount; i++) {
+		const SondeType *type = &sondeTypes[i];
+		if (type->bandwidth >= width && (!best || type->bandwidth < best->bandwidth)) best = type;
+		if (type->bandwidth > widest->bandwidth) widest = type;
+	}
+	return best ? best : widest;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "decode/decoder.hpp"
+
+#define SONDE_TYPES_COUNT 7     /* Entries in sondeTypes, for arrays indexed by type */
+
+namespace radiosonde {
+	/* Description of a supported sonde type, for frontends that create
+	 * decoders on demand */
+	struct SondeType {
+		const char *id;             /* Short name, for command lines and config files */
+		const char *name;           /* Display name */
+		float bandwidth;            /* Channel bandwidth, in Hz */
+		DecoderBase* (*create)();   /* Factory for an uninitialized decoder */
+		int resamplerTaps;          /* Taps per phase of the resampler to the decoder samplerate */
+	};
+
+	extern const SondeType sondeTypes[SONDE_TYPES_COUNT];
+	extern const int sondeTypeCount;
+
+	/**
+	 * Look up a sonde type by its short name.
+	 *
+	 * @param id short name of the type (e.g. "rs41")
+	 * @return pointer to the type description, or NULL if not found
+	 */
+	const SondeType *findSondeType(const char *id);
+
+	/**
+	 * Guess the type of a signal from its occupied bandwidth: picks the
+	 * narrowest type the signal fits in, or the widest one if it does not fit
+	 * in any of them.
+	 *
+	 * @param width occupied bandwidth, in Hz
+	 * @return pointer to the type description
+	 */
+	const SondeType *guessSondeType(float width);
+}
@@ -0,0 +1,124 @@
+#include "threadpool.hpp"
+
+using namespace radiosonde;
+
+void
+ThreadPool::init(int threads)
+{
+	if (!m_workers.empty()) deinit();
+	if (threads <= 0) threads = std::thread::hardware_concurrency();
+
+	m_stop = false;
+	for (int i=0; i<threads-1; i++) {
+		m_workers.emplace_back(&ThreadPool::workerLoop, this, i + 1);
+	}
+}
+
+void
+ThreadPool::deinit()
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_stop = true;
+	}
+	m_workCV.notify_all();
+
+	for (auto &worker : m_workers) worker.join();
+	m_workers.clear();
+}
+
+bool
+ThreadPool::setSchedule(const std::vector<ThreadSchedule> &schedules)
+{
+	bool ok = true, pinned = false;
+
+	for (size_t i=0; i<m_workers.size(); i++) {
+		const ThreadSchedule schedule = i < schedules.size() ? schedules[i] : ThreadSchedule();
+		ok &= applyThreadSchedule(m_workers[i], schedule);
+		pinned |= schedule.cpu >= 0;
+	}
+
+	std::lock_guard<std::mutex> lck(m_mtx);
+	m_pinned = pinned;
+	return ok;
+}
+
+void
+ThreadPool::parallelFor(int count, void (*job)(int idx, void *ctx), void *ctx)
+{
+	if (count <= 0) return;
+
+	/* Nothing to gain from waking up the workers for a single job */
+	if (m_workers.empty() || count == 1) {
+		for (int i=0; i<count; i++) job(i, ctx);
+		return;
+	}
+
+	{
+		/* Workers that woke up late for the previous batch might still be
+		 * looking at the counters: let them go back to sleep first */
+		std::unique_lock<std::mutex> lck(m_mtx);
+		m_doneCV.wait(lck, [this]{ return m_active == 0; });
+
+		m_job = job;
+		m_ctx = ctx;
+		m_count = count;
+		m_next = 0;
+		m_done = 0;
+		m_batchPinned = m_pinned;
+		m_generation++;
+	}
+	m_workCV.notify_all();
+
+	runJobs(0);
+
+	/* Wait for the last jobs to complete, and for all the workers to be done
+	 * touching the job counters before they are reset by the next call */
+	std::unique_lock<std::mutex> lck(m_mtx);
+	m_doneCV.wait(lck, [this]{ return m_done == m_count && m_active == 0; });
+}
+
+/* Private methods {{{ */
+void
+ThreadPool::workerLoop(int self)
+{
+	unsigned long generation = 0;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lck(m_mtx);
+			m_workCV.wait(lck, [&]{ return m_stop || m_generation != generation; });
+			if (m_stop) return;
+			generation = m_generation;
+			m_active++;
+		}
+
+		runJobs(self);
+
+		{
+			std::lock_guard<std::mutex> lck(m_mtx);
+			m_active--;
+		}
+		m_doneCV.notify_all();
+	}
+}
+
+void
+ThreadPool::runJobs(int self)
+{
+	int idx;
+
+	if (m_batchPinned) {
+		for (idx = self; idx < m_count; idx += size()) {
+			m_job(idx, m_ctx);
+			m_done++;
+		}
+		return;
+	}
+
+	while ((idx = m_next++) < m_count) {
+		m_job(idx, m_ctx);
+		m_done++;
+	}
+}
+/* }}} */
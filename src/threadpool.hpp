@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "sched.hpp"
+
+namespace radiosonde {
+	/**
+	 * Fixed-size pool of worker threads, used to spread independent jobs (e.g.
+	 * one per channel) across multiple cores and wait for all of them to finish.
+	 */
+	class ThreadPool {
+	public:
+		ThreadPool() { m_stop = false; m_generation = 0; m_active = 0; m_count = 0; m_pinned = m_batchPinned = false; };
+		~ThreadPool() { deinit(); };
+
+		/**
+		 * Spin up the worker threads.
+		 *
+		 * @param threads number of threads to execute jobs on, including the
+		 *        calling thread. 0 to use as many threads as there are cores
+		 */
+		void init(int threads = 0);
+		void deinit();
+
+		/**
+		 * Number of threads jobs are executed on, including the calling thread
+		 */
+		int size() const { return m_workers.size() + 1; }
+
+		/**
+		 * Pin the worker threads to cores. While any of them is pinned, jobs
+		 * are assigned statically, job i always running on thread i % size()
+		 * (thread 0 being the caller of parallelFor()), so that the state a
+		 * job touches stays in the cache of the same core from one call to
+		 * the next.
+		 *
+		 * @param schedules settings for each worker thread, in order. Workers
+		 *        past the end of the list use the default schedule
+		 * @return false if the settings could not be applied to some of the workers
+		 */
+		bool setSchedule(const std::vector<ThreadSchedule> &schedules);
+
+		/**
+		 * Run job(i, ctx) for every i in [0, count) and wait for all of them to
+		 * complete. The calling thread takes part in executing the jobs.
+		 *
+		 * @param count number of jobs
+		 * @param job function to execute
+		 * @param ctx opaque pointer passed to the function
+		 */
+		void parallelFor(int count, void (*job)(int idx, void *ctx), void *ctx);
+
+	private:
+		void workerLoop(int self);
+		void runJobs(int self);
+
+		std::vector<std::thread> m_workers;
+		std::mutex m_mtx;
+		std::condition_variable m_workCV, m_doneCV;
+		bool m_stop;
+		unsigned long m_generation;
+		int m_active;
+		bool m_pinned, m_batchPinned;
+
+		void (*m_job)(int idx, void *ctx);
+		void *m_ctx;
+		int m_count;
+		std::atomic<int> m_next, m_done;
+	};
+}
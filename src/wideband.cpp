@@ -0,0 +1,419 @@
+#include <math.h>
+#include "wideband.hpp"
+
+#define SCAN_INTERVAL 1.0           /* Seconds of input between scans */
+#define SCAN_RESOLUTION 2e3         /* Maximum width of an FFT bin, in Hz */
+
+using namespace radiosonde;
+
+WidebandReceiver::WidebandReceiver()
+{
+	m_samplerate = m_spacing = m_outSamplerate = m_center = 0;
+	m_callback = NULL;
+	m_ctx = NULL;
+	m_bufSize = m_outCount = 0;
+	m_nextId = 0;
+	m_decoderPool = NULL;
+	m_scanEnabled = false;
+	m_scanThreshold = m_scanMinWidth = m_scanMaxWidth = 0;
+	m_scanCallback = NULL;
+	m_scanCtx = NULL;
+	m_scanSamples = 0;
+}
+
+WidebandReceiver::~WidebandReceiver()
+{
+	if (!_block_init) return;
+	dsp::block::stop();
+	clearChannels();
+	m_pool.deinit();
+	m_channelizer.deinit();
+	m_scanner.deinit();
+}
+
+void
+WidebandReceiver::init(dsp::stream<dsp::complex_t> *in, double samplerate, double spacing, double outSamplerate, int threads,
+                       void (*callback)(SondeFullData *data, void *ctx), void *ctx)
+{
+	int fftSize;
+
+	m_samplerate = samplerate;
+	m_spacing = spacing;
+	m_outSamplerate = outSamplerate;
+	m_callback = callback;
+	m_ctx = ctx;
+
+	m_channelizer.init(lround(samplerate / spacing));
+	m_pool.init(threads);
+	m_bufSize = STREAM_BUFFER_SIZE / m_channelizer.decimation() + 1;
+
+	fftSize = 2;
+	while (fftSize < samplerate / SCAN_RESOLUTION) fftSize *= 2;
+	m_scanner.init(fftSize, samplerate);
+
+	dsp::Sink<dsp::complex_t>::init(in);
+}
+
+void
+WidebandReceiver::setCenterFrequency(double frequency)
+{
+	std::lock_guard<std::mutex> lck(m_channelMtx);
+	m_center = frequency;
+	for (auto &channel : m_channels) retune(channel.get());
+	m_scanner.reset();
+}
+
+int
+WidebandReceiver::addChannel(double frequency, float bandwidth, DecoderBase *decoder, int tag, float timeout)
+{
+	std::shared_ptr<Channel> channel(new Channel);
+	std::unique_ptr<DecoderBase> warmDecoder;
+	const double channelSamplerate = 2 * m_spacing;
+	double decoderSamplerate;
+	int decoderBufSize;
+
+	channel->parent = this;
+	channel->tag = tag;
+	channel->frequency = frequency;
+	channel->bandwidth = bandwidth;
+	channel->timeout = timeout;
+	channel->lastData = std::chrono::steady_clock::now();
+	channel->retuned = false;
+
+	/* Pick up where the last decoder on this frequency left off, if any */
+	if (m_decoderPool) warmDecoder = m_decoderPool->take(tag, frequency, &channel->data);
+	if (warmDecoder) {
+		delete decoder;
+		channel->decoder = std::move(warmDecoder);
+	} else {
+		channel->decoder.reset(decoder);
+	}
+
+	/* Either resample to a fixed rate, or decimate down to the native rate */
+	if (m_outSamplerate > 0) {
+		channel->decimation = 0;
+		decoderSamplerate = m_outSamplerate;
+	} else {
+		channel->decimation = nativeDecimation(bandwidth);
+		decoderSamplerate = bandwidth / channel->decimation;
+	}
+
+	/* Each stage can only shrink the number of samples, except for the
+	 * final resampler to the decoder samplerate */
+	decoderBufSize = m_bufSize * fmax(1.0, decoderSamplerate / bandwidth) + 1;
+	channel->basebandBuf = dsp::buffer::alloc<dsp::complex_t>(m_bufSize);
+	channel->channelBuf = dsp::buffer::alloc<dsp::complex_t>(m_bufSize);
+	channel->audioBuf = dsp::buffer::alloc<float>(m_bufSize);
+	channel->decoderBuf = dsp::buffer::alloc<float>(decoderBufSize);
+
+	channel->xlator.init(NULL, 0, channelSamplerate);
+	channel->channelResampler.init(NULL, channelSamplerate, bandwidth);
+	channel->fmDemod.init(NULL, bandwidth, bandwidth/2.0f);
+	if (channel->decimation == 0) channel->audioResampler.init(NULL, bandwidth, decoderSamplerate);
+	if (channel->decimation > 1) channel->audioDecimator.init(NULL, channel->decimation);
+	channel->decoder->init(NULL, decoderSamplerate, channelDataHandler, channel.get());
+
+	std::lock_guard<std::mutex> lck(m_channelMtx);
+	retune(channel.get());
+	channel->id = m_nextId++;
+	m_channels.push_back(channel);
+	return channel->id;
+}
+
+void
+WidebandReceiver::removeChannel(int id)
+{
+	std::shared_ptr<Channel> channel;
+	DecoderPool *pool;
+
+	{
+		std::lock_guard<std::mutex> lck(m_channelMtx);
+		for (auto it = m_channels.begin(); it != m_channels.end(); it++) {
+			if ((*it)->id == id) {
+				channel = *it;
+				m_channels.erase(it);
+				break;
+			}
+		}
+		pool = m_decoderPool;
+	}
+
+	/* The receiver thread may still be processing it: only waits for this channel */
+	if (channel) park(channel.get(), pool);
+}
+
+void
+WidebandReceiver::clearChannels()
+{
+	std::vector<std::shared_ptr<Channel>> channels;
+	DecoderPool *pool;
+
+	{
+		std::lock_guard<std::mutex> lck(m_channelMtx);
+		channels.swap(m_channels);
+		pool = m_decoderPool;
+	}
+	for (auto &channel : channels) park(channel.get(), pool);
+}
+
+bool
+WidebandReceiver::setThreadSchedule(const std::vector<ThreadSchedule> &schedules)
+{
+	bool ok;
+
+	ok = setSchedule(schedules.empty() ? ThreadSchedule() : schedules[0]);
+	ok &= m_pool.setSchedule(std::vector<ThreadSchedule>(schedules.begin() + (schedules.empty() ? 0 : 1), schedules.end()));
+	return ok;
+}
+
+void
+WidebandReceiver::setDecoderPool(DecoderPool *pool)
+{
+	std::lock_guard<std::mutex> lck(m_channelMtx);
+	m_decoderPool = pool;
+}
+
+void
+WidebandReceiver::getChannels(std::vector<ChannelStatus> &status)
+{
+	std::lock_guard<std::mutex> lck(m_channelMtx);
+
+	status.resize(m_channels.size());
+	for (size_t i=0; i<m_channels.size(); i++) {
+		Channel *channel = m_channels[i].get();
+		std::lock_guard<std::mutex> dataLck(channel->dataMtx);
+
+		status[i].id = channel->id;
+		status[i].frequency = channel->frequency;
+		status[i].tag = channel->tag;
+		status[i].inBand = channel->inBand;
+		status[i].transient = channel->timeout > 0;
+		status[i].bandwidth = channel->bandwidth;
+		status[i].data = channel->data;
+		channel->decoder->metrics().snapshot(&status[i].metrics);
+	}
+}
+
+void
+WidebandReceiver::setScanner(bool enabled, float threshold, float minWidth, float maxWidth,
+                             void (*callback)(double frequency, float width, void *ctx), void *ctx)
+{
+	std::lock_guard<std::mutex> lck(m_channelMtx);
+	if (enabled && !m_scanEnabled) m_scanner.reset();
+	m_scanEnabled = enabled && callback;
+	m_scanThreshold = threshold;
+	m_scanMinWidth = minWidth;
+	m_scanMaxWidth = maxWidth;
+	m_scanCallback = callback;
+	m_scanCtx = ctx;
+}
+
+int
+WidebandReceiver::run()
+{
+	uint64_t start, end;
+	int count;
+
+	start = nowNs();
+	if ((count = _in->read()) < 0) return -1;
+	end = nowNs();
+	m_metrics.waitNs.add(end - start);
+	m_metrics.reads.add(1);
+	start = end;
+
+	{
+		std::lock_guard<std::mutex> lck(m_channelMtx);
+
+		if (m_scanEnabled) m_scanner.process(_in->readBuf, count);
+
+		m_active.clear();
+		m_indices.clear();
+		m_outputs.clear();
+		for (auto &channel : m_channels) {
+			if (!channel->inBand) continue;
+			if (channel->retuned) {
+				channel->xlator.setOffset(-channel->residual, 2 * m_spacing);
+				channel->retuned = false;
+			}
+			m_active.push_back(channel);
+			m_indices.push_back(channel->index);
+			m_outputs.push_back(channel->basebandBuf);
+		}
+	}
+
+	/* Channelize, then demodulate and decode each channel in parallel, without
+	 * holding up getChannels() and the other calls in the meantime */
+	m_outCount = m_channelizer.process(_in->readBuf, count, m_indices.data(), m_indices.size(), m_outputs.data());
+	m_pool.parallelFor(m_active.size(), processChannel, this);
+	m_active.clear();
+
+	_in->flush();
+
+	m_metrics.samples.add(count);
+	m_metrics.blocks.add(1);
+	m_metrics.busyNs.add(nowNs() - start);
+
+	m_scanSamples += count;
+	if (m_scanSamples >= m_samplerate * SCAN_INTERVAL) {
+		m_scanSamples = 0;
+		scan();
+	}
+	return 0;
+}
+
+/* Private methods {{{ */
+WidebandReceiver::Channel::~Channel()
+{
+	decoder.reset();
+	dsp::buffer::free(basebandBuf);
+	dsp::buffer::free(channelBuf);
+	dsp::buffer::free(audioBuf);
+	dsp::buffer::free(decoderBuf);
+}
+
+void
+WidebandReceiver::retune(Channel *channel)
+{
+	const double offset = channel->frequency - m_center;
+
+	channel->inBand = fabs(offset) + channel->bandwidth / 2 < m_samplerate / 2;
+	if (!channel->inBand) return;
+
+	/* Pick the nearest channelizer output, then shift the rest of the way.
+	 * The xlator is only touched by the receiver thread, see run() */
+	channel->index = m_channelizer.channelForOffset(offset, m_samplerate);
+	channel->residual = offset - m_channelizer.channelOffset(channel->index, m_samplerate);
+	channel->retuned = true;
+}
+
+/* Hand the decoder of a channel that was removed from the list over to the
+ * pool, once the receiver thread is done with it */
+void
+WidebandReceiver::park(Channel *channel, DecoderPool *pool)
+{
+	std::lock_guard<std::mutex> procLck(channel->procMtx);
+	std::lock_guard<std::mutex> lck(channel->dataMtx);
+
+	if (!pool) return;
+	pool->park(std::move(channel->decoder), channel->tag, channel->frequency, channel->bandwidth, channel->data);
+}
+
+void
+WidebandReceiver::scan()
+{
+	const auto now = std::chrono::steady_clock::now();
+	void (*callback)(double frequency, float width, void *ctx);
+	void *ctx;
+
+	{
+		std::lock_guard<std::mutex> lck(m_channelMtx);
+
+		/* Tear down channels that have not decoded anything in a while */
+		for (auto it = m_channels.begin(); it != m_channels.end(); ) {
+			Channel *channel = it->get();
+			std::chrono::steady_clock::time_point lastData;
+			const auto timeout = std::chrono::milliseconds((long)(channel->timeout * 1000));
+
+			if (channel->timeout <= 0) {
+				it++;
+				continue;
+			}
+
+			{
+				std::lock_guard<std::mutex> dataLck(channel->dataMtx);
+				lastData = channel->lastData;
+			}
+
+			if (now - lastData < timeout) {
+				it++;
+				continue;
+			}
+
+			HoldOff holdOff;
+			holdOff.frequency = channel->frequency;
+			holdOff.bandwidth = channel->bandwidth;
+			holdOff.until = now + timeout;
+			m_holdOff.push_back(holdOff);
+			park(channel, m_decoderPool);
+			it = m_channels.erase(it);
+		}
+
+		for (auto it = m_holdOff.begin(); it != m_holdOff.end(); ) {
+			if (now >= it->until) it = m_holdOff.erase(it);
+			else it++;
+		}
+
+		if (!m_scanEnabled) return;
+
+		m_scanner.detect(m_scanThreshold, m_scanMinWidth, m_scanMaxWidth, m_detections);
+		m_signals.clear();
+		for (auto &detection : m_detections) {
+			const double frequency = m_center + detection.offset;
+			if (!isOccupied(frequency, detection.width)) m_signals.push_back(std::make_pair(frequency, detection.width));
+		}
+
+		callback = m_scanCallback;
+		ctx = m_scanCtx;
+	}
+
+	/* Called without holding the lock, so that the callback can add channels */
+	for (auto &signal : m_signals) {
+		callback(signal.first, signal.second, ctx);
+	}
+}
+
+bool
+WidebandReceiver::isOccupied(double frequency, float width)
+{
+	for (auto &channel : m_channels) {
+		if (fabs(channel->frequency - frequency) < (channel->bandwidth + width) / 2) return true;
+	}
+	for (auto &holdOff : m_holdOff) {
+		if (fabs(holdOff.frequency - frequency) < (holdOff.bandwidth + width) / 2) return true;
+	}
+	return false;
+}
+
+void
+WidebandReceiver::processChannel(int idx, void *ctx)
+{
+	WidebandReceiver *_this = (WidebandReceiver*)ctx;
+	Channel *channel = _this->m_active[idx].get();
+	int count = _this->m_outCount;
+	std::lock_guard<std::mutex> lck(channel->procMtx);
+
+	/* Removed and parked since the pass started */
+	if (!channel->decoder) return;
+
+	count = channel->xlator.process(count, channel->basebandBuf, channel->basebandBuf);
+	count = channel->channelResampler.process(count, channel->basebandBuf, channel->channelBuf);
+	count = channel->fmDemod.process(count, channel->channelBuf, channel->audioBuf);
+
+	switch (channel->decimation) {
+		case 0:
+			count = channel->audioResampler.process(count, channel->audioBuf, channel->decoderBuf);
+			channel->decoder->process(channel->decoderBuf, count);
+			break;
+		case 1:
+			channel->decoder->process(channel->audioBuf, count);
+			break;
+		default:
+			count = channel->audioDecimator.process(count, channel->audioBuf, channel->decoderBuf);
+			channel->decoder->process(channel->decoderBuf, count);
+			break;
+	}
+}
+
+void
+WidebandReceiver::channelDataHandler(SondeFullData *data, void *ctx)
+{
+	Channel *channel = (Channel*)ctx;
+
+	{
+		std::lock_guard<std::mutex> lck(channel->dataMtx);
+		channel->data = *data;
+		channel->lastData = std::chrono::steady_clock::now();
+	}
+	channel->parent->m_callback(data, channel->parent->m_ctx);
+}
+/* }}} */
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <dsp/sink.h>
+#include <dsp/channel/frequency_xlator.h>
+#include <dsp/multirate/power_decimator.h>
+#include <dsp/multirate/rational_resampler.h>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "channelizer.hpp"
+#include "decoderpool.hpp"
+#include "frontend.hpp"
+#include "scanner.hpp"
+#include "sched.hpp"
+#include "metrics.hpp"
+#include "threadpool.hpp"
+#include "decode/decoder.hpp"
+
+namespace radiosonde {
+	/**
+	 * Multi-channel receiver: takes a wideband IQ stream, splits it into
+	 * channels with a polyphase filter bank, and runs an FM demodulator and a
+	 * decoder on each active channel. Channels are processed in parallel on a
+	 * thread pool, without any per-channel block threads.
+	 *
+	 * Optionally, the input spectrum is scanned for signals, and the caller is
+	 * notified about the ones that are not being decoded yet, so that it can
+	 * start a channel on them.
+	 */
+	class WidebandReceiver : public ScheduledBlock<dsp::Sink<dsp::complex_t>> {
+	public:
+		/* Snapshot of a channel's state, as returned by getChannels() */
+		struct ChannelStatus {
+			int id;
+			double frequency;
+			int tag;
+			bool inBand;
+			bool transient;
+			float bandwidth;
+			SondeFullData data;
+			BlockMetrics::Snapshot metrics;
+		};
+
+		WidebandReceiver();
+		~WidebandReceiver();
+
+		/**
+		 * Initialize the receiver.
+		 *
+		 * @param in input IQ stream
+		 * @param samplerate input samplerate, an even multiple of the spacing
+		 * @param spacing channelizer channel spacing, in Hz. Must be at least twice
+		 *        the widest channel bandwidth
+		 * @param outSamplerate samplerate the decoders are fed at, or 0 to run
+		 *        each decoder at its channel bandwidth (see nativeDecimation())
+		 * @param threads number of worker threads, 0 for one per core
+		 * @param callback function to call with the data from every channel
+		 * @param ctx opaque pointer passed to the callback function
+		 */
+		void init(dsp::stream<dsp::complex_t> *in, double samplerate, double spacing, double outSamplerate, int threads,
+		          void (*callback)(SondeFullData *data, void *ctx), void *ctx);
+
+		/**
+		 * Set the absolute frequency the input is centered on, used to convert
+		 * channel frequencies to offsets. Safe to call while the receiver is running.
+		 *
+		 * @param frequency center frequency, in Hz
+		 */
+		void setCenterFrequency(double frequency);
+
+		/**
+		 * Start decoding a new channel. Safe to call while the receiver is running.
+		 *
+		 * @param frequency absolute frequency of the channel, in Hz
+		 * @param bandwidth channel bandwidth, in Hz
+		 * @param decoder uninitialized decoder for the channel, ownership is
+		 *        transferred to the receiver. If the decoder pool holds a
+		 *        decoder of the same type last used on this frequency, that one
+		 *        is used instead, and this one is destroyed
+		 * @param tag opaque value reported back by getChannels()
+		 * @param timeout remove the channel after this many seconds without any
+		 *        decoded data, 0 to keep it until removeChannel() is called
+		 * @return channel ID. Channels outside of the input band are kept, but
+		 *         are not decoded until the center frequency is moved closer
+		 */
+		int addChannel(double frequency, float bandwidth, DecoderBase *decoder, int tag, float timeout = 0);
+
+		/**
+		 * Stop decoding a channel. Safe to call while the receiver is running.
+		 *
+		 * @param id channel ID, as returned by addChannel()
+		 */
+		void removeChannel(int id);
+		void clearChannels();
+
+		/**
+		 * Get the current state of all channels.
+		 *
+		 * @param status vector to fill with one entry per channel
+		 */
+		void getChannels(std::vector<ChannelStatus> &status);
+
+		/**
+		 * Pin the receiver thread and the channel worker threads to cores.
+		 * While the workers are pinned, each channel is always processed on
+		 * the same thread, so a channel's channelizer output, demodulator,
+		 * resampler and decoder state stay on one core (and its L2 / NUMA
+		 * node). Safe to call while the receiver is running.
+		 *
+		 * @param schedules settings for the receiver thread, then for each of
+		 *        the worker threads. Threads past the end of the list use the
+		 *        default schedule
+		 * @return false if the settings could not be applied to some of the threads
+		 */
+		bool setThreadSchedule(const std::vector<ThreadSchedule> &schedules);
+
+		/**
+		 * Number of threads processing the input: the receiver thread, plus
+		 * the channel workers
+		 */
+		int threads() const { return m_pool.size(); }
+
+		/**
+		 * Set the pool that the decoders of removed channels are parked in, and
+		 * that new channels take their decoder from when possible. The pool
+		 * can outlive the receiver.
+		 *
+		 * @param pool decoder pool, or NULL to destroy decoders along with
+		 *        their channel
+		 */
+		void setDecoderPool(DecoderPool *pool);
+
+		/**
+		 * Configure the energy scanner. Safe to call while the receiver is running.
+		 *
+		 * @param enabled true to scan the input for signals, false otherwise
+		 * @param threshold minimum power above the noise floor, in dB
+		 * @param minWidth narrowest signal to report, in Hz
+		 * @param maxWidth widest signal to report, in Hz
+		 * @param callback function to call, from the receiver thread, for every
+		 *        signal found that is not covered by an existing channel. It is
+		 *        free to call addChannel()
+		 * @param ctx opaque pointer passed to the callback function
+		 */
+		void setScanner(bool enabled, float threshold, float minWidth, float maxWidth,
+		                void (*callback)(double frequency, float width, void *ctx), void *ctx);
+
+		/**
+		 * Counters for the receiver as a whole: input samples, time spent
+		 * channelizing and decoding, and time spent waiting for input
+		 */
+		const BlockMetrics &metrics() const { return m_metrics; }
+
+		int run() override;
+
+	private:
+		struct Channel {
+			~Channel();
+
+			WidebandReceiver *parent;
+			int id, tag;
+			double frequency;
+			float bandwidth;
+			int index;
+			bool inBand;
+			float timeout;
+
+			dsp::channel::FrequencyXlator xlator;
+			dsp::multirate::RationalResampler<dsp::complex_t> channelResampler;
+			FMDiscriminator fmDemod;
+			FixedResampler audioResampler;
+			dsp::multirate::PowerDecimator<float> audioDecimator;
+			int decimation;     /* 0 when going through the resampler */
+			std::unique_ptr<DecoderBase> decoder;
+			std::mutex procMtx;     /* Held while the channel is processed, and while its decoder is parked */
+
+			double residual;        /* Offset left for the xlator, applied by the receiver thread */
+			bool retuned;
+
+			dsp::complex_t *basebandBuf, *channelBuf;
+			float *audioBuf, *decoderBuf;
+
+			std::mutex dataMtx;
+			SondeFullData data;
+			std::chrono::steady_clock::time_point lastData;
+		};
+
+		/* Frequency where a timed out channel used to be, not reported by the
+		 * scanner for a while so that unknown signals are not retried forever */
+		struct HoldOff {
+			double frequency;
+			float bandwidth;
+			std::chrono::steady_clock::time_point until;
+		};
+
+		void retune(Channel *channel);
+		void park(Channel *channel, DecoderPool *pool);
+		void scan();
+		bool isOccupied(double frequency, float width);
+		static void processChannel(int idx, void *ctx);
+		static void channelDataHandler(SondeFullData *data, void *ctx);
+
+		double m_samplerate, m_spacing, m_outSamplerate, m_center;
+		void (*m_callback)(SondeFullData *data, void *ctx);
+		void *m_ctx;
+
+		Channelizer m_channelizer;
+		ThreadPool m_pool;
+		int m_bufSize, m_outCount;
+
+		/* Guards the channel list and the scanner. Only held by the receiver
+		 * thread while it takes the list of channels to process, which then
+		 * stay alive until it is done with them even if they are removed */
+		std::mutex m_channelMtx;
+		std::vector<std::shared_ptr<Channel>> m_channels;
+		std::vector<std::shared_ptr<Channel>> m_active;
+		std::vector<int> m_indices;
+		std::vector<dsp::complex_t*> m_outputs;
+		int m_nextId;
+		DecoderPool *m_decoderPool;
+
+		EnergyScanner m_scanner;
+		bool m_scanEnabled;
+		float m_scanThreshold, m_scanMinWidth, m_scanMaxWidth;
+		void (*m_scanCallback)(double frequency, float width, void *ctx);
+		void *m_scanCtx;
+		long m_scanSamples;
+		std::vector<EnergyScanner::Detection> m_detections;
+		std::vector<std::pair<double, float>> m_signals;    /* Frequency and width of new signals */
+		std::vector<HoldOff> m_holdOff;
+
+		BlockMetrics m_metrics;
+	};
+}
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "flightlog.hpp"
+
+static void usage(const char *pname);
+static bool has_suffix(const char *str, const char *suffix);
+
+int
+main(int argc, char *argv[])
+{
+	FlightLogReader reader;
+	SondeFullData first, last;
+	char timestr[64];
+
+	if (argc < 2 || argc > 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!reader.open(argv[1])) {
+		fprintf(stderr, "%s: not a valid flight log\n", argv[1]);
+		return 1;
+	}
+
+	/* No output: print a summary of the log */
+	if (argc == 2) {
+		printf("Frames: %zu\n", reader.frameCount());
+		if (reader.frameCount()) {
+			reader.getFrame(0, &first);
+			reader.getFrame(reader.frameCount() - 1, &last);
+			strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", gmtime(&first.time));
+			printf("First:  %s %s\n", timestr, first.serial);
+			strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", gmtime(&last.time));
+			printf("Last:   %s %s\n", timestr, last.serial);
+		}
+		return 0;
+	}
+
+	if (has_suffix(argv[2], ".gpx")) {
+		if (!reader.exportGPX(argv[2])) {
+			fprintf(stderr, "%s: could not write GPX\n", argv[2]);
+			return 1;
+		}
+	} else {
+		if (!reader.exportCSV(argv[2])) {
+			fprintf(stderr, "%s: could not write CSV\n", argv[2]);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+usage(const char *pname)
+{
+	fprintf(stderr, "Usage: %s <log> [output.csv|output.gpx]\n", pname);
+	fprintf(stderr, "Convert a binary flight log to CSV or GPX, or print a summary if no output is given\n");
+}
+
+static bool
+has_suffix(const char *str, const char *suffix)
+{
+	const size_t len = strlen(str), suffixLen = strlen(suffix);
+	return len >= suffixLen && !strcmp(str + len - suffixLen, suffix);
+}
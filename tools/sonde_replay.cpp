@@ -0,0 +1,175 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "decode/decoder.hpp"
+#include "gpx.hpp"
+#include "ptu.hpp"
+#include "replay.hpp"
+#include "sondetypes.hpp"
+
+#define OUT_SAMPLE_RATE 48000
+
+struct Output {
+	GPXWriter gpx;
+	PTUWriter ptu;
+	bool gpxOutput, ptuOutput, quiet;
+};
+
+static void usage(const char *pname);
+static bool has_suffix(const char *str, const char *suffix);
+static void data_handler(SondeFullData *data, void *ctx);
+
+int
+main(int argc, char *argv[])
+{
+	const radiosonde::SondeType *type = &radiosonde::sondeTypes[0];
+	radiosonde::Recording recording;
+	radiosonde::Replay replay;
+	radiosonde::Replay::Stats stats;
+	radiosonde::Recording::SampleFormat format = radiosonde::Recording::SAMPLE_F32;
+	radiosonde::DecoderBase *decoder;
+	Output output;
+	const char *gpxPath = NULL, *ptuPath = NULL, *input = NULL;
+	double samplerate = 0, outSamplerate = OUT_SAMPLE_RATE, snr = NAN;
+	bool audio = false, opened;
+
+	output.gpxOutput = output.ptuOutput = output.quiet = false;
+
+	for (int i=1; i<argc; i++) {
+		const char *arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (!strcmp(arg, "-t") && hasValue) {
+			if (!(type = radiosonde::findSondeType(argv[i+1]))) {
+				fprintf(stderr, "Unknown sonde type: %s\n", argv[i+1]);
+				return 1;
+			}
+			i++;
+		} else if (!strcmp(arg, "-f") && hasValue) {
+			if (!strcmp(argv[i+1], "u8")) format = radiosonde::Recording::SAMPLE_U8;
+			else if (!strcmp(argv[i+1], "s16")) format = radiosonde::Recording::SAMPLE_S16;
+			else if (!strcmp(argv[i+1], "f32")) format = radiosonde::Recording::SAMPLE_F32;
+			else {
+				fprintf(stderr, "Unknown sample format: %s\n", argv[i+1]);
+				return 1;
+			}
+			i++;
+		} else if (!strcmp(arg, "-r") && hasValue) {
+			samplerate = atof(argv[++i]);
+		} else if (!strcmp(arg, "-a")) {
+			audio = true;
+		} else if (!strcmp(arg, "-n")) {
+			outSamplerate = 0;
+		} else if (!strcmp(arg, "-s") && hasValue) {
+			snr = atof(argv[++i]);
+		} else if (!strcmp(arg, "-g") && hasValue) {
+			gpxPath = argv[++i];
+		} else if (!strcmp(arg, "-o") && hasValue) {
+			ptuPath = argv[++i];
+		} else if (!strcmp(arg, "-q")) {
+			output.quiet = true;
+		} else if (arg[0] == '-' || input) {
+			usage(argv[0]);
+			return 1;
+		} else {
+			input = arg;
+		}
+	}
+
+	if (!input) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	/* WAV files describe their own format, anything else needs to be told */
+	if (has_suffix(input, ".wav") || has_suffix(input, ".WAV")) {
+		opened = recording.openWAV(input);
+	} else if (samplerate > 0) {
+		opened = recording.openRaw(input, format, samplerate, !audio);
+	} else {
+		fprintf(stderr, "%s: the samplerate of raw files must be specified with -r\n", input);
+		return 1;
+	}
+	if (!opened) {
+		fprintf(stderr, "%s: could not open recording\n", input);
+		return 1;
+	}
+
+	if (gpxPath && !(output.gpxOutput = output.gpx.init(gpxPath))) {
+		fprintf(stderr, "%s: could not open GPX output\n", gpxPath);
+		return 1;
+	}
+	if (ptuPath && !(output.ptuOutput = output.ptu.init(ptuPath))) {
+		fprintf(stderr, "%s: could not open CSV output\n", ptuPath);
+		return 1;
+	}
+
+	decoder = type->create();
+	if (!replay.init(&recording, decoder, type->bandwidth, type->resamplerTaps, outSamplerate, data_handler, &output)) {
+		fprintf(stderr, "%s: could not set up the decoder\n", input);
+		delete decoder;
+		return 1;
+	}
+
+	replay.setNoise(snr);
+	stats = replay.run();
+	replay.deinit();
+	delete decoder;
+
+	output.gpx.deinit();
+	output.ptu.deinit();
+
+	fprintf(stderr, "%s: %llu %s samples at %.0f Hz, %d frames\n",
+	        input, (unsigned long long)stats.samples, recording.isIQ() ? "IQ" : "audio", recording.samplerate(), stats.frames);
+	fprintf(stderr, "Decoded %.1f s in %.2f s: %.2f Msamples/s, %.0fx realtime\n",
+	        stats.duration, stats.elapsed,
+	        stats.elapsed > 0 ? stats.samples / stats.elapsed * 1e-6 : 0,
+	        stats.elapsed > 0 ? stats.duration / stats.elapsed : 0);
+
+	return 0;
+}
+
+static void
+usage(const char *pname)
+{
+	fprintf(stderr, "Usage: %s [options] <recording>\n", pname);
+	fprintf(stderr, "Decode a WAV or raw recording as fast as possible\n\n");
+	fprintf(stderr, "   -t <type>     Sonde type (rs41, dfm09, ims100, m10, imet4, c50, mrzn1; default rs41)\n");
+	fprintf(stderr, "   -f <format>   Sample format of raw recordings (u8, s16, f32; default f32)\n");
+	fprintf(stderr, "   -r <rate>     Samplerate of raw recordings, in Hz\n");
+	fprintf(stderr, "   -a            Raw recording contains FM-demodulated audio instead of IQ\n");
+	fprintf(stderr, "   -n            Run the decoder at the channel bandwidth instead of 48kHz\n");
+	fprintf(stderr, "   -s <snr>      Add white noise, for the given signal-to-noise ratio in dB\n");
+	fprintf(stderr, "   -g <file>     Write the track to a GPX file\n");
+	fprintf(stderr, "   -o <file>     Write the decoded data to a CSV file\n");
+	fprintf(stderr, "   -q            Do not print decoded frames\n");
+	fprintf(stderr, "\nMono WAV files are treated as audio, stereo WAV files as IQ\n");
+}
+
+static bool
+has_suffix(const char *str, const char *suffix)
+{
+	const size_t len = strlen(str), suffixLen = strlen(suffix);
+	return len >= suffixLen && !strcmp(str + len - suffixLen, suffix);
+}
+
+static void
+data_handler(SondeFullData *data, void *ctx)
+{
+	Output *output = (Output*)ctx;
+	char timestr[64];
+
+	if (output->gpxOutput) {
+		if (data->serial[0]) output->gpx.startTrack(data->serial);
+		output->gpx.addPoint(data);
+	}
+	if (output->ptuOutput) output->ptu.addPoint(data);
+
+	if (!output->quiet) {
+		strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", gmtime(&data->time));
+		printf("%s %s %.5f %.5f %.0fm %.1fC %.0f%% %.1fhPa\n",
+		       timestr, data->serial, data->lat, data->lon, data->alt, data->temp, data->rh, data->pressure);
+	}
+}
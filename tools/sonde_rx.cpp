@@ -0,0 +1,313 @@
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "asyncwriter.hpp"
+#include "flightlog.hpp"
+#include "gpxtracks.hpp"
+#include "netwriter.hpp"
+#include "ptu.hpp"
+#include "recording.hpp"
+#include "sondetypes.hpp"
+#include "wideband.hpp"
+
+#define OUT_SAMPLE_RATE 48000
+#define WIDEBAND_SPACING 100e3  /* Same as the plugin */
+#define READ_SIZE 65536         /* IQ samples read from the input at once */
+#define OUTPUT_QUEUE_SIZE 1024
+#define FLUSH_INTERVAL 1000
+#define FLUSH_SIZE 64
+
+struct Receiver {
+	radiosonde::DecoderPool decoderPool;    /* Declared first, so that it outlives the receiver */
+	radiosonde::WidebandReceiver rx;
+	radiosonde::AsyncWriter writer;
+	const radiosonde::SondeType *scanType;  /* NULL to guess from the occupied bandwidth */
+	float scanTimeout;
+
+	GPXTrackSet gpx;
+	PTUWriter ptu;
+	FlightLogWriter flightLog;
+	NetWriter net;
+	bool gpxOutput, ptuOutput, flightLogOutput, quiet;
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void usage(const char *pname);
+static bool add_channel(Receiver *receiver, const char *spec);
+static void data_handler(SondeFullData *data, void *ctx);
+static void signal_handler(double frequency, float width, void *ctx);
+static void write_batch(const SondeFullData *data, int count, void *ctx);
+static void flush_output(void *ctx);
+static void on_interrupt(int signum);
+
+int
+main(int argc, char *argv[])
+{
+	Receiver receiver;
+	radiosonde::Recording recording;
+	radiosonde::Recording::SampleFormat format = radiosonde::Recording::SAMPLE_U8;
+	dsp::stream<dsp::complex_t> input;
+	std::vector<const char*> channels;
+	const char *gpxPath = NULL, *ptuPath = NULL, *flightLogPath = NULL, *inputPath = "-";
+	const char *netAddress = NULL;
+	int netTransport = NetWriter::TRANSPORT_UDP, netFormat = NetWriter::FORMAT_JSON;
+	double samplerate = 0, center = 0, outSamplerate = OUT_SAMPLE_RATE;
+	float scanThreshold = 10;
+	radiosonde::SegmentPolicy segments;
+	bool scan = false;
+	int threads = 0, count;
+
+	receiver.scanType = NULL;
+	receiver.scanTimeout = 60;
+	receiver.gpxOutput = receiver.ptuOutput = receiver.flightLogOutput = receiver.quiet = false;
+
+	for (int i=1; i<argc; i++) {
+		const char *arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (!strcmp(arg, "-r") && hasValue) {
+			samplerate = atof(argv[++i]);
+		} else if (!strcmp(arg, "-c") && hasValue) {
+			center = atof(argv[++i]) * 1e6;
+		} else if (!strcmp(arg, "-f") && hasValue) {
+			if (!strcmp(argv[i+1], "u8")) format = radiosonde::Recording::SAMPLE_U8;
+			else if (!strcmp(argv[i+1], "s16")) format = radiosonde::Recording::SAMPLE_S16;
+			else if (!strcmp(argv[i+1], "f32")) format = radiosonde::Recording::SAMPLE_F32;
+			else {
+				fprintf(stderr, "Unknown sample format: %s\n", argv[i+1]);
+				return 1;
+			}
+			i++;
+		} else if (!strcmp(arg, "-t") && hasValue) {
+			channels.push_back(argv[++i]);
+		} else if (!strcmp(arg, "-s")) {
+			scan = true;
+		} else if (!strcmp(arg, "-S") && hasValue) {
+			scan = true;
+			if (!(receiver.scanType = radiosonde::findSondeType(argv[i+1]))) {
+				fprintf(stderr, "Unknown sonde type: %s\n", argv[i+1]);
+				return 1;
+			}
+			i++;
+		} else if (!strcmp(arg, "-T") && hasValue) {
+			scanThreshold = atof(argv[++i]);
+		} else if (!strcmp(arg, "-x") && hasValue) {
+			receiver.scanTimeout = atof(argv[++i]);
+		} else if (!strcmp(arg, "-j") && hasValue) {
+			threads = atoi(argv[++i]);
+		} else if (!strcmp(arg, "-n")) {
+			outSamplerate = 0;
+		} else if (!strcmp(arg, "-g") && hasValue) {
+			gpxPath = argv[++i];
+		} else if (!strcmp(arg, "-o") && hasValue) {
+			ptuPath = argv[++i];
+		} else if (!strcmp(arg, "-l") && hasValue) {
+			flightLogPath = argv[++i];
+		} else if (!strcmp(arg, "-p")) {
+			segments.perSerial = true;
+		} else if (!strcmp(arg, "-d")) {
+			segments.daily = true;
+		} else if (!strcmp(arg, "-m") && hasValue) {
+			segments.maxSize = atoi(argv[++i]);
+		} else if (!strcmp(arg, "-z")) {
+			segments.compress = true;
+		} else if (!strcmp(arg, "-u") && hasValue) {
+			netAddress = argv[++i];
+			netTransport = NetWriter::TRANSPORT_UDP;
+		} else if (!strcmp(arg, "-U") && hasValue) {
+			netAddress = argv[++i];
+			netTransport = NetWriter::TRANSPORT_TCP;
+		} else if (!strcmp(arg, "-b")) {
+			netFormat = NetWriter::FORMAT_BINARY;
+		} else if (!strcmp(arg, "-q")) {
+			receiver.quiet = true;
+		} else if (!strcmp(arg, "-h") || (arg[0] == '-' && arg[1])) {
+			usage(argv[0]);
+			return 1;
+		} else {
+			inputPath = arg;
+		}
+	}
+
+	/* The channelizer needs the samplerate to be an even multiple of the spacing */
+	if (samplerate <= 0 || lround(samplerate / WIDEBAND_SPACING) % 2
+	 || fabs(samplerate - lround(samplerate / WIDEBAND_SPACING) * WIDEBAND_SPACING) >= 1) {
+		fprintf(stderr, "The samplerate must be a multiple of %.0f Hz\n", 2 * WIDEBAND_SPACING);
+		return 1;
+	}
+	if (channels.empty() && !scan) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!recording.openRaw(inputPath, format, samplerate, true)) {
+		fprintf(stderr, "%s: could not open input\n", inputPath);
+		return 1;
+	}
+	if (gpxPath && !(receiver.gpxOutput = receiver.gpx.init(gpxPath))) {
+		fprintf(stderr, "%s: could not open GPX output\n", gpxPath);
+		return 1;
+	}
+	if (segments.compress && !radiosonde::SegmentedFile::compressionSupported()) {
+		fprintf(stderr, "Built without zlib, logs are not compressed\n");
+	}
+	if (ptuPath && !(receiver.ptuOutput = receiver.ptu.init(ptuPath, segments))) {
+		fprintf(stderr, "%s: could not open CSV output\n", ptuPath);
+		return 1;
+	}
+	if (flightLogPath && !(receiver.flightLogOutput = receiver.flightLog.init(flightLogPath, segments))) {
+		fprintf(stderr, "%s: could not open flight log\n", flightLogPath);
+		return 1;
+	}
+
+	if (netAddress && !receiver.net.init(netAddress, netTransport, netFormat)) {
+		fprintf(stderr, "%s: could not open network output\n", netAddress);
+		return 1;
+	}
+
+	receiver.writer.init(OUTPUT_QUEUE_SIZE, FLUSH_INTERVAL, FLUSH_SIZE, write_batch, flush_output, &receiver);
+	receiver.rx.init(&input, samplerate, WIDEBAND_SPACING, outSamplerate, threads, data_handler, &receiver);
+	receiver.rx.setDecoderPool(&receiver.decoderPool);
+	receiver.rx.setCenterFrequency(center);
+	for (auto spec : channels) {
+		if (!add_channel(&receiver, spec)) {
+			fprintf(stderr, "Invalid channel: %s (expected type:MHz, e.g. rs41:403.5)\n", spec);
+			return 1;
+		}
+	}
+	if (scan) receiver.rx.setScanner(true, scanThreshold, 5e3, 60e3, signal_handler, &receiver);
+
+	signal(SIGINT, on_interrupt);
+	signal(SIGTERM, on_interrupt);
+
+	/* Feed the receiver from this thread, until the input runs out. The
+	 * receiver decodes on its own thread and worker pool */
+	receiver.rx.start();
+	while (!stopRequested && (count = recording.read((float*)input.writeBuf, READ_SIZE)) > 0) {
+		if (!input.swap(count)) break;
+	}
+
+	/* Empty swap: returns once the receiver has consumed the last block */
+	input.swap(0);
+	receiver.rx.stop();
+
+	receiver.writer.deinit();
+	receiver.gpx.deinit();
+	receiver.ptu.deinit();
+	receiver.flightLog.deinit();
+	receiver.net.deinit();
+	return 0;
+}
+
+static void
+usage(const char *pname)
+{
+	fprintf(stderr, "Usage: %s [options] [input]\n", pname);
+	fprintf(stderr, "Decode radiosondes from a wideband IQ stream (standard input by default)\n\n");
+	fprintf(stderr, "   -r <rate>        Input samplerate, a multiple of %.0f Hz\n", 2 * WIDEBAND_SPACING);
+	fprintf(stderr, "   -c <MHz>         Center frequency of the input\n");
+	fprintf(stderr, "   -f <format>      Sample format (u8, s16, f32; default u8)\n");
+	fprintf(stderr, "   -t <type:MHz>    Decode a channel (e.g. rs41:403.5), can be repeated\n");
+	fprintf(stderr, "   -s               Scan for signals, guessing their type from the bandwidth\n");
+	fprintf(stderr, "   -S <type>        Scan for signals of the given type\n");
+	fprintf(stderr, "   -T <dB>          Scanner threshold above the noise floor (default 10)\n");
+	fprintf(stderr, "   -x <seconds>     Drop scanned channels after this long without data (default 60)\n");
+	fprintf(stderr, "   -j <threads>     Decoder threads (default: one per core)\n");
+	fprintf(stderr, "   -n               Run the decoders at the channel bandwidth instead of 48kHz\n");
+	fprintf(stderr, "   -g <file>        Write one GPX track per sonde (serial appended to the name)\n");
+	fprintf(stderr, "   -o <file>        Write the decoded data to a CSV file\n");
+	fprintf(stderr, "   -l <file>        Write the decoded data to a binary flight log\n");
+	fprintf(stderr, "   -p               Split the CSV and binary logs per sonde\n");
+	fprintf(stderr, "   -d               Split the CSV and binary logs per day (UTC)\n");
+	fprintf(stderr, "   -m <MB>          Split the CSV and binary logs every <MB> megabytes\n");
+	fprintf(stderr, "   -z               Compress the CSV and binary logs with gzip\n");
+	fprintf(stderr, "   -u <host:port>   Send the decoded data as UDP datagrams (Horus JSON by default)\n");
+	fprintf(stderr, "   -U <[host:]port> Stream the decoded data to TCP clients connecting to this port\n");
+	fprintf(stderr, "   -b               Send binary records instead of JSON over the network\n");
+	fprintf(stderr, "   -q               Do not print decoded frames\n");
+	fprintf(stderr, "\nSonde types:");
+	for (int i=0; i<radiosonde::sondeTypeCount; i++) fprintf(stderr, " %s", radiosonde::sondeTypes[i].id);
+	fprintf(stderr, "\n");
+}
+
+static bool
+add_channel(Receiver *receiver, const char *spec)
+{
+	const radiosonde::SondeType *type;
+	const char *sep;
+	char id[32];
+	double frequency;
+
+	if (!(sep = strchr(spec, ':')) || sep - spec >= (long)sizeof(id)) return false;
+	snprintf(id, sizeof(id), "%.*s", (int)(sep - spec), spec);
+	if (!(type = radiosonde::findSondeType(id))) return false;
+	if ((frequency = atof(sep + 1) * 1e6) <= 0) return false;
+
+	receiver->rx.addChannel(frequency, type->bandwidth, type->create(), type - radiosonde::sondeTypes);
+	return true;
+}
+
+static void
+data_handler(SondeFullData *data, void *ctx)
+{
+	Receiver *receiver = (Receiver*)ctx;
+
+	/* Called from the decoder threads, file I/O happens on the writer thread */
+	receiver->writer.push(*data);
+}
+
+static void
+signal_handler(double frequency, float width, void *ctx)
+{
+	Receiver *receiver = (Receiver*)ctx;
+	const radiosonde::SondeType *type = receiver->scanType ? receiver->scanType : radiosonde::guessSondeType(width);
+
+	if (!receiver->quiet) fprintf(stderr, "New signal at %.4f MHz (%.1f kHz), decoding as %s\n", frequency * 1e-6, width * 1e-3, type->name);
+	receiver->rx.addChannel(frequency, type->bandwidth, type->create(), type - radiosonde::sondeTypes, receiver->scanTimeout);
+}
+
+static void
+write_batch(const SondeFullData *data, int count, void *ctx)
+{
+	Receiver *receiver = (Receiver*)ctx;
+	char timestr[64];
+
+	for (int i=0; i<count; i++) {
+		if (receiver->gpxOutput) {
+			receiver->gpx.addPoint(&data[i]);
+		}
+		if (receiver->ptuOutput) receiver->ptu.addPoint(&data[i]);
+		if (receiver->flightLogOutput) receiver->flightLog.addPoint(&data[i]);
+		receiver->net.addPoint(&data[i]);
+
+		if (!receiver->quiet) {
+			strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", gmtime(&data[i].time));
+			printf("%s %s %.5f %.5f %.0fm %.1fC %.0f%% %.1fhPa\n",
+			       timestr, data[i].serial, data[i].lat, data[i].lon, data[i].alt, data[i].temp, data[i].rh, data[i].pressure);
+		}
+	}
+	receiver->net.flush();
+}
+
+static void
+flush_output(void *ctx)
+{
+	Receiver *receiver = (Receiver*)ctx;
+
+	if (receiver->gpxOutput) receiver->gpx.flush();
+	if (receiver->ptuOutput) receiver->ptu.flush();
+	if (receiver->flightLogOutput) receiver->flightLog.flush();
+	receiver->net.flush();
+	fflush(stdout);
+}
+
+static void
+on_interrupt(int signum)
+{
+	(void)signum;
+	stopRequested = 1;
+}